@@ -130,6 +130,10 @@ public:
     }
 };
 
+// extern __shared__ arrays have no size of their own: the launch gives their size, in
+// cudaConfigureCall, so they all live in one local buffer, passed in as a kernel argument
+bool isDynamicSharedMemory(llvm::Value *value);
+
 class SharedClWriter : public ClWriter {
 public:
     SharedClWriter(LocalValueInfo *localValueInfo) :
@@ -6,6 +6,10 @@
 #include <set>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string>
+#include <vector>
 
 extern "C" {
     size_t cuCtxSynchronize(void);
@@ -32,13 +36,53 @@ namespace easycl {
 
 namespace cocl {
     class Memory;
+    class MemoryCache;
+    class SlabAllocator;
     class CoclStream;
+    class KernelWarmup;
+    class StagingPool;
 
     class KernelInfo {
     public:
         // CLKernel *kernel = 0;
         bool usesVmem = false;
-        bool usesScratch = false;
+        int scratchBytesPerThread = 0; // local scratch, eg for __shfl_down; 0 if the kernel takes none
+        bool usesDynamicShared = false; // takes the launch's sharedMem bytes, as an extra local arg
+    };
+
+    // the last value we passed to clSetKernelArg, for one arg of a kernel
+    class BoundKernelArg {
+    public:
+        bool bound = false;
+        bool local = false; // local memory, of size bytes; value is unused
+        size_t size = 0;
+        uint64_t value = 0; // every arg we pass fits in 8 bytes
+    };
+
+    // one kernel variant, in one context. Entries are created on first lookup, and live as long
+    // as the context, so callers can hang on to them. Generating the OpenCL, and building it, each
+    // happen once per entry: the first thread to ask does the work, without holding any lock
+    // other threads need, and any other thread asking meanwhile waits on buildCv. Once clReady,
+    // or kernel, is set, the fields it covers never change again, so can be read without locking
+    class KernelEntry {
+    public:
+        KernelEntry() : clReady(false), kernel(nullptr) {}
+        std::string uniqueKernelName;
+        std::mutex mutex; // guards generating and compiling
+        std::condition_variable buildCv;
+        bool generating = false;
+        bool compiling = false;
+        std::atomic<bool> clReady; // clSourcecode and kernelInfo are set
+        std::string clSourcecode;
+        cocl::KernelInfo kernelInfo;
+        std::atomic<easycl::CLKernel *> kernel;
+        // the args set on a cl_kernel are shared by all its users, so hold this from setting them through to enqueue
+        std::mutex launchMutex;
+        // the args currently set on kernel, so relaunching with the same args skips the
+        // clSetKernelArg calls. Guarded by launchMutex. A freed cl_mem's handle can be reused by the
+        // next allocation, so this is only trusted whilst the context's memoryGeneration is unchanged
+        std::vector<BoundKernelArg> boundArgs;
+        long long boundMemoryGeneration = -1;
     };
 
     class Context {
@@ -47,14 +91,38 @@ namespace cocl {
         ~Context();
         std::unique_ptr<easycl::EasyCL> cl;
         std::unique_ptr<cocl::CoclStream> default_stream;
-        std::map<std::string, easycl::CLKernel *> kernelCache;
-        std::map<std::string, cocl::KernelInfo> kernelInfoByUniqueName;
-        std::map<std::string, std::string > clSourceCodeCache;
+        std::set<cocl::CoclStream *> streams; // all live streams, including default_stream
+        const long long id; // unique for the life of the process, unlike the address
+        // kernelCacheMutex guards kernelEntries, and the kernels stored in cl; it is only taken
+        // the first time each thread looks up each kernel, see getKernelEntry
+        std::mutex kernelCacheMutex;
+        std::map<std::string, std::unique_ptr<cocl::KernelEntry> > kernelEntries; // by unique kernel name
+        std::atomic<int> numCachedKernels;
+        std::atomic<int> numGeneratedKernels;
+        std::atomic<int> numKernelCalls;
+        std::atomic<long long> numKernelArgsSet; // clSetKernelArg calls made by launches
+        std::atomic<long long> numKernelArgsSkipped; // ... and avoided, since the arg was already set
+        std::atomic<long long> numCrossStreamWaits; // barriers added for the legacy default stream
+        // builds kernels from the launch manifest in the background; 0 if there is nothing to build
+        std::unique_ptr<cocl::KernelWarmup> warmup;
         std::set<cocl::Memory *>memories;
         long long nextAllocPos = 1;
+        // ordered by fakePos, so findMemory can do an O(log n) interval lookup
         std::map< long long, cocl::Memory *>memoryByAllocPos;
-        int numKernelCalls = 0;
+        // vmem location of byte 0 of each clmem handed out by cudaMalloc, either a dedicated
+        // clmem or a slab; so size() is the number of distinct device buffers
+        std::map< cl_mem, long long >vmemBaseByClmem;
+        // bumped on every alloc/free, and whenever any other cl_mem that can be a kernel arg is
+        // released (launch struct buffers, upload rings), so per-thread lookup caches, and each
+        // KernelEntry's boundArgs, know when they are stale
+        std::atomic<long long> memoryGeneration;
+        std::unique_ptr<cocl::MemoryCache> memoryCache;
+        std::unique_ptr<cocl::SlabAllocator> slabAllocator;
+        // pinned chunks that async copies from pageable memory are staged through
+        std::unique_ptr<cocl::StagingPool> stagingPool;
         const int gpuOrdinal;
+        size_t maxKernelParameterBytes; // CL_DEVICE_MAX_PARAMETER_SIZE
+        size_t localMemBytes; // CL_DEVICE_LOCAL_MEM_SIZE, the most dynamic shared memory a launch can ask for
         easycl::EasyCL *getCl() {
             return cl.get();
         }
@@ -79,6 +147,11 @@ namespace cocl {
     };
 
     ThreadVars *getThreadVars();
+
+    // for per-thread caches keyed on context id: the count only ever goes up, so a cache that
+    // has seen it change knows to drop any contexts that isContextAlive says are gone
+    long long getNumContextsDestroyed();
+    bool isContextAlive(long long contextId);
 }
 
 typedef char *CUcontext;
@@ -0,0 +1,54 @@
+// Copyright Hugh Perkins 2016, 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <mutex>
+
+namespace cocl {
+    // 64-bit FNV-1a. pass the previous result in as hash, to hash several strings in a row
+    uint64_t fnv1a(const std::string &data, uint64_t hash = 14695981039346656037ULL);
+    std::string hashToHex(uint64_t hash);
+
+    // a directory of files, one per key, shared between processes (and between threads).
+    // Files are written to a temporary name, then renamed into place, so readers only ever
+    // see complete files, and each file carries a checksum, so anything truncated or corrupted
+    // on disk reads as a miss. Reads update the file's mtime, and once the directory grows past
+    // maxBytes, the least recently used files are deleted.
+    // Nothing here throws: the cache is an optimization, so any io problem just means a miss
+    class DiskCache {
+    public:
+        DiskCache(std::string dir, long long maxBytes);
+        bool read(std::string key, std::string *contents);
+        void write(std::string key, const std::string &contents);
+        void evict(); // deletes least recently used files, until we are within maxBytes
+        long long getTotalBytes();
+        std::string getPath(std::string key);
+        std::string dir;
+        long long maxBytes;
+        std::mutex mutex; // only for numWrites, and evict; the filesystem handles the rest
+        long long numWrites = 0;
+    };
+
+    // identifies this build of libcocl (its path, size and mtime), for keys of anything that
+    // libcocl generates itself, so a rebuilt libcocl doesnt pick up stale entries
+    std::string getLibraryBuildId();
+
+    // the process-wide cache, in COCL_CACHE_DIR (by default ~/.cache/coriander), bounded by
+    // COCL_CACHE_MAX_BYTES. On by default; returns 0 if COCL_CACHE_MAX_BYTES=0, or the directory
+    // cant be created
+    DiskCache *getDiskCache();
+}
@@ -15,6 +15,9 @@ namespace cocl {
         // bool has_event();
         cl_event event = 0;
     };
+    // whether streams get profiling queues, so that cudaEventElapsedTime can read device
+    // timestamps off recorded events. On, unless COCL_EVENT_TIMING=0
+    bool isEventTimingEnabled();
 }
 
 extern "C" {
@@ -0,0 +1,43 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ctime>
+
+// the few filesystem and process calls that differ between posix and windows, so the
+// rest of cocl doesnt need any #ifdefs. None of these throw
+namespace cocl {
+    class FileInfo {
+    public:
+        std::string name; // without the directory
+        long long bytes;
+        time_t mtime;
+    };
+
+    bool makeDirs(std::string path); // like mkdir -p. returns true if path is a directory afterwards
+    std::vector<FileInfo> listFiles(std::string dir); // regular files only
+    bool getFileInfo(std::string path, FileInfo *info); // returns false if path isnt a regular file
+    bool setFileMtime(std::string path, time_t mtime);
+    bool touchFile(std::string path); // sets mtime to now
+    // renames from to to, atomically replacing to if it exists, as posix rename does
+    bool replaceFile(std::string from, std::string to);
+    int getProcessId();
+    std::string makeTempDir(std::string prefix); // a new, empty, directory. returns "" on failure
+    // the file of the executable or shared library containing address. returns "" if unknown
+    std::string getModulePath(const void *address);
+    std::string getExecutablePath(); // of this process. returns "" if unknown
+}
@@ -1,2 +1,21 @@
 #pragma once
 
+#include <cstdint>
+
+// patch_hostside lays out each launch's arguments as an array of these, on the host stack, and
+// passes the whole array to launchKernel, in one call. Kept as plain C, so patch_hostside can
+// build the same layout in IR: { i32, i32, i64 }
+enum CoclKernelArgKind {
+    COCL_ARG_INT8 = 1,
+    COCL_ARG_INT32 = 2,
+    COCL_ARG_INT64 = 3,
+    COCL_ARG_FLOAT = 4, // value holds the float's bits, in its low 32 bits
+    COCL_ARG_GPU_BUFFER = 5, // value is the (virtual) device pointer, size is the element size
+    COCL_ARG_HOSTSIDE_BUFFER = 6 // value points at size bytes of host memory, eg a by-value struct
+};
+
+struct CoclKernelArgDesc {
+    int32_t kind; // a CoclKernelArgKind
+    int32_t size;
+    int64_t value;
+};
@@ -2,139 +2,61 @@
 
 #include "EasyCL/EasyCL.h"
 
-#include "llvm/Support/Casting.h" // for llvm rtti
-
 #include <string>
+#include <cstdint>
 
 namespace cocl {
-    // These Arg classes store kernel parameter values, which we can use
+    // A KernelArg stores one kernel parameter value, which we can use
     // at kernel creation time, and then pass into the kernel at that point
     // we dont create the kernel until the actual launch command (which is after
     // the kernelSetArg commands), so we have all the information available at that
     // time about what kernel arguments we have
     // concretely, it means we can dedupe the underlying cl_mem buffers, for example
-    class Arg {
+    //
+    // These are plain values, rather than a class per kind, so that the args vector keeps its
+    // capacity from launch to launch, and setting an arg allocates nothing
+    class KernelArg {
     public:
         enum ArgKind {
-            AK_Base,
             AK_Int8Arg,
             AK_Int32Arg,
             AK_UInt32Arg,
             AK_Int64Arg,
             AK_FloatArg,
-            AK_NullPtrArg,
-            AK_ClmemArg,
-            AK_StructArg
+            AK_NullPtrArg
         };
-        Arg(ArgKind kind=AK_Base) : Kind(kind) {}
-        virtual ~Arg() {}
-        virtual void inject(easycl::CLKernel *kernel) = 0;
-        virtual std::string str() = 0;
+        static KernelArg int8(char v) { KernelArg arg(AK_Int8Arg); arg.v.int8 = v; return arg; }
+        static KernelArg int32(int32_t v) { KernelArg arg(AK_Int32Arg); arg.v.int32 = v; return arg; }
+        static KernelArg uint32(uint32_t v) { KernelArg arg(AK_UInt32Arg); arg.v.uint32 = v; return arg; }
+        static KernelArg int64(int64_t v) { KernelArg arg(AK_Int64Arg); arg.v.int64 = v; return arg; }
+        static KernelArg float32(float v) { KernelArg arg(AK_FloatArg); arg.v.float32 = v; return arg; }
+        static KernelArg nullPtr() { return KernelArg(AK_NullPtrArg); }
 
-    private:
-        const ArgKind Kind;
+        // what to pass to clSetKernelArg
+        size_t size() const {
+            switch(kind) {
+                case AK_Int8Arg: return sizeof(v.int8);
+                case AK_Int32Arg: return sizeof(v.int32);
+                case AK_UInt32Arg: return sizeof(v.uint32);
+                case AK_Int64Arg: return sizeof(v.int64);
+                case AK_FloatArg: return sizeof(v.float32);
+                case AK_NullPtrArg: return sizeof(cl_mem); // a null cl_mem, which v.int64 holds
+            }
+            return 0;
+        }
+        const void *data() const { return &v; }
+        std::string str() const;
 
-    public:
-        ArgKind getKind() const { return Kind; }
+        ArgKind kind;
+        union {
+            char int8;
+            int32_t int32;
+            uint32_t uint32;
+            int64_t int64;
+            float float32;
+        } v;
 
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_Base;
-        }
-    };
-    class Int8Arg : public Arg {
-    public:
-        Int8Arg(char v) : Arg(AK_Int8Arg), v(v) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->in_char(v);
-        }
-        virtual std::string str() { return "Int8Arg"; }
-        char v;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_Int8Arg;
-        }
-    };
-    class Int32Arg : public Arg {
-    public:
-        Int32Arg(int v) : Arg(AK_Int32Arg), v(v) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->in_int32(v);
-        }
-        virtual std::string str();
-        int v;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_Int32Arg;
-        }
-    };
-    class UInt32Arg : public Arg {
-    public:
-        UInt32Arg(uint32_t v) : Arg(AK_UInt32Arg), v(v) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->in_uint32(v);
-        }
-        virtual std::string str() { return "UInt32Arg"; }
-        uint32_t v;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_UInt32Arg;
-        }
-    };
-    class Int64Arg : public Arg {
-    public:
-        Int64Arg(int64_t v) : Arg(AK_Int64Arg), v(v) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->in_int64(v);
-        }
-        virtual std::string str();
-        int64_t v;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_Int64Arg;
-        }
-    };
-    class FloatArg : public Arg {
-    public:
-        FloatArg(float v) : Arg(AK_FloatArg), v(v) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->in_float(v);
-        }
-        virtual std::string str() { return "FloatArg"; }
-        float v;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_FloatArg;
-        }
-    };
-    class NullPtrArg : public Arg {
-    public:
-        NullPtrArg() : Arg(AK_NullPtrArg) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->in_nullptr();
-        }
-        virtual std::string str() { return "NullPtrArg"; }
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_NullPtrArg;
-        }
-    };
-    class ClmemArg : public Arg {
-    public:
-        ClmemArg(cl_mem v) : Arg(AK_ClmemArg), v(v) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->inout(&v);
-        }
-        virtual std::string str() { return "ClmemArg"; }
-        cl_mem v;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_ClmemArg;
-        }
-    };
-    class StructArg : public Arg {
-    public:
-        StructArg(char *pCpuStruct, int structAllocateSize) :
-            Arg(AK_StructArg),
-            pCpuStruct(pCpuStruct), structAllocateSize(structAllocateSize)
-        {}
-        virtual std::string str() { return "StructArg"; }
-        char *pCpuStruct;
-        int structAllocateSize;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_StructArg;
-        }
+    private:
+        KernelArg(ArgKind kind) : kind(kind) { v.int64 = 0; }
     };
 } // namespace cocl
@@ -3,24 +3,109 @@
 #include "clew.h"
 
 #include <cstdint>
+#include <map>
+#include <vector>
+#include <memory>
+
+namespace easycl {
+    class EasyCL;
+}
 
 namespace cocl {
+    class Context;
+    class Slab;
+
     class Memory {
     protected:
-        Memory(cl_mem clmem, size_t bytes);
+        Memory(cl_mem clmem, size_t bytes, size_t capacity, Slab *slab, size_t clmemOffset);
 
      public:
         static Memory *newDeviceAlloc(size_t bytes);
         ~Memory();
-        size_t getOffset(const char *passedInAsCharStar);
+        size_t getOffset(const char *passedInAsCharStar); // offset into clmem, not into this Memory
         cl_mem clmem; // this is assumed to always be valid
         size_t bytes; // should always be valid (ideally > 0...)
+        size_t capacity; // bytes actually reserved for us in clmem; can be larger than bytes, since we round up
         size_t fakePos; // the range (fakePos) to (fakePos + bytes) should not overlap with any other memory
         // otherwise, problems :-P
+        Slab *slab; // 0 if we have clmem to ourselves
+        size_t clmemOffset; // where we start inside clmem. always 0 if slab is 0
+    };
+
+    // what a lookup needs of a Memory, copied out whilst holding the context mutex, so it stays
+    // safe to use even if another thread frees the Memory meanwhile. clmem is 0 if not found
+    class MemoryRef {
+    public:
+        size_t getOffset(const char *passedInAsCharStar) const; // offset into clmem
+        cl_mem clmem = 0;
+        size_t fakePos = 0;
+        size_t bytes = 0;
+        size_t clmemOffset = 0;
+    };
+
+    Memory *findMemory(const char *passedInPointer); // takes the context mutex every time
+    MemoryRef findMemoryRef(const char *passedInPointer); // usually lock-free, see MemoryLookupCache
+    // the vmem location of byte 0 of clmem, or 0 if clmem isnt from cudaMalloc (eg a hostside struct buffer)
+    size_t getClmemVmemBase(cl_mem clmem);
+
+    class MemoryCacheStats {
+    public:
+        long long numAllocs = 0;
+        long long numCacheHits = 0; // allocs served from the cache, without calling clCreateBuffer
+        long long numCacheMisses = 0;
+        long long numFrees = 0;
+        long long numReleases = 0; // clmems actually released, via clReleaseMemObject
+        size_t cachedBytes = 0;
+        size_t cachedBuffers = 0;
+        size_t maxCachedBytes = 0;
     };
 
-    Memory *findMemory(const char *passedInPointer);
-    Memory *findMemoryByClmem(cl_mem clmem);
+    // holds clmems freed by cudaFree, so cudaMalloc can reuse them, rather than going back
+    // to clCreateBuffer. One per Context. Caller should hold the context mutex
+    class MemoryCache {
+    public:
+        MemoryCache(cl_device_id deviceId);
+        ~MemoryCache();
+        static size_t getSizeClass(size_t bytes);
+        size_t getCapacityFor(size_t bytes);
+        cl_mem allocate(easycl::EasyCL *cl, size_t capacity); // from the cache if possible, otherwise new
+        cl_mem take(size_t capacity); // returns 0 if nothing cached of this capacity
+        void give(cl_mem clmem, size_t capacity);
+        void trim(size_t targetCachedBytes);
+        MemoryCacheStats stats;
+        std::multimap<size_t, cl_mem> clmemsByCapacity;
+    };
+
+    // one large clmem, which small cudaMallocs are carved out of. The slab reserves a contiguous
+    // range of vmem, so an allocation at clmemOffset inside the slab lives at vmem fakePos + clmemOffset
+    class Slab {
+    public:
+        Slab(cl_mem clmem, size_t capacity, size_t fakePos);
+        bool allocate(size_t bytes, size_t *pOffset); // first-fit. returns false if no room
+        void free(size_t offset, size_t bytes);
+        cl_mem clmem;
+        size_t capacity;
+        size_t fakePos;
+        size_t usedBytes = 0;
+        std::map<size_t, size_t> freeBytesByOffset;
+    };
+
+    // hands out ranges of Slabs, so that most kernel launches see only one or two distinct
+    // clmems, rather than one per allocation. One per Context. Caller should hold the context mutex
+    class SlabAllocator {
+    public:
+        SlabAllocator(cl_device_id deviceId);
+        ~SlabAllocator();
+        bool handles(size_t bytes);
+        Slab *allocate(Context *context, size_t bytes, size_t *pOffset);
+        void free(Context *context, Slab *slab, size_t offset, size_t bytes);
+        size_t slabBytes; // 0 means slabs are disabled
+        std::vector<std::unique_ptr<Slab> > slabs;
+    };
+
+    // for the current context
+    MemoryCacheStats getMemoryCacheStats();
+    void trimMemoryCache();
 }
 
 #define CU_MEMHOSTALLOC_PORTABLE 123
@@ -34,11 +119,61 @@ enum cudaMemcpyKind {  // name used by thrust, in trivial_copy.inl, line 55 ish
     cudaMemcpyDeviceToHost=111,
     cudaMemcpyHostToDevice=222,
     cudaMemcpyDeviceToDevice=333,
-    cudaMemcpyDefault=444  // from thrust, trivial_copy.inl
+    cudaMemcpyDefault=444,  // from thrust, trivial_copy.inl
+    cudaMemcpyHostToHost=555  // not handled, but callers can name it, and get cudaErrorInvalidValue
 };
 
 typedef long long CUdeviceptr;
 
+// for the pitched, 2d and 3d, copies. We have no cuda arrays, so srcArray and dstArray should be 0
+struct cudaArray;
+typedef struct cudaArray *cudaArray_t;
+
+struct cudaPitchedPtr {
+    void *ptr;
+    size_t pitch; // bytes from one row to the next
+    size_t xsize; // width of a row, in bytes
+    size_t ysize; // rows per slice
+};
+
+struct cudaExtent {
+    size_t width; // in bytes, for our copies, since we have no arrays
+    size_t height;
+    size_t depth;
+};
+
+struct cudaPos {
+    size_t x; // in bytes
+    size_t y;
+    size_t z;
+};
+
+struct cudaMemcpy3DParms {
+    cudaArray_t srcArray;
+    struct cudaPos srcPos;
+    struct cudaPitchedPtr srcPtr;
+    cudaArray_t dstArray;
+    struct cudaPos dstPos;
+    struct cudaPitchedPtr dstPtr;
+    struct cudaExtent extent;
+    enum cudaMemcpyKind kind;
+};
+
+inline cudaPitchedPtr make_cudaPitchedPtr(void *ptr, size_t pitch, size_t xsize, size_t ysize) {
+    cudaPitchedPtr pitchedPtr = { ptr, pitch, xsize, ysize };
+    return pitchedPtr;
+}
+
+inline cudaExtent make_cudaExtent(size_t width, size_t height, size_t depth) {
+    cudaExtent extent = { width, height, depth };
+    return extent;
+}
+
+inline cudaPos make_cudaPos(size_t x, size_t y, size_t z) {
+    cudaPos pos = { x, y, z };
+    return pos;
+}
+
 extern "C" {
     size_t cudaMalloc(void **pMemory, size_t N);
     size_t cudaFree(void *memory);
@@ -63,6 +198,15 @@ extern "C" {
     size_t cuMemcpyDtoHAsync(void *host_dst, CUdeviceptr gpu_src, size_t size, char*queue);
 
     size_t cuDeviceTotalMem(size_t *value, CUdeviceptr device);
+
+    // each copy is a single rectangular OpenCL transfer, rather than one per row
+    size_t cudaMallocPitch(void **devPtr, size_t *pitch, size_t width, size_t height);
+    size_t cudaMemcpy2D(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width, size_t height,
+        cudaMemcpyKind kind);
+    size_t cudaMemcpy2DAsync(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width, size_t height,
+        cudaMemcpyKind kind, char *queue=0);
+    size_t cudaMemcpy3D(const cudaMemcpy3DParms *p);
+    size_t cudaMemset2D(void *devPtr, size_t pitch, int value, size_t width, size_t height);
 }
 
 size_t cudaMalloc(float **pMemory, size_t N);
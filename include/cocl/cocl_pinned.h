@@ -0,0 +1,83 @@
+// Copyright Hugh Perkins 2016, 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Pinned host memory: OpenCL buffers created with CL_MEM_ALLOC_HOST_PTR, and mapped for as long
+// as they live, so the host can use them as ordinary memory, and the device can dma straight
+// out of them. Used for cuMemHostAlloc, and for staging async copies out of pageable memory
+
+#pragma once
+
+#include "EasyCL/EasyCL.h"
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+namespace cocl {
+    class Context;
+
+    class PinnedBuffer {
+    public:
+        PinnedBuffer(Context *context, size_t bytes); // throws if the device wont give us one
+        ~PinnedBuffer();
+        Context *context; // not owned. the context frees its buffers before it goes, see releasePinnedHostMemory
+        cl_mem clmem = 0;
+        char *hostPtr = 0; // where clmem is mapped
+        size_t bytes;
+    };
+
+    // for cuMemHostAlloc and cuMemFreeHost. Process-wide, so any thread can free them
+    void *allocatePinnedHostMemory(Context *context, size_t bytes); // returns 0 if the device wont
+    bool freePinnedHostMemory(void *hostPtr); // returns false if hostPtr isnt from allocatePinnedHostMemory
+    // frees everything context allocated, like cuda does when a context is destroyed. Any later
+    // freePinnedHostMemory of those pointers is a no-op
+    void releasePinnedHostMemory(Context *context);
+    // whether [hostPtr, hostPtr + bytes) lies inside memory from allocatePinnedHostMemory
+    bool isPinnedHostMemory(const void *hostPtr, size_t bytes);
+
+    class StagingChunk {
+    public:
+        std::unique_ptr<PinnedBuffer> buffer;
+        cl_event event = 0; // the last copy reading from the chunk; the chunk is free once it completes
+    };
+
+    // fixed size pinned chunks, for cuMemcpyHtoDAsync and cudaMemcpyAsync from pageable memory.
+    // The source is copied into chunks, and written to the device from there, so the caller can
+    // reuse their memory as soon as the call returns, without waiting for the transfer. Chunks
+    // are allocated on first use, up to COCL_STAGING_BYTES in all, and recycled once the copy
+    // reading them has completed. One per Context
+    class StagingPool {
+    public:
+        StagingPool(Context *context);
+        ~StagingPool(); // waits for copies still reading from chunks
+        bool enabled() { return maxChunks > 0; }
+        // a free chunk, waiting for the oldest copy in flight, if every chunk is busy, or for another
+        // thread to release one, if they are all still being filled
+        StagingChunk *acquire();
+        // chunk stays busy until event completes. takes ownership of event
+        void release(StagingChunk *chunk, cl_event event);
+        void retireCompleted(); // caller holds mutex
+
+        Context *context; // not owned
+        size_t chunkBytes;
+        size_t maxChunks;
+        std::mutex mutex;
+        std::condition_variable chunkReleased;
+        std::vector<std::unique_ptr<StagingChunk> > chunks;
+        std::vector<StagingChunk *> freeChunks;
+        std::deque<StagingChunk *> busyChunks; // oldest copy first
+    };
+}
@@ -2,6 +2,12 @@
 
 #include "cocl/cocl_events.h"
 
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <memory>
+
 namespace easycl {
     class EasyCL;
     class CLQueue;
@@ -40,15 +46,113 @@ namespace cocl {
     };
     void CL_CALLBACK coclCallback(cl_event event, cl_int status, void *userdata);
 
+    class Context;
+
+    // a launch whose resources (eg hostside struct buffers) we cant release until the
+    // device has finished with it
+    class PendingLaunch {
+    public:
+        long long seq;
+        cl_event event;
+        std::vector<cl_mem> clmemsToRelease;
+    };
+
+    class CoclStream;
+
+    class UploadRegion {
+    public:
+        long long seq; // the launch reading this region
+        size_t numBytes; // including any padding skipped at the end of the ring
+    };
+
+    // a device buffer, one per stream, that by-value struct kernel args are uploaded into. Each
+    // launch packs its structs into one region, written with a single non-blocking write; the
+    // host copy stays put in hostShadow until the write has finished. Regions are handed out in
+    // order, and recycled once the launch reading them has completed
+    class UploadRing {
+    public:
+        UploadRing(CoclStream *stream, size_t capacity);
+        ~UploadRing();
+        // copies data into the ring, and enqueues the write. returns the offset of the data in clmem
+        // numBytes must be at most capacity
+        size_t upload(long long seq, const char *data, size_t numBytes);
+        void retireCompleted();
+        static const int alignment = 128;
+        CoclStream *stream;
+        size_t capacity;
+        cl_mem clmem = 0;
+        std::vector<char> hostShadow;
+        size_t head = 0; // where the next region starts
+        size_t usedBytes = 0;
+        std::deque<UploadRegion> inFlight;
+        std::mutex mutex;
+    };
+
     // a coclstream:
     // - is associated with one virtual cuda stream, from the point of view of the client
     // - is associated with exactly one opencl queue
     // - has a lock associated with it, so if there are more than one thread using it, they're method calls
     //   will run sequentially, not in parallel
+    //
+    // Commands are enqueued asynchronously, so each stream counts what it has enqueued, and
+    // what is known to have finished. We use that to give CUDA's legacy default stream semantics
+    // (the default stream waits for all other streams, and they wait for it), without adding
+    // any barriers between streams that are idle
     class CoclStream {
     public:
-        CoclStream(easycl::EasyCL *cl);
+        CoclStream(Context *context);
         ~CoclStream();
+        // waits for other streams, as needed, and returns the next command's sequence number. Caller
+        // should hold enqueueMutex until the command is enqueued; see StreamEnqueue
+        long long beforeEnqueue();
+        void completedUpTo(long long seq); // eg after a blocking read/write
+        bool isBusy(); // doesnt block, but checks whether async work has finished
+        void waitFor(CoclStream *other); // next command on this stream waits for everything so far on other
+        void addPending(long long seq, cl_event event, std::vector<cl_mem> &clmemsToRelease);
+        void reapCompleted();
+        void synchronize();
+        // without blocking: CL_COMPLETE once everything enqueued so far has finished, a positive
+        // CL_QUEUED/CL_SUBMITTED/CL_RUNNING while work is pending, or negative if it failed
+        cl_int query();
+        // a marker behind everything enqueued so far; caller should release it
+        cl_event retainMarker();
+        // created on first use. returns 0 if COCL_UPLOAD_RING_BYTES=0
+        UploadRing *getUploadRing();
+        Context *context;
         easycl::CLQueue *clqueue;
+        // held from beforeEnqueue until the command is on the queue, so commands reach the queue
+        // in seq order. Never held while waiting on another stream's enqueueMutex
+        std::mutex enqueueMutex;
+        std::atomic<long long> lastEnqueuedSeq; // only commands that are on the queue already
+        std::atomic<long long> lastCompletedSeq;
+        std::mutex pendingMutex;
+        std::deque<PendingLaunch> pending;
+        std::mutex uploadRingMutex;
+        std::unique_ptr<UploadRing> uploadRing;
+        // a marker behind the work that was enqueued when we were last queried, or last waited
+        // for by another stream, so that polling a busy stream doesnt enqueue a marker every time,
+        // and isBusy can tell when async work has finished. guarded by queryMutex
+        std::mutex queryMutex;
+        cl_event queryMarker = 0;
+        long long queryMarkerSeq = 0;
+    protected:
+        cl_event getMarkerLocked(long long seq); // caller should hold queryMutex
     };
+
+    // one command on a stream: holds enqueueMutex from beforeEnqueue until publish, or until it goes
+    // out of scope, whichever is first, and only then publishes seq in lastEnqueuedSeq. So another
+    // thread on the same stream can never synchronize, query or wait for a seq whose command isnt
+    // enqueued yet
+    class StreamEnqueue {
+    public:
+        StreamEnqueue(CoclStream *stream);
+        ~StreamEnqueue();
+        void publish(); // call once the command is enqueued, if anything else follows in scope
+        CoclStream *stream;
+        std::unique_lock< std::mutex > lock;
+        long long seq;
+    };
+
+    // waits for all streams in context, eg for cuCtxSynchronize, or before cudaFree recycles memory
+    void synchronizeStreams(Context *context);
 }
@@ -0,0 +1,95 @@
+// Copyright Hugh Perkins 2016, 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The launch manifest records which kernel variants a program launched, so that the next run
+// of the same program can generate and build them on background threads, at startup, rather
+// than stalling each kernel's first launch
+
+#pragma once
+
+#include "cocl/cocl_device.h"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+namespace cocl {
+    class Context;
+    class DiskCache;
+
+    // one kernel variant: enough to generate, and build, that kernel again, in a later run
+    class KernelVariant {
+    public:
+        std::string deviceKey; // which device, and driver, see getDeviceKey
+        bool offsets_32bit = false;
+        std::string deviceIrKey; // the device IR is in the disk cache, under this key
+        std::string kernelName;
+        int uniqueClmemCount = 0;
+        std::vector<int> clmemIndexByClmemArgIndex;
+        int numVmemSegmentClmems = 0;
+        std::string str() const; // one line of the manifest
+        static bool fromString(std::string line, KernelVariant *variant);
+    };
+
+    std::string getDeviceKey(cl_device_id deviceId);
+
+    // process-wide, stored in the disk cache, one per executable
+    class LaunchManifest {
+    public:
+        LaunchManifest(DiskCache *diskCache, std::string key);
+        ~LaunchManifest(); // writes out anything not yet written
+        // the variants recorded by earlier runs
+        std::vector<KernelVariant> getRecordedVariants();
+        // adds variant, if new, saving deviceIr to the disk cache alongside
+        void record(KernelVariant variant, const std::string &deviceIr);
+        void save();
+        void saveLocked(); // caller holds mutex
+
+        DiskCache *diskCache;
+        std::string key;
+        std::mutex mutex;
+        std::vector<KernelVariant> recordedVariants;
+        std::set<std::string> lines; // recorded by earlier runs, and by this one
+        std::set<std::string> savedDeviceIrKeys;
+        bool dirty = false;
+        // rewriting the whole manifest for every new kernel would be quadratic, so we save at
+        // most once a second, and at exit
+        std::chrono::steady_clock::time_point lastSave;
+    };
+    // returns 0 if the disk cache is disabled
+    LaunchManifest *getLaunchManifest();
+
+    // background threads building the variants from the launch manifest, into one context.
+    // They go through the same kernel cache entries as launches do, so a launch whose kernel is
+    // being built right now waits for just that kernel, and one whose kernel hasnt been reached
+    // yet builds it itself
+    class KernelWarmup {
+    public:
+        KernelWarmup(Context *context, std::vector<KernelVariant> variants, int numThreads);
+        ~KernelWarmup(); // abandons anything not yet started, and waits for the rest
+        void threadMain();
+
+        Context *context; // not owned
+        std::mutex mutex; // guards nextVariant and stopping
+        std::vector<KernelVariant> variants;
+        size_t nextVariant = 0;
+        bool stopping = false;
+        std::vector<std::thread> threads;
+    };
+    // returns 0 if there is nothing to warm up for this context, or COCL_WARMUP_THREADS=0
+    KernelWarmup *createKernelWarmup(Context *context, bool offsets_32bit);
+}
@@ -18,11 +18,27 @@
 
 namespace cocl {
 
-// non-blocking "async"
+// non-blocking "async". offsetBytes must be a multiple of 4. Vector width, workgroup size, and
+// whether to use clEnqueueFillBuffer instead, are chosen per device, see COCL_FILL_VECTOR_WIDTH
+// and COCL_FILL_NATIVE in doc/options.md
 int myEnqueueFillBuffer(
     cl_command_queue queue,
     cl_mem clmem,
     unsigned int value,
-    int offsetBytes, int countInts);
+    size_t offsetBytes, size_t countInts);
+
+// memset: any offset, any count. non-blocking too
+int myEnqueueMemset(
+    cl_command_queue queue,
+    cl_mem clmem,
+    unsigned char value,
+    size_t offsetBytes, size_t countBytes);
+
+// memset of height rows, width bytes each, starting pitch bytes apart. non-blocking
+int myEnqueueMemset2D(
+    cl_command_queue queue,
+    cl_mem clmem,
+    unsigned char value,
+    size_t offsetBytes, size_t pitch, size_t width, size_t height);
 
 } // namespace cocl
@@ -90,6 +90,7 @@ public:
     std::string createOffsetDeclaration(std::string argName);
     std::string createOffsetShim(llvm::Type *argType, std::string argName, int clmemIndex);
     std::string dumpKernelFunctionDeclarationWithoutReturn(llvm::Function *F);
+    std::string dumpGlobalVarsSegmentTable();
     std::string dumpInternalFunctionDeclarationWithoutReturn(llvm::Function *F);
     std::string dumpFunctionDeclarationWithoutReturn(llvm::Function *F);
     void generateBlockIndex();
@@ -108,6 +109,16 @@ public:
         _addIRToCl = true;
         return this;
     }
+    // kernel takes a local scratch buffer, for shims such as __shfl_down
+    FunctionDumper *addScratchArg() {
+        _scratchArg = true;
+        return this;
+    }
+    // kernel takes a local buffer for its extern __shared__ arrays
+    FunctionDumper *addDynamicSharedArg() {
+        _dynamicSharedArg = true;
+        return this;
+    }
 
     // std::set<std::string> shimFunctionsNeeded; // for __shfldown_3 etc, that we provide as opencl directly
     cocl::Shims shims;
@@ -140,6 +151,8 @@ protected:
     int kernelNumUniqueClmems;
     std::vector<int> &kernelClmemIndexByArgIndex;
     bool _addIRToCl = false;
+    bool _scratchArg = false;
+    bool _dynamicSharedArg = false;
     std::map<llvm::BasicBlock *, int> functionBlockIndex;
 
     GlobalNames *globalNames;
@@ -18,8 +18,12 @@
 // they'll just need to include coriander includes, not have eg llvm includes
 
 #include "cocl/cocl_launch_args.h"
+#include "cocl/cocl_context.h"
 #include "cocl/hostside_opencl_funcs_ext.h"
 
+#include <string>
+#include <vector>
+
 namespace easycl {
     class CLKernel;
     class EasyCL;
@@ -27,17 +31,69 @@ namespace easycl {
 
 namespace cocl {
     class CoclStream;
+    class KernelVariant;
 
     struct GenerateOpenCLResult {
         std::string clSourcecode;
         std::string originalKernelName;
         std::string shortKernelName;
         std::string uniqueKernelName;
+        cocl::KernelInfo kernelInfo;
     };
-    GenerateOpenCLResult generateOpenCL(int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, std::string origKernelName, std::string devicellsourcecode);
+    // numVmemSegmentClmems: how many of the uniqueClmemCount clmems are there only for the vmem segment table
+    GenerateOpenCLResult generateOpenCL(int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, std::string origKernelName, const std::string &devicellsourcecode,
+        int numVmemSegmentClmems = 0);
     easycl::CLKernel *compileOpenCLKernel(std::string originalKernelName, std::string uniqueKernelName, std::string shortKernelName, std::string clSourcecode);
     easycl::CLKernel *compileOpenCLKernel(std::string shortKernelName, std::string clSourcecode);
+    std::string getUniqueKernelName(std::string origKernelName, const std::vector<int> &clmemIndexByClmemArgIndex, int numVmemSegmentClmems);
+    // generates and builds a kernel variant from the launch manifest, ahead of its first launch
+    void warmUpKernel(cocl::Context *context, const cocl::KernelVariant &variant, const std::string &deviceIr);
+    // returns the kernel cache entry for uniqueKernelName, creating it if need be. Takes no lock
+    // shared with other threads, once this thread has looked the kernel up before
+    cocl::KernelEntry *getKernelEntry(cocl::Context *context, const std::string &uniqueKernelName);
+    // a CLKernel holds its args until it is run, so hold this from the first inout/in through to run
+    std::mutex *getKernelLaunchMutex(std::string uniqueKernelName);
+
 
+    // which kernel a launch site resolved to, for one context and one clmem mapping
+    class LaunchSiteResolution {
+    public:
+        bool matches(long long contextId, int uniqueClmemCount, const std::vector<int> &clmemIndexByClmemArgIndex,
+            int numVmemSegmentClmems) const;
+        long long contextId;
+        int uniqueClmemCount;
+        std::vector<int> clmemIndexByClmemArgIndex;
+        int numVmemSegmentClmems;
+        cocl::KernelEntry *kernelEntry;
+    };
+
+    // one per kernel launch site in the host code. patch_hostside gives each launch site a
+    // pointer-sized slot, which configureKernelSite points at one of these on the first launch.
+    // Each launch then checks resolution: if the context and clmem mapping are the same as last
+    // time, which they nearly always are, it has its kernel entry, without building the unique
+    // kernel name, or looking anything up by name
+    class CoclLaunchSite {
+    public:
+        CoclLaunchSite(const char *kernelName, const char *deviceIrPtr, int64_t deviceIrSize);
+        const std::string &getDeviceIr(); // copied out of the host binary on first use
+        // returns a matching resolution, or 0
+        LaunchSiteResolution *findResolution(long long contextId, int uniqueClmemCount, const std::vector<int> &clmemIndexByClmemArgIndex,
+            int numVmemSegmentClmems);
+        void publish(long long contextId, int uniqueClmemCount, const std::vector<int> &clmemIndexByClmemArgIndex,
+            int numVmemSegmentClmems, cocl::KernelEntry *kernelEntry);
+
+        const std::string kernelName;
+        const std::string shortKernelName;
+        const char *deviceIrPtr;
+        int64_t deviceIrSize; // -1 means deviceIrPtr is null-terminated text
+        std::once_flag deviceIrOnce;
+        std::string deviceIr;
+        std::atomic<LaunchSiteResolution *> resolution; // the most recent
+        // every resolution ever published, so alternating between a few clmem mappings doesnt
+        // allocate each time; and never freed, since other threads may still be reading them
+        std::mutex mutex;
+        std::vector<std::unique_ptr<LaunchSiteResolution> > resolutions;
+    };
 
     class LaunchConfiguration {
     public:
@@ -45,18 +101,23 @@ namespace cocl {
         size_t block[3];
         easycl::CLQueue *queue = 0;  // NOT owned by us
         cocl::CoclStream *coclStream = 0; // NOT owned
+        size_t sharedMem = 0; // bytes of dynamic shared memory, for extern __shared__ arrays
 
-        std::vector<std::unique_ptr<Arg> > args;
+        std::vector<KernelArg> args;
 
         std::map<cl_mem, int> clmemIndexByClmem;
         std::vector<cl_mem> clmems;
         std::vector<int> clmemIndexByClmemArgIndex;
+        std::vector<uint64_t> clmemVmemBases; // filled in by kernelGo
 
         std::vector<cl_mem> kernelArgsToBeReleased;
-        std::string kernelName = "";
-        std::string uniqueKernelName = "";
-        std::string shortKernelName = "";
-        std::string devicellsourcecode = "";
+        // by-value structs bound for the stream's upload ring, packed at UploadRing::alignment. The
+        // args at uploadOffsetArgIndices hold offsets into uploadBytes, until kernelGo knows where in
+        // the ring uploadBytes lands
+        std::vector<char> uploadBytes;
+        std::vector<int> uploadOffsetArgIndices;
+        cocl::CoclLaunchSite *site = 0; // NOT owned; lives as long as the process
+        cocl::KernelEntry *kernelEntry = 0; // set by kernelGo, once it knows the variant
     };
 }
 
@@ -25,6 +25,7 @@
 #include "EasyCL/EasyCL.h"
 
 #include "cocl/cocl_defs.h"
+#include "cocl/cocl_kernellaunch.h"
 
 // #define __launch_bounds__(x) __attribute__((launch_bounds(x)))
 // #define __launch_bounds__(x)
@@ -36,10 +37,20 @@
 namespace cocl {
     int32_t getNumCachedKernels(); // this should be per-context or something, though right now, it is not yet
     int32_t getNumKernelCalls();
+    // clSetKernelArg calls made by launches, and those skipped because the kernel already had that value
+    int64_t getNumKernelArgsSet();
+    int64_t getNumKernelArgsSkipped();
+    // barriers one stream has waited on another with, for the legacy default stream
+    int64_t getNumCrossStreamWaits();
 }
 
 extern "C" {
     int cudaConfigureCall(const dim3 grid, const dim3 block, long long shared = 0,  char * stream = 0);
+    // the launch ABI of newer CUDA headers and clang. patch_hostside rewrites calls to cudaLaunchKernel
+    // into cudaConfigureCall and launchKernel, so the runtime's cudaLaunchKernel only reports an unpatched call
+    int __cudaPushCallConfiguration(dim3 grid, dim3 block, size_t sharedMem = 0, void *stream = 0);
+    int __cudaPopCallConfiguration(dim3 *grid, dim3 *block, size_t *sharedMem, void **stream);
+    size_t cudaLaunchKernel(const void *func, dim3 grid, dim3 block, void **args, size_t sharedMem = 0, char *stream = 0);
 
     void configureKernel(
         const char *kernelName, const char *llsourcecode);
@@ -47,6 +58,8 @@ extern "C" {
     size_t cuInit(unsigned int flags);
 
     void configureKernel(const char *kernelName, const char *devicellsourcecode);
+    // launchSite points at a per-launch-site slot, initially 0; deviceIrSize of -1 means deviceIr is text
+    void configureKernelSite(char **launchSite, const char *kernelName, const char *deviceIr, int64_t deviceIrSize);
     void addClmemArg(cl_mem clmem);
     void setKernelArgHostsideBuffer(char *pCpuStruct, int structAllocateSize);
     void setKernelArgGpuBuffer(char *memory_as_charstar, int32_t elementSize);
@@ -55,6 +68,11 @@ extern "C" {
     void setKernelArgInt8(char value);
     void setKernelArgFloat(float value);
     void kernelGo();
+    // configureKernelSite, then each of args, then kernelGo, in one call. This is what
+    // patch_hostside emits; the calls above remain for binaries patched before it
+    void launchKernel(
+        char **launchSite, const char *kernelName, const char *deviceIr, int64_t deviceIrSize,
+        const CoclKernelArgDesc *args, int32_t numArgs);
 }
 
 class ArgStore_base {
@@ -28,7 +28,8 @@ class ModuleClRes {
 public:
     std::string clSourcecode = "";
     bool usesVmem = false;
-    bool usesScratch = false;
+    int scratchBytesPerThread = 0;
+    bool usesDynamicShared = false;
 };
 
 ModuleClRes convertModuleToCl(
@@ -56,7 +56,8 @@ public:
     }
 
     bool usesVmem = false;
-    bool usesScratch = false;
+    int scratchBytesPerThread = 0; // local scratch the kernel takes, per workitem; 0 for none
+    bool usesDynamicShared = false; // any extern __shared__ array, reachable from the kernel
 
 protected:
     bool _addIRToCl = false;
@@ -78,6 +78,10 @@ public:
 
     void runGeneration(LocalValueInfo *localValueInfo, const std::map<llvm::Function *, llvm::Type *> &returnTypeByFunction);
 
+    // bytes of pGlobalVars->scratch each workitem needs, for the shim that a call to functionName
+    // becomes, or 0 if it doesnt touch scratch
+    static int getScratchBytesPerThread(std::string functionName);
+
     NewInstructionDumper *addIRToCl(bool set=true) {
         _addIRToCl = set;
         return this;
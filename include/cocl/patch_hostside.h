@@ -19,7 +19,7 @@ What this does / how this works
 ===============================
 
 The input to this module is hostside llvm ir code, probably from a *-hostraw.ll file. This file contains
-calls to NVIDIA® CUDA™ kernel launch commands, such as cudaSetupArgument. What we are going to do is
+calls to NVIDIA® CUDA™ kernel launch commands, such as cudaSetupArgument, or, from newer clang, cudaLaunchKernel. What we are going to do is
 to re-route these into the CUDA-on-CL runtime, performing any appropriate transformations first.
 
 We can receive, amongst other things, arguments such as:
@@ -36,9 +36,13 @@ How these are going to be handled. So, in all cases, what we are going to do is
 calls to methods in hostside_opencl_funcs.cpp. Then, depending on the type, we're going to handle the value in the IR
 code slightly differently:
 
+Each launch becomes a single call to launchKernel, passing an array of CoclKernelArgDesc (see cocl_kernellaunch.h),
+one per runtime arg, which we lay out on the stack. launchKernel unpacks each desc into the corresponding method, such
+as setKernelArgInt64 or setKernelArgGpuBuffer, so the descriptions of those methods below still hold.
+
 - int32, int8, float, any primitives basically:
-  - a call to one of the methods such as setKernelArgInt64 or setKernelArgFloat will be added to the bytecode
-    - the actual value of the primitive will be directly passed, as a parameter in this method
+  - a desc of kind COCL_ARG_INT64, COCL_ARG_FLOAT etc will be added to the array
+    - the actual value of the primitive will be directly stored, in the desc
     - we do need a slight hack to get this value, since the original cudaSetupArgument method will pass a pointer, whereas
       we are going to pass the underlying value
     - we get the underlying value by hunting for the upstream alloca
@@ -94,6 +98,15 @@ public:
     int paramIndex = 0; // in the original function, nto in our hacked around kernel function
 };
 
+// one entry in a launch's CoclKernelArgDesc array, before it is written out
+class PackedKernelArg {
+public:
+    PackedKernelArg(int kind, int size, llvm::Value *value) : kind(kind), size(size), value(value) {}
+    int kind; // a CoclKernelArgKind
+    int size;
+    llvm::Value *value; // an i64
+};
+
   // noncopyable(const noncopyable&) =delete;  
   // noncopyable& operator=(const noncopyable&) =delete; 
 
@@ -114,6 +127,9 @@ public:
     // eg see the random_op_gpu.cc kernel, from tensorflow, which has NormalDistribution as readnone, on its 4th arg,
     // but the hostside only passes 3 args, skips the NOrmalDistribution arg)
     std::vector<std::unique_ptr<ParamInfo> > params;
+    // what addSetKernelArgInst produced for params, in order. There can be more of these than
+    // params, eg a by-value struct containing pointers sends each pointer too
+    std::vector<PackedKernelArg> packedArgs;
 
     llvm::Value *stream;
     llvm::Value *grid_xy_value;
@@ -134,6 +150,7 @@ public:
     static std::unique_ptr<GenericCallInst> create(llvm::InvokeInst *inst);
     static std::unique_ptr<GenericCallInst> create(llvm::CallInst *inst);
     virtual llvm::Value *getArgOperand(int idx) = 0;
+    virtual unsigned getNumArgOperands() = 0;
     virtual llvm::Value *getOperand(int idx) = 0;
     virtual llvm::Module *getModule() = 0;
     virtual llvm::Instruction *getInst() = 0;
@@ -147,6 +164,7 @@ public:
     GenericCallInst_Call(llvm::CallInst *inst) : inst(inst) {}
     llvm::CallInst *inst;
     virtual llvm::Value *getArgOperand(int idx) override { return inst->getArgOperand(idx); }
+    virtual unsigned getNumArgOperands() override { return inst->getNumArgOperands(); }
     virtual llvm::Value *getOperand(int idx) override { return inst->getArgOperand(idx); }
     virtual llvm::Module *getModule() override { return inst->getModule(); }
     virtual llvm::Instruction *getInst() override { return inst; }
@@ -158,6 +176,7 @@ public:
     GenericCallInst_Invoke(llvm::InvokeInst *inst) : inst(inst) {}
     llvm::InvokeInst *inst;
     virtual llvm::Value *getArgOperand(int idx) override { return inst->getArgOperand(idx); }
+    virtual unsigned getNumArgOperands() override { return inst->getNumArgOperands(); }
     virtual llvm::Value *getOperand(int idx) override { return inst->getArgOperand(idx); }
     virtual llvm::Module *getModule() override { return inst->getModule(); }
     virtual llvm::Instruction *getInst() override { return inst; }
@@ -169,6 +188,10 @@ public:
     // returns path without the directory name (I think). this should go into some utiity class really...
     static std::string getBasename(std::string path); 
 
+    // converts value to an i64, and appends it to the current launch's packedArgs, which
+    // patchCudaLaunch writes out to the CoclKernelArgDesc array passed to launchKernel
+    static llvm::Instruction *addPackedKernelArg(llvm::Instruction *lastInst, int kind, int size, llvm::Value *value);
+
     // handle primitive ints and floats (not arrays):
     static llvm::Instruction *addSetKernelArgInst_int(llvm::Instruction *lastInst, llvm::Value *value, llvm::IntegerType *intType);
     static llvm::Instruction *addSetKernelArgInst_float(llvm::Instruction *lastInst, llvm::Value *value);
@@ -230,6 +253,21 @@ public:
     // about this, such as the type of the argument being set, and an instruction that represents
     // its value, stores that, in info, along with the arguments there already
     static void getLaunchArgValue(GenericCallInst *inst, LaunchCallInfo *info, ParamInfo *paramInfo);
+    // the same, given the pointer to the value, rather than the cudaSetupArgument call. Any loads are
+    // inserted before insertBefore
+    static void getLaunchArgValueFromPointer(llvm::Value *argPointer, llvm::Instruction *insertBefore, ParamInfo *paramInfo);
+
+    // given a call to cudaLaunchKernel(func, grid, block, args, sharedMem, stream), the launch ABI of
+    // newer clang and CUDA headers, finds the stores that fill in the args array, and adds a ParamInfo
+    // for each, to info, as cudaSetupArgument would have done. Then adds a call to cudaConfigureCall,
+    // passing on grid, block, sharedMem and stream, so that patchCudaLaunch can handle the launch
+    // just as it handles cudaLaunch
+    static void getLaunchKernelArgs(GenericCallInst *inst, LaunchCallInfo *info);
+
+    // returns the device-side code for kernelName, and everything it calls, as llvm bitcode.
+    // This is what gets embedded in the host binary, for the runtime to convert to OpenCL, so
+    // the runtime only has to parse the functions this kernel actually uses
+    static std::string getKernelBitcode(const llvm::Module *MDevice, std::string kernelName);
 
     static void patchCudaLaunch(
         llvm::Module *M, const llvm::Module *MDevice,
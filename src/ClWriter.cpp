@@ -23,6 +23,7 @@
 
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
 
 #include "cocl/llvm_dump.h"
 
@@ -209,6 +210,18 @@ void InsertValueClWriter::writeDeclaration(std::string indent, TypeDumper *typeD
     }
 }
 
+bool isDynamicSharedMemory(llvm::Value *value) {
+    GlobalVariable *globalVariable = dyn_cast<GlobalVariable>(value);
+    if(globalVariable == 0 || globalVariable->getType()->getAddressSpace() != 3) {
+        return false;
+    }
+    if(globalVariable->isDeclaration()) {
+        return true;
+    }
+    ArrayType *arrayType = dyn_cast<ArrayType>(globalVariable->getType()->getElementType());
+    return arrayType != 0 && arrayType->getNumElements() == 0;
+}
+
 void SharedClWriter::writeDeclaration(std::string indent, TypeDumper *typeDumper, std::ostream &os) {
     // cout << "sharedclwriter::writedeclaration" << endl;
     Value *value = localValueInfo->value;
@@ -233,6 +246,17 @@ void SharedClWriter::writeDeclaration(std::string indent, TypeDumper *typeDumper
             throw runtime_error("shouldnt be here");
         }
         Type *elementType = pointerType->getElementType();
+        if(isDynamicSharedMemory(value)) {
+            // every extern __shared__ array starts at the start of the launch's dynamic shared
+            // memory, just like in cuda
+            Type *primitiveType = elementType;
+            if(ArrayType *arrayType = dyn_cast<ArrayType>(elementType)) {
+                primitiveType = arrayType->getElementType();
+            }
+            string typeString = typeDumper->dumpType(primitiveType);
+            os << indent << "local " << typeString << " *" << localValueInfo->name << " = (local " << typeString << " *)pGlobalVars->dynamicShared;\n";
+            return;
+        }
         // cout << "elementType:" << endl;
         // elementType->dump();
         // cout << endl;
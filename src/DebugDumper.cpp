@@ -31,10 +31,10 @@ DebugDumper::DebugDumper(LaunchConfiguration *launchConfiguration) :
 
 void DebugDumper::dump() {
     // we assume that dump config is enabled, and the dump config has been loaded ,successfully
-    YAML::Node kernelConfig = dumpConfig[launchConfiguration->uniqueKernelName];
+    YAML::Node kernelConfig = dumpConfig[launchConfiguration->kernelEntry->uniqueKernelName];
     if(kernelConfig) {
-        cout << "Dumping for " << launchConfiguration->uniqueKernelName << " in dump config" << endl;
-        // cout << dumpConfig[launchConfiguration->uniqueKernelName] << endl;
+        cout << "Dumping for " << launchConfiguration->kernelEntry->uniqueKernelName << " in dump config" << endl;
+        // cout << dumpConfig[launchConfiguration->kernelEntry->uniqueKernelName] << endl;
         // YAML::Node kernelConfig = 
         int argIdx = 0;
         for(auto it=kernelConfig.begin(); it != kernelConfig.end(); it++) {
@@ -52,9 +52,9 @@ void DebugDumper::dump() {
                     continue;
                 }
                 unsigned long virtualAddress = argConfig["virtualaddress"].as<int>();
-                Memory *memory = findMemory((char *)virtualAddress);
-                offsetBytes = memory->getOffset((char *)virtualAddress);
-                clmem = memory->clmem;
+                MemoryRef memory = findMemoryRef((char *)virtualAddress);
+                offsetBytes = memory.getOffset((char *)virtualAddress);
+                clmem = memory.clmem;
                 cout << "  Dumping buffer " << argIdx << " virtualaddress=" << virtualAddress << " " << " offset in buffer " << offsetBytes << " " << argTypeName << "s:" << endl;
             } else {
                 if(argConfig["offsetarg"] && argConfig["offsetbytes"]) {
@@ -122,8 +122,7 @@ void DebugDumper::dump() {
 }
 
 void DebugDumper::maybeDump() {
-    // we are going to assume we're already inside a mutex, and therefore
-    // guaranteed to be running single-threaded
+    // each launching thread has its own DebugDumper, so no locking needed here
     if(!checkedDumpEnabled) {
         if(getenv("COCL_DUMP_CONFIG") != 0) {
             string dumpConfigFile = getenv("COCL_DUMP_CONFIG");
@@ -16,6 +16,9 @@
 
 #include "cocl/hostside_opencl_funcs.h"
 #include "cocl/cocl_streams.h"
+#include "cocl/cocl_memory.h"
+#include "cocl/cocl_warmup.h"
+#include "cocl/cocl_pinned.h"
 
 #include <iostream>
 #include <memory>
@@ -36,16 +39,55 @@ using namespace easycl;
 
 namespace cocl {
     std::mutex clcontextcreation_mutex;
+    static std::atomic<long long> nextContextId(0);
+    static std::atomic<long long> numContextsDestroyed(0);
+    static std::mutex liveContextIdsMutex;
+    static std::set<long long> liveContextIds;
 
-    Context::Context(int gpuOrdinal) : gpuOrdinal(gpuOrdinal) {
+    long long getNumContextsDestroyed() {
+        return numContextsDestroyed.load();
+    }
+
+    bool isContextAlive(long long contextId) {
+        std::lock_guard< std::mutex > guard(liveContextIdsMutex);
+        return liveContextIds.find(contextId) != liveContextIds.end();
+    }
+
+    Context::Context(int gpuOrdinal) :
+            id(nextContextId++), numCachedKernels(0), numGeneratedKernels(0), numKernelCalls(0),
+            numKernelArgsSet(0), numKernelArgsSkipped(0), numCrossStreamWaits(0),
+            memoryGeneration(0), gpuOrdinal(gpuOrdinal) {
         COCL_PRINT(cout << "Context() " << this << endl);
+        {
+            std::lock_guard< std::mutex > guard(liveContextIdsMutex);
+            liveContextIds.insert(id);
+        }
         std::lock_guard< std::mutex > guard(clcontextcreation_mutex);
         cocl::CoclDevice *coclDevice = cocl::getCoclDeviceByGpuOrdinal(gpuOrdinal);
         cl.reset(EasyCL::createForPlatformDeviceIds(coclDevice->platformId, coclDevice->deviceId));
-        default_stream.reset(new CoclStream(cl.get()));
+        maxKernelParameterBytes = getDeviceInfoInt64(coclDevice->deviceId, CL_DEVICE_MAX_PARAMETER_SIZE);
+        localMemBytes = getDeviceInfoInt64(coclDevice->deviceId, CL_DEVICE_LOCAL_MEM_SIZE);
+        default_stream.reset(new CoclStream(this));
+        memoryCache.reset(new MemoryCache(coclDevice->deviceId));
+        slabAllocator.reset(new SlabAllocator(coclDevice->deviceId));
+        stagingPool.reset(new StagingPool(this));
+        warmup.reset(createKernelWarmup(this, getThreadVars()->offsets_32bit));
     }
     Context::~Context() {
         COCL_PRINT(cout << "~Context() " << this << endl);
+        // the warmup threads build into our caches, using cl
+        warmup.reset();
+        // waits for staged copies, and unmaps its chunks, on default_stream
+        stagingPool.reset();
+        // likewise any cuMemHostAlloc memory from this context, which goes with it, as in cuda
+        releasePinnedHostMemory(this);
+        // the stream unregisters itself, using mu, so it needs to go before mu does
+        default_stream.reset();
+        {
+            std::lock_guard< std::mutex > guard(liveContextIdsMutex);
+            liveContextIds.erase(id);
+        }
+        numContextsDestroyed++;
     }
 
     ContextMutex::ContextMutex(Context *context) : context(context) {
@@ -92,6 +134,7 @@ size_t cuCtxSynchronize(void) {
     COCL_PRINT(cout << "cuCtxSynchronize" << endl);
     ThreadVars *v = getThreadVars();
     EasyCL *cl = v->getContext()->getCl();
+    synchronizeStreams(v->getContext());
     cl->finish();
     return 0;
 }
@@ -0,0 +1,241 @@
+// Copyright Hugh Perkins 2016, 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_diskcache.h"
+
+#include "cocl/cocl_filesystem.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+
+using namespace std;
+
+#undef COCL_PRINT
+#define COCL_PRINT(x)
+// #define COCL_PRINT(x) std::cout << "[DISKCACHE] " << x << std::endl;
+
+namespace cocl {
+
+static const char *fileMagic = "COCLCACHE1";
+
+uint64_t fnv1a(const std::string &data, uint64_t hash) {
+    for(size_t i = 0; i < data.size(); i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    // also mix in a terminator, so that eg hashing "ab" then "c" differs from "a" then "bc"
+    hash ^= 0xff;
+    hash *= 1099511628211ULL;
+    return hash;
+}
+
+std::string hashToHex(uint64_t hash) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)hash);
+    return buf;
+}
+
+DiskCache::DiskCache(std::string dir, long long maxBytes) :
+        dir(dir), maxBytes(maxBytes) {
+}
+
+std::string DiskCache::getPath(std::string key) {
+    return dir + "/" + key;
+}
+
+bool DiskCache::read(std::string key, std::string *contents) {
+    std::string path = getPath(key);
+    ifstream f(path, ios_base::in | ios_base::binary);
+    if(!f) {
+        return false;
+    }
+    std::string magic;
+    std::string hashHex;
+    size_t size = 0;
+    f >> magic >> hashHex >> size;
+    if(!f || magic != fileMagic || f.get() != '\n') {
+        COCL_PRINT("bad header in " << path);
+        return false;
+    }
+    std::string data(size, '\0');
+    if(size > 0) {
+        f.read(&data[0], size);
+    }
+    if(!f || (size_t)f.gcount() != size || hashToHex(fnv1a(data)) != hashHex) {
+        // truncated or corrupted. someone may be overwriting it right now, so just leave it
+        COCL_PRINT("bad checksum in " << path);
+        return false;
+    }
+    f.close();
+    // mark as recently used, for eviction
+    touchFile(path);
+    contents->swap(data);
+    COCL_PRINT("hit " << path << " size=" << size);
+    return true;
+}
+
+void DiskCache::write(std::string key, const std::string &contents) {
+    std::string path = getPath(key);
+    long long writeId = 0;
+    {
+        std::lock_guard< std::mutex > guard(mutex);
+        writeId = numWrites++;
+    }
+    // unique across processes, and across threads in this process
+    std::ostringstream tmpPath;
+    tmpPath << path << ".tmp." << getProcessId() << "." << writeId;
+    {
+        ofstream f(tmpPath.str(), ios_base::out | ios_base::binary | ios_base::trunc);
+        if(!f) {
+            COCL_PRINT("failed to open " << tmpPath.str());
+            return;
+        }
+        f << fileMagic << " " << hashToHex(fnv1a(contents)) << " " << contents.size() << "\n";
+        f.write(contents.data(), contents.size());
+        f.close();
+        if(!f) {
+            COCL_PRINT("failed to write " << tmpPath.str());
+            remove(tmpPath.str().c_str());
+            return;
+        }
+    }
+    // rename is atomic, so readers see either the old file, or the whole new file
+    if(!replaceFile(tmpPath.str(), path)) {
+        COCL_PRINT("failed to rename " << tmpPath.str());
+        remove(tmpPath.str().c_str());
+        return;
+    }
+    COCL_PRINT("wrote " << path << " size=" << contents.size());
+    evict();
+}
+
+class DiskCacheFile {
+public:
+    std::string path;
+    long long bytes;
+    time_t mtime;
+    bool operator<(const DiskCacheFile &other) const {
+        return mtime < other.mtime;
+    }
+};
+
+static std::vector<DiskCacheFile> listCacheFiles(std::string dir) {
+    std::vector<DiskCacheFile> files;
+    std::vector<FileInfo> fileInfos = listFiles(dir);
+    time_t now = time(0);
+    for(auto it = fileInfos.begin(); it != fileInfos.end(); it++) {
+        DiskCacheFile file;
+        file.path = dir + "/" + it->name;
+        if(it->name.find(".tmp.") != std::string::npos) {
+            // left behind by a process that died mid-write; anything still being written is
+            // much newer than an hour
+            if(now - it->mtime > 3600) {
+                remove(file.path.c_str());
+            }
+            continue;
+        }
+        file.bytes = it->bytes;
+        file.mtime = it->mtime;
+        files.push_back(file);
+    }
+    return files;
+}
+
+long long DiskCache::getTotalBytes() {
+    std::vector<DiskCacheFile> files = listCacheFiles(dir);
+    long long totalBytes = 0;
+    for(auto it = files.begin(); it != files.end(); it++) {
+        totalBytes += it->bytes;
+    }
+    return totalBytes;
+}
+
+void DiskCache::evict() {
+    std::lock_guard< std::mutex > guard(mutex);
+    std::vector<DiskCacheFile> files = listCacheFiles(dir);
+    long long totalBytes = 0;
+    for(auto it = files.begin(); it != files.end(); it++) {
+        totalBytes += it->bytes;
+    }
+    if(totalBytes <= maxBytes) {
+        return;
+    }
+    // other processes may be evicting too, so files can vanish under us; we just skip those
+    std::sort(files.begin(), files.end());
+    for(auto it = files.begin(); it != files.end() && totalBytes > maxBytes; it++) {
+        COCL_PRINT("evicting " << it->path << " size=" << it->bytes);
+        remove(it->path.c_str());
+        totalBytes -= it->bytes;
+    }
+}
+
+std::string getLibraryBuildId() {
+    static std::string buildId = "";
+    static std::once_flag once;
+    std::call_once(once, [] {
+        std::ostringstream oss;
+        std::string path = getModulePath((const void *)&getLibraryBuildId);
+        FileInfo info;
+        if(path != "" && getFileInfo(path, &info)) {
+            oss << path << " " << info.bytes << " " << info.mtime;
+        } else {
+            // cant find ourselves on disk; fall back to when this file was compiled
+            oss << __DATE__ << " " << __TIME__;
+        }
+        buildId = oss.str();
+    });
+    return buildId;
+}
+
+static DiskCache *createDiskCache() {
+    long long maxBytes = 512ll * 1024 * 1024;
+    if(getenv("COCL_CACHE_MAX_BYTES") != 0) {
+        maxBytes = atoll(getenv("COCL_CACHE_MAX_BYTES"));
+    }
+    if(maxBytes <= 0) {
+        return 0;
+    }
+    std::string dir = "";
+    if(getenv("COCL_CACHE_DIR") != 0) {
+        dir = getenv("COCL_CACHE_DIR");
+    } else if(getenv("XDG_CACHE_HOME") != 0) {
+        dir = std::string(getenv("XDG_CACHE_HOME")) + "/coriander";
+    } else if(getenv("HOME") != 0) {
+        dir = std::string(getenv("HOME")) + "/.cache/coriander";
+    } else if(getenv("LOCALAPPDATA") != 0) {
+        dir = std::string(getenv("LOCALAPPDATA")) + "/coriander";
+    }
+    if(dir == "") {
+        return 0;
+    }
+    if(!makeDirs(dir)) {
+        cout << "coriander: cannot create cache directory " << dir << ", so not caching kernels on disk" << endl;
+        return 0;
+    }
+    return new DiskCache(dir, maxBytes);
+}
+
+DiskCache *getDiskCache() {
+    static std::unique_ptr<DiskCache> diskCache(createDiskCache());
+    return diskCache.get();
+}
+
+} // namespace cocl
@@ -25,6 +25,7 @@
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <cstdlib>
 
 using namespace std;
 using namespace cocl;
@@ -47,6 +48,11 @@ using namespace easycl;
 static std::mutex cocl_events_mutex;
 
 namespace cocl {
+    bool isEventTimingEnabled() {
+        static bool enabled = getenv("COCL_EVENT_TIMING") == 0 || atoi(getenv("COCL_EVENT_TIMING")) != 0;
+        return enabled;
+    }
+
     CoclEvent::CoclEvent() {
         COCL_PRINT("CoclEvent() this=" << this);
         event = 0;
@@ -149,7 +155,34 @@ size_t cudaProfilerStop() {
 }
 
 size_t cudaEventElapsedTime(float *p_elapsedTime, cocl::CoclEvent *start, cocl::CoclEvent *stop) {
-    *p_elapsedTime = 0.0f;
+    std::lock_guard< std::mutex > guard(cocl_events_mutex);
+    COCL_PRINT("cudaEventElapsedTime start=" << start << " stop=" << stop);
+    if(start->event == 0 || stop->event == 0) {
+        COCL_PRINT("cudaEventElapsedTime: event not recorded");
+        return cudaErrorInvalidResourceHandle;
+    }
+    // each event is a marker, so its CL_PROFILING_COMMAND_END is when everything enqueued before
+    // it, on its stream, had finished
+    cl_event events[2] = { start->event, stop->event };
+    cl_ulong endTimes[2];
+    for(int i = 0; i < 2; i++) {
+        cl_int status;
+        cl_int err = clGetEventInfo(events[i], CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, 0);
+        EasyCL::checkError(err);
+        if(status > 0) {
+            return cudaErrorNotReady;
+        }
+        err = clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &endTimes[i], 0);
+        if(err == CL_PROFILING_INFO_NOT_AVAILABLE) {
+            // eg COCL_EVENT_TIMING=0
+            COCL_PRINT("cudaEventElapsedTime: no profiling info");
+            return cudaErrorInvalidResourceHandle;
+        }
+        EasyCL::checkError(err);
+    }
+    // nanoseconds to milliseconds
+    *p_elapsedTime = (float)((double)((long long)endTimes[1] - (long long)endTimes[0]) / 1000000.0);
+    COCL_PRINT("cudaEventElapsedTime " << *p_elapsedTime << "ms");
     return 0;
 }
 
@@ -186,6 +219,7 @@ size_t cuEventRecord(CoclEvent *event, char *_queue) {
         // cout << "cuEventRecrd event is already assigned => error" << endl;
         // throw runtime_error("cuEventRecord: event is already assigned => error");
     }
+    StreamEnqueue streamEnqueue(coclStream);
     cl_event clevent;
     err = clEnqueueMarkerWithWaitList(queue->queue, 0, 0, &clevent);
     COCL_PRINT("cuEventRecord CoclEvent=" << event << " created clevent=" << clevent);
@@ -0,0 +1,244 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_filesystem.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#include <io.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <dlfcn.h>
+#include <limits.h>
+#endif
+
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+using namespace std;
+
+namespace cocl {
+
+static bool isSeparator(char c) {
+#ifdef _WIN32
+    return c == '/' || c == '\\';
+#else
+    return c == '/';
+#endif
+}
+
+static bool statFile(std::string path, struct stat *st) {
+    return stat(path.c_str(), st) == 0;
+}
+
+bool makeDirs(std::string path) {
+    for(size_t pos = 1; pos <= path.size(); pos++) {
+        if(pos == path.size() || isSeparator(path[pos])) {
+            std::string parent = path.substr(0, pos);
+            if(parent[parent.size() - 1] == ':') {
+                continue; // a windows drive, eg C:
+            }
+#ifdef _WIN32
+            int res = _mkdir(parent.c_str());
+#else
+            int res = mkdir(parent.c_str(), 0755);
+#endif
+            if(res != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    struct stat st;
+    return statFile(path, &st) && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+bool getFileInfo(std::string path, FileInfo *info) {
+    struct stat st;
+    if(!statFile(path, &st) || (st.st_mode & S_IFMT) != S_IFREG) {
+        return false;
+    }
+    size_t lastSeparator = path.size();
+    for(size_t pos = 0; pos < path.size(); pos++) {
+        if(isSeparator(path[pos])) {
+            lastSeparator = pos;
+        }
+    }
+    info->name = lastSeparator == path.size() ? path : path.substr(lastSeparator + 1);
+    info->bytes = st.st_size;
+    info->mtime = st.st_mtime;
+    return true;
+}
+
+static void addFileInfo(std::string dir, std::string name, std::vector<FileInfo> *files) {
+    if(name == "." || name == "..") {
+        return;
+    }
+    FileInfo file;
+    if(getFileInfo(dir + "/" + name, &file)) {
+        files->push_back(file);
+    }
+}
+
+std::vector<FileInfo> listFiles(std::string dir) {
+    std::vector<FileInfo> files;
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    HANDLE handle = FindFirstFileA((dir + "\\*").c_str(), &findData);
+    if(handle == INVALID_HANDLE_VALUE) {
+        return files;
+    }
+    do {
+        addFileInfo(dir, findData.cFileName, &files);
+    } while(FindNextFileA(handle, &findData));
+    FindClose(handle);
+#else
+    DIR *d = opendir(dir.c_str());
+    if(d == 0) {
+        return files;
+    }
+    struct dirent *entry;
+    while((entry = readdir(d)) != 0) {
+        addFileInfo(dir, entry->d_name, &files);
+    }
+    closedir(d);
+#endif
+    return files;
+}
+
+bool setFileMtime(std::string path, time_t mtime) {
+#ifdef _WIN32
+    struct _utimbuf times;
+    times.actime = mtime;
+    times.modtime = mtime;
+    return _utime(path.c_str(), &times) == 0;
+#else
+    struct utimbuf times;
+    times.actime = mtime;
+    times.modtime = mtime;
+    return utime(path.c_str(), &times) == 0;
+#endif
+}
+
+bool touchFile(std::string path) {
+#ifdef _WIN32
+    return _utime(path.c_str(), 0) == 0;
+#else
+    return utime(path.c_str(), 0) == 0;
+#endif
+}
+
+bool replaceFile(std::string from, std::string to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+int getProcessId() {
+#ifdef _WIN32
+    return _getpid();
+#else
+    return getpid();
+#endif
+}
+
+std::string makeTempDir(std::string prefix) {
+#ifdef _WIN32
+    char tempPath[MAX_PATH];
+    DWORD len = GetTempPathA(MAX_PATH, tempPath);
+    if(len == 0 || len >= MAX_PATH) {
+        return "";
+    }
+    std::string dirTemplate = std::string(tempPath) + prefix + "XXXXXX";
+    std::vector<char> buf(dirTemplate.begin(), dirTemplate.end());
+    buf.push_back('\0');
+    if(_mktemp_s(&buf[0], buf.size()) != 0 || _mkdir(&buf[0]) != 0) {
+        return "";
+    }
+    return &buf[0];
+#else
+    std::string dirTemplate = "/tmp/" + prefix + "XXXXXX";
+    std::vector<char> buf(dirTemplate.begin(), dirTemplate.end());
+    buf.push_back('\0');
+    if(mkdtemp(&buf[0]) == 0) {
+        return "";
+    }
+    return &buf[0];
+#endif
+}
+
+std::string getModulePath(const void *address) {
+#ifdef _WIN32
+    HMODULE module = 0;
+    if(!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+            (LPCSTR)address, &module)) {
+        return "";
+    }
+    char path[MAX_PATH];
+    DWORD len = GetModuleFileNameA(module, path, MAX_PATH);
+    if(len == 0 || len >= MAX_PATH) {
+        return "";
+    }
+    return std::string(path, len);
+#else
+    Dl_info info;
+    if(dladdr(address, &info) == 0 || info.dli_fname == 0) {
+        return "";
+    }
+    return info.dli_fname;
+#endif
+}
+
+std::string getExecutablePath() {
+#if defined(_WIN32)
+    char path[MAX_PATH];
+    DWORD len = GetModuleFileNameA(0, path, MAX_PATH);
+    if(len == 0 || len >= MAX_PATH) {
+        return "";
+    }
+    return std::string(path, len);
+#elif defined(__APPLE__)
+    uint32_t size = 0;
+    _NSGetExecutablePath(0, &size); // tells us how big a buffer we need
+    std::vector<char> path(size + 1, '\0');
+    if(_NSGetExecutablePath(&path[0], &size) != 0) {
+        return "";
+    }
+    return &path[0];
+#else
+    char path[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if(len <= 0) {
+        return "";
+    }
+    return std::string(path, len);
+#endif
+}
+
+} // namespace cocl
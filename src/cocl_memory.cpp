@@ -18,6 +18,8 @@
 #include "cocl/cocl_streams.h"
 #include "cocl/cocl_context.h"
 #include "cocl/cocl_device.h"
+#include "cocl/cocl_pinned.h"
+#include "cocl/cocl_error.h"
 
 #include "cocl/fill_buffer.h"
 
@@ -26,6 +28,8 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <cstdlib>
+#include <cstring>
 
 #include "EasyCL/EasyCL.h"
 
@@ -44,17 +48,37 @@ using namespace easycl;
 #endif
 
 namespace cocl {
-    // we should index these, but a set is ok-ish for now. maybe
-
-    Memory::Memory(cl_mem clmem, size_t bytes) :
-            clmem(clmem), bytes(bytes) {
+    // the last Memory found by findMemoryRef, on this thread. Lets repeated lookups into the same
+    // buffer (the common case, eg a kernel launched in a loop) skip the context mutex entirely.
+    // It's only trusted whilst context->memoryGeneration is unchanged, ie no alloc/free since.
+    // Holds a copy, rather than the Memory itself, since a free on another thread can delete
+    // that between our generation check and reading it
+    class MemoryLookupCache {
+    public:
+        long long contextId = -1;
+        long long generation = -1;
+        MemoryRef ref;
+    };
+    static thread_local MemoryLookupCache memoryLookupCache;
+
+    Memory::Memory(cl_mem clmem, size_t bytes, size_t capacity, Slab *slab, size_t clmemOffset) :
+            clmem(clmem), bytes(bytes), capacity(capacity), slab(slab), clmemOffset(clmemOffset) {
+        // caller should hold the context mutex
         ThreadVars *v = getThreadVars();
-        fakePos = v->getContext()->nextAllocPos;
-        // we should align it actually.  on 128-bytes?
-        fakePos = ((fakePos + 127) / 128) * 128;
-        v->getContext()->nextAllocPos = fakePos + bytes;
-        v->getContext()->memoryByAllocPos[fakePos] = this;
-        v->getContext()->memories.insert(this);
+        Context *context = v->getContext();
+        if(slab != 0) {
+            // the slab already reserved our vmem range, when it was created
+            fakePos = slab->fakePos + clmemOffset;
+        } else {
+            fakePos = context->nextAllocPos;
+            // we should align it actually.  on 128-bytes?
+            fakePos = ((fakePos + 127) / 128) * 128;
+            context->nextAllocPos = fakePos + bytes;
+            context->vmemBaseByClmem[clmem] = fakePos;
+        }
+        context->memoryByAllocPos[fakePos] = this;
+        context->memories.insert(this);
+        context->memoryGeneration++;
     }
 
     Memory *Memory::newDeviceAlloc(size_t bytes) {
@@ -62,65 +86,348 @@ namespace cocl {
         Context *context = v->getContext();
         ContextMutex contextMutex(context);
         EasyCL *cl = v->getContext()->getCl();
+        MemoryCache *memoryCache = context->memoryCache.get();
+        SlabAllocator *slabAllocator = context->slabAllocator.get();
+        memoryCache->stats.numAllocs++;
+        if(slabAllocator->handles(bytes)) {
+            size_t clmemOffset = 0;
+            Slab *slab = slabAllocator->allocate(context, bytes, &clmemOffset);
+            size_t capacity = ((bytes + 127) / 128) * 128;
+            return new Memory(slab->clmem, bytes, capacity, slab, clmemOffset);
+        }
+        size_t capacity = memoryCache->getCapacityFor(bytes);
+        cl_mem clmem = memoryCache->allocate(cl, capacity);
+        Memory *memory = new Memory(clmem, bytes, capacity, 0, 0);
+        return memory;
+    }
+
+    Memory::~Memory() {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        ContextMutex contextMutex(context);
+        context->memoryGeneration++;
+        context->memoryByAllocPos.erase(fakePos);
+        context->memories.erase(this);
+        context->memoryCache->stats.numFrees++;
+        if(slab != 0) {
+            context->slabAllocator->free(context, slab, clmemOffset, capacity);
+        } else {
+            context->vmemBaseByClmem.erase(clmem);
+            context->memoryCache->give(clmem, capacity);
+        }
+    }
+
+    MemoryCache::MemoryCache(cl_device_id deviceId) {
+        // by default, let the cache hold up to a quarter of the device memory
+        stats.maxCachedBytes = getDeviceInfoInt64(deviceId, CL_DEVICE_GLOBAL_MEM_SIZE) / 4;
+        if(getenv("COCL_MEMORY_CACHE_MAX_BYTES") != 0) {
+            stats.maxCachedBytes = atoll(getenv("COCL_MEMORY_CACHE_MAX_BYTES"));
+        }
+        COCL_PRINT("MemoryCache maxCachedBytes=" << stats.maxCachedBytes);
+    }
+
+    MemoryCache::~MemoryCache() {
+        trim(0);
+    }
+
+    size_t MemoryCache::getSizeClass(size_t bytes) {
+        // four size classes per power of two, so we waste at most 25% of each allocation
+        const size_t minSizeClass = 512;
+        if(bytes <= minSizeClass) {
+            return minSizeClass;
+        }
+        size_t powerOfTwo = minSizeClass;
+        while(powerOfTwo * 2 < bytes) {
+            powerOfTwo *= 2;
+        }
+        size_t step = powerOfTwo / 4;
+        return ((bytes + step - 1) / step) * step;
+    }
+
+    size_t MemoryCache::getCapacityFor(size_t bytes) {
+        if(stats.maxCachedBytes == 0) {
+            // caching is disabled, so no point in rounding up
+            return bytes;
+        }
+        return getSizeClass(bytes);
+    }
+
+    cl_mem MemoryCache::allocate(EasyCL *cl, size_t capacity) {
+        cl_mem clmem = take(capacity);
+        if(clmem != 0) {
+            return clmem;
+        }
         cl_int err;
-        cl_mem clmem = clCreateBuffer(*cl->context, CL_MEM_READ_WRITE, bytes,
+        clmem = clCreateBuffer(*cl->context, CL_MEM_READ_WRITE, capacity,
                                                NULL, &err);
+        if(err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES || err == CL_OUT_OF_HOST_MEMORY) {
+            if(stats.cachedBytes > 0) {
+                COCL_PRINT("clCreateBuffer failed, releasing " << stats.cachedBytes << " cached bytes, and retrying");
+                trim(0);
+                clmem = clCreateBuffer(*cl->context, CL_MEM_READ_WRITE, capacity,
+                                                       NULL, &err);
+            }
+        }
         EasyCL::checkError(err);
-        Memory *memory = new Memory(clmem, bytes);
-        return memory;
+        return clmem;
     }
 
-    Memory::~Memory() {
+    cl_mem MemoryCache::take(size_t capacity) {
+        auto it = clmemsByCapacity.find(capacity);
+        if(it == clmemsByCapacity.end()) {
+            stats.numCacheMisses++;
+            return 0;
+        }
+        cl_mem clmem = it->second;
+        clmemsByCapacity.erase(it);
+        stats.cachedBytes -= capacity;
+        stats.cachedBuffers--;
+        stats.numCacheHits++;
+        return clmem;
+    }
+
+    void MemoryCache::give(cl_mem clmem, size_t capacity) {
+        if(capacity > stats.maxCachedBytes) {
+            stats.numReleases++;
+            cl_int err = clReleaseMemObject(clmem);
+            EasyCL::checkError(err);
+            return;
+        }
+        trim(stats.maxCachedBytes - capacity);
+        clmemsByCapacity.insert(std::make_pair(capacity, clmem));
+        stats.cachedBytes += capacity;
+        stats.cachedBuffers++;
+    }
+
+    void MemoryCache::trim(size_t targetCachedBytes) {
+        // release the largest clmems first, so we get under the target with as few
+        // releases as possible
+        while(stats.cachedBytes > targetCachedBytes) {
+            auto it = clmemsByCapacity.end();
+            it--;
+            cl_int err = clReleaseMemObject(it->second);
+            EasyCL::checkError(err);
+            stats.cachedBytes -= it->first;
+            stats.cachedBuffers--;
+            stats.numReleases++;
+            clmemsByCapacity.erase(it);
+        }
+    }
+
+    Slab::Slab(cl_mem clmem, size_t capacity, size_t fakePos) :
+            clmem(clmem), capacity(capacity), fakePos(fakePos) {
+        freeBytesByOffset[0] = capacity;
+    }
+
+    bool Slab::allocate(size_t bytes, size_t *pOffset) {
+        // bytes should already be a multiple of 128, so every offset we hand out stays aligned
+        for(auto it = freeBytesByOffset.begin(); it != freeBytesByOffset.end(); it++) {
+            size_t offset = it->first;
+            size_t freeBytes = it->second;
+            if(freeBytes < bytes) {
+                continue;
+            }
+            freeBytesByOffset.erase(it);
+            if(freeBytes > bytes) {
+                freeBytesByOffset[offset + bytes] = freeBytes - bytes;
+            }
+            usedBytes += bytes;
+            *pOffset = offset;
+            return true;
+        }
+        return false;
+    }
+
+    void Slab::free(size_t offset, size_t bytes) {
+        usedBytes -= bytes;
+        auto it = freeBytesByOffset.insert(std::make_pair(offset, bytes)).first;
+        // merge with the following free range, if adjacent
+        auto next = it;
+        next++;
+        if(next != freeBytesByOffset.end() && it->first + it->second == next->first) {
+            it->second += next->second;
+            freeBytesByOffset.erase(next);
+        }
+        // and with the preceding one
+        if(it != freeBytesByOffset.begin()) {
+            auto prev = it;
+            prev--;
+            if(prev->first + prev->second == it->first) {
+                prev->second += it->second;
+                freeBytesByOffset.erase(it);
+            }
+        }
+    }
+
+    SlabAllocator::SlabAllocator(cl_device_id deviceId) {
+        slabBytes = 64 * 1024 * 1024;
+        if(getenv("COCL_SLAB_BYTES") != 0) {
+            slabBytes = atoll(getenv("COCL_SLAB_BYTES"));
+        }
+        size_t maxAllocBytes = getDeviceInfoInt64(deviceId, CL_DEVICE_MAX_MEM_ALLOC_SIZE);
+        if(slabBytes > maxAllocBytes / 4) {
+            slabBytes = maxAllocBytes / 4;
+        }
+        slabBytes = (slabBytes / 128) * 128;
+        COCL_PRINT("SlabAllocator slabBytes=" << slabBytes);
+    }
+
+    SlabAllocator::~SlabAllocator() {
+        for(auto it = slabs.begin(); it != slabs.end(); it++) {
+            cl_int err = clReleaseMemObject((*it)->clmem);
+            EasyCL::checkError(err);
+        }
+    }
+
+    bool SlabAllocator::handles(size_t bytes) {
+        // anything bigger than this gets its own clmem, so one large allocation cant
+        // fragment a slab
+        return bytes <= slabBytes / 4;
+    }
+
+    Slab *SlabAllocator::allocate(Context *context, size_t bytes, size_t *pOffset) {
+        bytes = ((bytes + 127) / 128) * 128;
+        for(auto it = slabs.begin(); it != slabs.end(); it++) {
+            Slab *slab = it->get();
+            if(slab->allocate(bytes, pOffset)) {
+                return slab;
+            }
+        }
+        cl_mem clmem = context->memoryCache->allocate(context->getCl(), slabBytes);
+        size_t fakePos = ((context->nextAllocPos + 127) / 128) * 128;
+        context->nextAllocPos = fakePos + slabBytes;
+        context->vmemBaseByClmem[clmem] = fakePos;
+        Slab *slab = new Slab(clmem, slabBytes, fakePos);
+        slabs.push_back(std::unique_ptr<Slab>(slab));
+        COCL_PRINT("new slab clmem=" << clmem << " fakePos=" << fakePos << " numSlabs=" << slabs.size());
+        if(!slab->allocate(bytes, pOffset)) {
+            throw runtime_error("SlabAllocator::allocate: allocation doesnt fit in a new slab");
+        }
+        return slab;
+    }
+
+    void SlabAllocator::free(Context *context, Slab *slab, size_t offset, size_t bytes) {
+        slab->free(offset, bytes);
+        if(slab->usedBytes > 0 || slabs.size() == 1) {
+            // we always keep one slab, even if empty, so alloc/free in a loop doesnt keep
+            // creating and dropping slabs
+            return;
+        }
+        for(auto it = slabs.begin(); it != slabs.end(); it++) {
+            if(it->get() == slab) {
+                COCL_PRINT("returning empty slab clmem=" << slab->clmem);
+                context->vmemBaseByClmem.erase(slab->clmem);
+                context->memoryCache->give(slab->clmem, slab->capacity);
+                slabs.erase(it);
+                return;
+            }
+        }
+    }
+
+    MemoryCacheStats getMemoryCacheStats() {
         ThreadVars *v = getThreadVars();
-        v->getContext()->memoryByAllocPos.erase(fakePos);
-        v->getContext()->memories.erase(this);
-        cl_int err = clReleaseMemObject(clmem);
-        v->getContext()->getCl()->checkError(err);
-        // TODO: should remove from map and set too
+        Context *context = v->getContext();
+        ContextMutex contextMutex(context);
+        return context->memoryCache->stats;
+    }
+
+    void trimMemoryCache() {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        ContextMutex contextMutex(context);
+        context->memoryCache->trim(0);
+    }
+
+    // caller should hold the context mutex
+    static Memory *findMemoryLocked(Context *context, size_t pos) {
+        // memoryByAllocPos is keyed on fakePos, and ranges dont overlap, so the only candidate
+        // is the last allocation starting at or before pos
+        auto it = context->memoryByAllocPos.upper_bound((long long)pos);
+        if(it == context->memoryByAllocPos.begin()) {
+            return 0;
+        }
+        it--;
+        Memory *memory = it->second;
+        if(pos >= memory->fakePos && pos < memory->fakePos + memory->bytes) {
+            return memory;
+        }
+        return 0;
     }
 
     Memory *findMemory(const char *passedInAsCharStar) {
         ThreadVars *v = getThreadVars();
         Context *context = v->getContext();
         ContextMutex contextMutex(context);
+        return findMemoryLocked(context, (size_t)passedInAsCharStar);
+    }
+
+    MemoryRef findMemoryRef(const char *passedInAsCharStar) {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
         size_t pos = (size_t)passedInAsCharStar;
-        for(auto it=v->getContext()->memories.begin(), e=v->getContext()->memories.end(); it != e; it++) {
-            Memory *memory = *it;
-            if(pos >= memory->fakePos && pos < memory->fakePos + memory->bytes) {
-                return memory;
+
+        MemoryLookupCache &cache = memoryLookupCache;
+        if(cache.contextId == context->id && cache.generation == context->memoryGeneration.load()) {
+            const MemoryRef &ref = cache.ref;
+            if(pos >= ref.fakePos && pos < ref.fakePos + ref.bytes) {
+                return ref;
             }
         }
-        return 0;
+
+        ContextMutex contextMutex(context);
+        MemoryRef ref;
+        Memory *memory = findMemoryLocked(context, pos);
+        if(memory == 0) {
+            return ref;
+        }
+        ref.clmem = memory->clmem;
+        ref.fakePos = memory->fakePos;
+        ref.bytes = memory->bytes;
+        ref.clmemOffset = memory->clmemOffset;
+        // generation only moves under the context mutex, so this matches ref
+        cache.contextId = context->id;
+        cache.generation = context->memoryGeneration.load();
+        cache.ref = ref;
+        return ref;
     }
 
-    Memory *findMemoryByClmem(cl_mem clmem) {
+    size_t getClmemVmemBase(cl_mem clmem) {
         ThreadVars *v = getThreadVars();
         Context *context = v->getContext();
         ContextMutex contextMutex(context);
 
-        for(auto it=v->getContext()->memories.begin(), e=v->getContext()->memories.end(); it != e; it++) {
-            Memory *memory = *it;
-            if(clmem == memory->clmem) {
-                return memory;
-            }
+        auto it = context->vmemBaseByClmem.find(clmem);
+        if(it == context->vmemBaseByClmem.end()) {
+            return 0;
         }
-        return 0;
+        return it->second;
     }
 
     size_t Memory::getOffset(const char *passedInAsCharStar) {
-        return (size_t)passedInAsCharStar - fakePos;
+        return (size_t)passedInAsCharStar - fakePos + clmemOffset;
+    }
+
+    size_t MemoryRef::getOffset(const char *passedInAsCharStar) const {
+        return (size_t)passedInAsCharStar - fakePos + clmemOffset;
     }
 }
 
 size_t cuMemHostAlloc(void **pHostPointer, unsigned int bytes, int type) {
-    COCL_PRINT("cuMemHostAlloc redirected bytes=" << bytes);
-    *pHostPointer = malloc(bytes);
+    COCL_PRINT("cuMemHostAlloc bytes=" << bytes);
+    *pHostPointer = allocatePinnedHostMemory(getThreadVars()->getContext(), bytes);
+    if(*pHostPointer == 0) {
+        // still works, just without the faster, asynchronous, copies
+        COCL_PRINT("cuMemHostAlloc couldnt pin, using pageable memory");
+        *pHostPointer = malloc(bytes);
+    }
     return 0;
 }
 
 size_t cuMemFreeHost(void *hostPointer) {
-    COCL_PRINT("cuMemFreeHost redirected");
-    free(hostPointer);
+    COCL_PRINT("cuMemFreeHost");
+    if(!freePinnedHostMemory(hostPointer)) {
+        free(hostPointer);
+    }
     return 0;
 }
 
@@ -134,6 +441,43 @@ size_t cuMemGetInfo(size_t *free, size_t *total) {
     return 0;
 }
 
+namespace cocl {
+    // enqueues a write of host memory to the device, on coclStream, returning as soon as src can
+    // be reused. Pinned memory is written straight from, since it stays put until cuMemFreeHost;
+    // pageable memory is copied into staging chunks first, or, if staging is disabled, written
+    // with a blocking write
+    static void enqueueHostToDevice(CoclStream *coclStream, long long seq, cl_mem clmem, size_t offset,
+            const void *src, size_t bytes) {
+        cl_command_queue queue = coclStream->clqueue->queue;
+        StagingPool *stagingPool = coclStream->context->stagingPool.get();
+        cl_int err;
+        if(isPinnedHostMemory(src, bytes)) {
+            err = clEnqueueWriteBuffer(queue, clmem, CL_FALSE, offset, bytes, src, 0, NULL, NULL);
+            EasyCL::checkError(err);
+        } else if(stagingPool->enabled()) {
+            const char *srcChars = (const char *)src;
+            for(size_t pos = 0; pos < bytes; pos += stagingPool->chunkBytes) {
+                size_t chunkBytes = min(stagingPool->chunkBytes, bytes - pos);
+                StagingChunk *chunk = stagingPool->acquire();
+                memcpy(chunk->buffer->hostPtr, srcChars + pos, chunkBytes);
+                cl_event event;
+                err = clEnqueueWriteBuffer(queue, clmem, CL_FALSE, offset + pos, chunkBytes,
+                    chunk->buffer->hostPtr, 0, NULL, &event);
+                EasyCL::checkError(err);
+                stagingPool->release(chunk, event);
+            }
+        } else {
+            err = clEnqueueWriteBuffer(queue, clmem, CL_TRUE, offset, bytes, src, 0, NULL, NULL);
+            EasyCL::checkError(err);
+            coclStream->completedUpTo(seq);
+            return;
+        }
+        // so the transfer gets going now, overlapping with whatever the host does next
+        err = clFlush(queue);
+        EasyCL::checkError(err);
+    }
+}
+
 size_t cudaMemcpyAsync (void *dst, const void *src, size_t count, size_t cudaMemcpyKind, char *_queue) {
     ThreadVars *v = getThreadVars();
     CoclStream *coclStream = (CoclStream *)_queue;
@@ -144,46 +488,46 @@ size_t cudaMemcpyAsync (void *dst, const void *src, size_t count, size_t cudaMem
         coclStream = v->currentContext->default_stream.get();
     }
     CLQueue *queue = coclStream->clqueue;
+    StreamEnqueue streamEnqueue(coclStream);
+    long long seq = streamEnqueue.seq;
     cl_int err;
     if(cudaMemcpyKind == cudaMemcpyDeviceToHost) {
-        Memory *srcMemory = findMemory((const char *)src);
-        if(srcMemory == 0) {
+        MemoryRef srcMemory = findMemoryRef((const char *)src);
+        if(srcMemory.clmem == 0) {
             cout << "coudlnt find memory for src " << (const void *)src << endl;
             throw runtime_error("couldnt find memory for src");
         }
-        size_t src_offset = srcMemory->getOffset((const char *)src);
-        err = clEnqueueReadBuffer(queue->queue, srcMemory->clmem, CL_FALSE, src_offset,
+        size_t src_offset = srcMemory.getOffset((const char *)src);
+        err = clEnqueueReadBuffer(queue->queue, srcMemory.clmem, CL_FALSE, src_offset,
                                          count, dst, 0, NULL, NULL);
         EasyCL::checkError(err);
     } else if(cudaMemcpyKind == cudaMemcpyHostToDevice) {
-        Memory *dstMemory = findMemory((char *)dst);
-        if(dstMemory == 0) {
+        MemoryRef dstMemory = findMemoryRef((char *)dst);
+        if(dstMemory.clmem == 0) {
             cout << "coudlnt find memory for dst " << (void *)dst << endl;
             throw runtime_error("couldnt find memory for dst");
         }
-        size_t dst_offset = dstMemory->getOffset((char *)dst);
-        err = clEnqueueWriteBuffer(queue->queue, dstMemory->clmem, CL_FALSE, dst_offset,
-                                          count, src, 0, NULL, NULL);
-        EasyCL::checkError(err);
+        size_t dst_offset = dstMemory.getOffset((char *)dst);
+        enqueueHostToDevice(coclStream, seq, dstMemory.clmem, dst_offset, src, count);
     } else if(cudaMemcpyKind == cudaMemcpyDeviceToDevice) {
-        Memory *dstMemory = findMemory((char *)dst);
-        size_t dst_offset = dstMemory->getOffset((char *)dst);
+        MemoryRef dstMemory = findMemoryRef((char *)dst);
+        size_t dst_offset = dstMemory.getOffset((char *)dst);
 
-        Memory *srcMemory = findMemory((const char *)src);
-        size_t src_offset = srcMemory->getOffset((const char *)src);
-        if(dstMemory == 0) {
+        MemoryRef srcMemory = findMemoryRef((const char *)src);
+        size_t src_offset = srcMemory.getOffset((const char *)src);
+        if(dstMemory.clmem == 0) {
             cout << "coudlnt find memory for dst " << (void *)dst << endl;
             throw runtime_error("couldnt find memory for dst");
         }
-        if(srcMemory == 0) {
+        if(srcMemory.clmem == 0) {
             cout << "coudlnt find memory for src " << (const void *)src << endl;
             throw runtime_error("couldnt find memory for src");
         }
 
         err = clEnqueueCopyBuffer(
             queue->queue,
-            srcMemory->clmem,
-            dstMemory->clmem,
+            srcMemory.clmem,
+            dstMemory.clmem,
             src_offset,
             dst_offset,
             count,
@@ -200,41 +544,24 @@ size_t cudaMemcpyAsync (void *dst, const void *src, size_t count, size_t cudaMem
 
 size_t cudaMemsetAsync(void *location, int value, size_t count, char *_queue) {
     COCL_PRINT("cudaMemsetAsync value=" << value << " count=" << count << " queue=" << (long)_queue);
-
-    // this is not terribly async for now :-P
-
-    Memory *memory = findMemory((char *)location);
     ThreadVars *v = getThreadVars();
-    size_t offsetBytes = memory->getOffset((char *)location);
-    // std::cout << "memory " << (long)memory << std::endl;
-    // std::cout << " memory bytes " << memory->bytes << std::endl;
-    // std::cout << " offsetBytes " << offsetBytes << std::endl;
-
-    cl_int err;
-
-    err = clFinish(v->currentContext->default_stream.get()->clqueue->queue);
-    EasyCL::checkError(err);
-    // std::cout << "clfinished the queue" << std::endl;
-
-    if(count % 4 == 0) {
-        unsigned int fourbytes = 0;
-        for(int j=0; j < 4; j++) {
-            fourbytes <<= 8;
-            fourbytes |= (value & 255);
-        }
-        int intCount = count >> 2;
-        myEnqueueFillBuffer(
-            v->currentContext->default_stream.get()->clqueue->queue,
-            memory->clmem,
-            fourbytes,
-            offsetBytes, intCount);
-    } else {
-        cout << "memset should be multiple of 4 count" << std::endl;
-        throw std::runtime_error("cudaMemsetAsync should have count multiple of 4");
+    CoclStream *coclStream = (CoclStream *)_queue;
+    if(coclStream == 0) {
+        coclStream = v->getContext()->default_stream.get();
     }
-    err = clFinish(v->currentContext->default_stream.get()->clqueue->queue);
-    EasyCL::checkError(err);
-    // COCL_PRINT("finished cudaMemsetAsync");
+    if(count == 0) {
+        return 0;
+    }
+    MemoryRef memory = findMemoryRef((char *)location);
+    if(memory.clmem == 0) {
+        cout << "coudlnt find memory for location " << location << endl;
+        throw runtime_error("couldnt find memory for location");
+    }
+    size_t offsetBytes = memory.getOffset((char *)location);
+
+    // ordered on coclStream like any other command, so no need to wait for anything here
+    StreamEnqueue streamEnqueue(coclStream);
+    myEnqueueMemset(coclStream->clqueue->queue, memory.clmem, (unsigned char)value, offsetBytes, count);
     return 0;
 }
 
@@ -242,19 +569,21 @@ size_t cuMemsetD8(CUdeviceptr location, unsigned char value, uint32_t count) {
     COCL_PRINT("cuMemsetD8 redirected value " << value << " count=" << count);
     // use default queue??
     ThreadVars *v = getThreadVars();
-    Memory *memory = findMemory((char *)location);
-    size_t offset = memory->getOffset((char *)location);
-    cl_int err = clEnqueueFillBuffer(v->currentContext->default_stream.get()->clqueue->queue, memory->clmem, &value, sizeof(unsigned char), offset, count * sizeof(unsigned char), 0, 0, 0);
+    MemoryRef memory = findMemoryRef((char *)location);
+    size_t offset = memory.getOffset((char *)location);
+    StreamEnqueue streamEnqueue(v->currentContext->default_stream.get());
+    cl_int err = clEnqueueFillBuffer(v->currentContext->default_stream.get()->clqueue->queue, memory.clmem, &value, sizeof(unsigned char), offset, count * sizeof(unsigned char), 0, 0, 0);
     EasyCL::checkError(err);
     return 0;
 }
 
 size_t cuMemsetD32(CUdeviceptr location, unsigned int value, uint32_t count) {
-    Memory *memory = findMemory((char *)location);
+    MemoryRef memory = findMemoryRef((char *)location);
     ThreadVars *v = getThreadVars();
-    size_t offset = memory->getOffset((char *)location);
-    COCL_PRINT("cuMemsetD32 redirected value " << value << " count=" << count << " location=" << location << " memory=" << (void *)memory);
-    cl_int err = clEnqueueFillBuffer(v->currentContext->default_stream.get()->clqueue->queue, memory->clmem, &value, sizeof(int), offset, count * sizeof(int), 0, 0, 0);
+    size_t offset = memory.getOffset((char *)location);
+    COCL_PRINT("cuMemsetD32 redirected value " << value << " count=" << count << " location=" << location << " clmem=" << (void *)memory.clmem);
+    StreamEnqueue streamEnqueue(v->currentContext->default_stream.get());
+    cl_int err = clEnqueueFillBuffer(v->currentContext->default_stream.get()->clqueue->queue, memory.clmem, &value, sizeof(int), offset, count * sizeof(int), 0, 0, 0);
     EasyCL::checkError(err);
     return 0;
 }
@@ -272,27 +601,33 @@ size_t cudaMemcpy(void *dst, const void *src, size_t bytes, cudaMemcpyKind kind)
     COCL_PRINT("cudamempcy using opencl cudaMemcpyKind " << kind << " count=" << bytes);
     cl_int err;
     ThreadVars *v = getThreadVars();
+    // cudaMemcpy is on the legacy default stream, so waits for everything else in the context first
+    CoclStream *coclStream = v->getContext()->default_stream.get();
+    StreamEnqueue streamEnqueue(coclStream);
+    long long seq = streamEnqueue.seq;
     if(kind == cudaMemcpyDeviceToHost) {
-        Memory *srcMemory = findMemory((const char *)src);
-        size_t offset = srcMemory->getOffset((const char *)src);
-        err = clEnqueueReadBuffer(v->currentContext->default_stream.get()->clqueue->queue, srcMemory->clmem, CL_TRUE, offset,
+        MemoryRef srcMemory = findMemoryRef((const char *)src);
+        size_t offset = srcMemory.getOffset((const char *)src);
+        err = clEnqueueReadBuffer(v->currentContext->default_stream.get()->clqueue->queue, srcMemory.clmem, CL_TRUE, offset,
                                          bytes, dst, 0, NULL, NULL);
         EasyCL::checkError(err);
+        coclStream->completedUpTo(seq);
     } else if(kind == cudaMemcpyHostToDevice) {
-        Memory *dstMemory = findMemory((char *)dst);
-        size_t offset = dstMemory->getOffset((char *)dst);
-        err = clEnqueueWriteBuffer(v->currentContext->default_stream.get()->clqueue->queue, dstMemory->clmem, CL_TRUE, offset,
+        MemoryRef dstMemory = findMemoryRef((char *)dst);
+        size_t offset = dstMemory.getOffset((char *)dst);
+        err = clEnqueueWriteBuffer(v->currentContext->default_stream.get()->clqueue->queue, dstMemory.clmem, CL_TRUE, offset,
                                           bytes, src, 0, NULL, NULL);
         EasyCL::checkError(err);
+        coclStream->completedUpTo(seq);
     } else if(kind == cudaMemcpyDeviceToDevice) {
-        Memory *srcMemory = findMemory((const char *)src);
-        size_t src_offset = srcMemory->getOffset((const char *)src);
-        Memory *dstMemory = findMemory((char *)dst);
-        size_t dst_offset = dstMemory->getOffset((char *)dst);
+        MemoryRef srcMemory = findMemoryRef((const char *)src);
+        size_t src_offset = srcMemory.getOffset((const char *)src);
+        MemoryRef dstMemory = findMemoryRef((char *)dst);
+        size_t dst_offset = dstMemory.getOffset((char *)dst);
         err = clEnqueueCopyBuffer(
             v->currentContext->default_stream.get()->clqueue->queue,
-            srcMemory->clmem,
-            dstMemory->clmem,
+            srcMemory.clmem,
+            dstMemory.clmem,
             src_offset,
             dst_offset,
             bytes,
@@ -309,28 +644,29 @@ size_t cudaMemcpy(void *dst, const void *src, size_t bytes, cudaMemcpyKind kind)
 
 size_t cuMemcpyHtoDAsync(CUdeviceptr dst, const void *src, size_t bytes, char *_queue) {
     CoclStream *coclStream = (CoclStream *)_queue;
-    CLQueue *queue = coclStream->clqueue;
+    if(coclStream == 0) {
+        coclStream = getThreadVars()->getContext()->default_stream.get();
+    }
+    StreamEnqueue streamEnqueue(coclStream);
+    long long seq = streamEnqueue.seq;
     COCL_PRINT("cuMemcpyHtoDAsync dst=" << dst << " src=" << src << " bytes=" << bytes);
-    Memory *dstMemory = findMemory((char *)dst);
-    size_t offset = dstMemory->getOffset((char *)dst);
-    cl_int err;
-
-    err = clEnqueueWriteBuffer(queue->queue, dstMemory->clmem, CL_TRUE, offset,
-                                      bytes, src, 0, NULL, NULL);
-    EasyCL::checkError(err);
-
-    err = clFinish(queue->queue);
-    EasyCL::checkError(err);
-    COCL_PRINT(" ... done cuMemcpyHtoDAsync dst=" << dst << " src=" << src << " bytes=" << bytes);
+    MemoryRef dstMemory = findMemoryRef((char *)dst);
+    size_t offset = dstMemory.getOffset((char *)dst);
+    enqueueHostToDevice(coclStream, seq, dstMemory.clmem, offset, src, bytes);
+    COCL_PRINT(" ... enqueued cuMemcpyHtoDAsync dst=" << dst << " src=" << src << " bytes=" << bytes);
     return 0;
 }
 
 size_t  cuMemcpyDtoHAsync(void *dst, CUdeviceptr src, size_t bytes, char *_queue) {
     CoclStream *coclStream = (CoclStream *)_queue;
+    if(coclStream == 0) {
+        coclStream = getThreadVars()->getContext()->default_stream.get();
+    }
     CLQueue *queue = coclStream->clqueue;
+    StreamEnqueue streamEnqueue(coclStream);
     COCL_PRINT("cuMemcpyDtoHAsync queue=" << (void *)queue << " dst=" << dst << " src=" << src << " bytes=" << bytes);
-    Memory *srcMemory = findMemory((char *)src);
-    size_t offset = srcMemory->getOffset((char *)src);
+    MemoryRef srcMemory = findMemoryRef((char *)src);
+    size_t offset = srcMemory.getOffset((char *)src);
 
     // adding this because otherwise seems I need to call synchronize, on intel hd beignet, before
     // copying data back (even though the copy should wait, by virtue of being on the same queue, I think)
@@ -343,18 +679,14 @@ size_t  cuMemcpyDtoHAsync(void *dst, CUdeviceptr src, size_t bytes, char *_queue
 
     COCL_PRINT("   cuMemcpyDtoHAsync ...enqueued barrier with wait list")
 
-    err = clFinish(queue->queue);
-    EasyCL::checkError(err);
-
-    err = clEnqueueReadBuffer(queue->queue, srcMemory->clmem, CL_TRUE, offset,
+    // dst isnt valid until the stream is synchronized anyway, so the device can write straight
+    // into it, pinned or not
+    err = clEnqueueReadBuffer(queue->queue, srcMemory.clmem, CL_FALSE, offset,
                                      bytes, dst, 0, NULL, NULL);
     EasyCL::checkError(err);
-
-    COCL_PRINT("   cuMemcpyDtoHAsync ...enqueued read buffer")
-    EasyCL::checkError(err);
-    err = clFinish(queue->queue);
+    err = clFlush(queue->queue);
     EasyCL::checkError(err);
-    COCL_PRINT("   cuMemcpyDtoHAsync ...finished clfinish")
+    COCL_PRINT("   cuMemcpyDtoHAsync ...enqueued read buffer")
     return 0;
 }
 
@@ -402,6 +734,9 @@ size_t cudaFree(void *_memory) {
     }
     Memory *memory = findMemory((char *)_memory);
     COCL_PRINT("cudafree using opencl memory=" << memory);
+    // launches are asynchronous, so something queued might still be using this memory. Like cuda,
+    // cudaFree waits for the device, so the memory can safely be handed out again straight away
+    synchronizeStreams(getThreadVars()->getContext());
     delete memory;
     return 0;
 }
@@ -409,3 +744,211 @@ size_t cudaFree(void *_memory) {
 size_t cuMemFree(CUdeviceptr memory) {
     return cudaFree((void *)memory);
 }
+
+namespace cocl {
+    // rows are padded out to this, same as the alignment of our allocations
+    static const size_t pitchAlignment = 128;
+
+    // bytes from the first byte of a box of depth slices, of height rows, of width bytes, to
+    // just past its last
+    static size_t getRectSpan(size_t pitch, size_t slicePitch, size_t width, size_t height, size_t depth) {
+        return (depth - 1) * slicePitch + (height - 1) * pitch + width;
+    }
+
+    // the Memory holding all spanBytes from ptr, and the offset of ptr in its clmem. clmem is 0 if
+    // ptr isnt device memory, or the box runs off the end of its allocation; callers return
+    // cudaErrorInvalidValue for either
+    static MemoryRef findRectMemory(const char *ptr, size_t spanBytes, size_t *pOffset) {
+        MemoryRef memory = findMemoryRef(ptr);
+        if(memory.clmem == 0) {
+            cout << "rectangular copy: couldnt find memory for " << (const void *)ptr << endl;
+            return MemoryRef();
+        }
+        if((size_t)ptr + spanBytes > memory.fakePos + memory.bytes) {
+            cout << "rectangular copy of " << spanBytes << " bytes from " << (const void *)ptr
+                << " runs off the end of its allocation" << endl;
+            return MemoryRef();
+        }
+        *pOffset = memory.getOffset(ptr);
+        return memory;
+    }
+
+    // writes a box of pageable host memory to the device, via the staging pool, a chunk of rows
+    // at a time, packed together. Returns false if staging is off, or one row wont fit in a chunk
+    static bool enqueueStagedHostToDeviceRect(CoclStream *coclStream, cl_mem clmem, size_t dstOffset,
+            size_t dstPitch, size_t dstSlicePitch, const char *src, size_t srcPitch, size_t srcSlicePitch,
+            size_t width, size_t height, size_t depth) {
+        StagingPool *stagingPool = coclStream->context->stagingPool.get();
+        if(!stagingPool->enabled() || width > stagingPool->chunkBytes) {
+            return false;
+        }
+        size_t rowsPerChunk = stagingPool->chunkBytes / width;
+        for(size_t z = 0; z < depth; z++) {
+            for(size_t y = 0; y < height; y += rowsPerChunk) {
+                size_t numRows = min(rowsPerChunk, height - y);
+                StagingChunk *chunk = stagingPool->acquire();
+                for(size_t row = 0; row < numRows; row++) {
+                    memcpy(chunk->buffer->hostPtr + row * width, src + z * srcSlicePitch + (y + row) * srcPitch, width);
+                }
+                size_t bufferOrigin[3] = { dstOffset + z * dstSlicePitch + y * dstPitch, 0, 0 };
+                size_t hostOrigin[3] = { 0, 0, 0 };
+                size_t region[3] = { width, numRows, 1 };
+                cl_event event;
+                cl_int err = clEnqueueWriteBufferRect(coclStream->clqueue->queue, clmem, CL_FALSE,
+                    bufferOrigin, hostOrigin, region, dstPitch, 0, width, 0, chunk->buffer->hostPtr, 0, NULL, &event);
+                EasyCL::checkError(err);
+                stagingPool->release(chunk, event);
+            }
+        }
+        return true;
+    }
+
+    // copies a box of bytes, with a single rectangular transfer, or, for async copies from pageable
+    // memory, one per staging chunk. Blocking copies wait for the transfer; otherwise host to
+    // device returns as soon as src can be reused, and device to host leaves dst to be read once
+    // the stream is synchronized
+    static size_t enqueueMemcpy3D(CoclStream *coclStream, bool blocking, char *dst, size_t dstPitch, size_t dstSlicePitch,
+            const char *src, size_t srcPitch, size_t srcSlicePitch, size_t width, size_t height, size_t depth,
+            cudaMemcpyKind kind) {
+        COCL_PRINT("enqueueMemcpy3D kind=" << kind << " dst=" << (void *)dst << " src=" << (const void *)src
+            << " width=" << width << " height=" << height << " depth=" << depth << " blocking=" << blocking);
+        if(width == 0 || height == 0 || depth == 0) {
+            return cudaSuccess;
+        }
+        if(width > dstPitch || width > srcPitch) {
+            return cudaErrorInvalidPitchValue;
+        }
+        if(depth > 1 && (dstSlicePitch < height * dstPitch || srcSlicePitch < height * srcPitch)) {
+            return cudaErrorInvalidValue;
+        }
+        size_t dstSpan = getRectSpan(dstPitch, dstSlicePitch, width, height, depth);
+        size_t srcSpan = getRectSpan(srcPitch, srcSlicePitch, width, height, depth);
+        // opencl wants 0 for the slice pitch of a single slice, rather than anything that fits
+        if(depth == 1) {
+            dstSlicePitch = 0;
+            srcSlicePitch = 0;
+        }
+        // find everything, and reject anything bad, before beforeEnqueue, which records a
+        // command we then have to enqueue
+        bool srcOnDevice = kind == cudaMemcpyDeviceToHost || kind == cudaMemcpyDeviceToDevice;
+        bool dstOnDevice = kind == cudaMemcpyHostToDevice || kind == cudaMemcpyDeviceToDevice;
+        if(!srcOnDevice && !dstOnDevice) {
+            cout << "enqueueMemcpy3D: unhandled cudaMemcpyKind " << kind << endl;
+            return cudaErrorInvalidValue;
+        }
+        size_t srcOffset = 0;
+        size_t dstOffset = 0;
+        MemoryRef srcMemory;
+        MemoryRef dstMemory;
+        if(srcOnDevice) {
+            srcMemory = findRectMemory(src, srcSpan, &srcOffset);
+            if(srcMemory.clmem == 0) {
+                return cudaErrorInvalidValue;
+            }
+        }
+        if(dstOnDevice) {
+            dstMemory = findRectMemory(dst, dstSpan, &dstOffset);
+            if(dstMemory.clmem == 0) {
+                return cudaErrorInvalidValue;
+            }
+        }
+        size_t region[3] = { width, height, depth };
+        cl_command_queue queue = coclStream->clqueue->queue;
+        StreamEnqueue streamEnqueue(coclStream);
+        long long seq = streamEnqueue.seq;
+        cl_int err;
+        if(kind == cudaMemcpyHostToDevice) {
+            bool pinned = isPinnedHostMemory(src, srcSpan);
+            bool staged = !blocking && !pinned && enqueueStagedHostToDeviceRect(coclStream, dstMemory.clmem,
+                dstOffset, dstPitch, dstSlicePitch, src, srcPitch, srcSlicePitch, width, height, depth);
+            if(!staged) {
+                size_t bufferOrigin[3] = { dstOffset, 0, 0 };
+                size_t hostOrigin[3] = { 0, 0, 0 };
+                // pageable memory has to be read before we return, unless it was staged
+                blocking = blocking || !pinned;
+                err = clEnqueueWriteBufferRect(queue, dstMemory.clmem, blocking ? CL_TRUE : CL_FALSE,
+                    bufferOrigin, hostOrigin, region, dstPitch, dstSlicePitch, srcPitch, srcSlicePitch, src, 0, NULL, NULL);
+                EasyCL::checkError(err);
+            }
+        } else if(kind == cudaMemcpyDeviceToHost) {
+            size_t bufferOrigin[3] = { srcOffset, 0, 0 };
+            size_t hostOrigin[3] = { 0, 0, 0 };
+            err = clEnqueueReadBufferRect(queue, srcMemory.clmem, blocking ? CL_TRUE : CL_FALSE,
+                bufferOrigin, hostOrigin, region, srcPitch, srcSlicePitch, dstPitch, dstSlicePitch, dst, 0, NULL, NULL);
+            EasyCL::checkError(err);
+        } else {
+            size_t srcOrigin[3] = { srcOffset, 0, 0 };
+            size_t dstOrigin[3] = { dstOffset, 0, 0 };
+            err = clEnqueueCopyBufferRect(queue, srcMemory.clmem, dstMemory.clmem, srcOrigin, dstOrigin, region,
+                srcPitch, srcSlicePitch, dstPitch, dstSlicePitch, 0, NULL, NULL);
+            EasyCL::checkError(err);
+            blocking = false;
+        }
+        if(blocking) {
+            coclStream->completedUpTo(seq);
+        } else {
+            err = clFlush(queue);
+            EasyCL::checkError(err);
+        }
+        return cudaSuccess;
+    }
+}
+
+size_t cudaMallocPitch(void **devPtr, size_t *pitch, size_t width, size_t height) {
+    *pitch = (width + pitchAlignment - 1) / pitchAlignment * pitchAlignment;
+    COCL_PRINT("cudaMallocPitch width=" << width << " height=" << height << " pitch=" << *pitch);
+    return cudaMalloc(devPtr, *pitch * height);
+}
+
+size_t cudaMemcpy2D(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width, size_t height,
+        cudaMemcpyKind kind) {
+    // on the legacy default stream, like cudaMemcpy
+    CoclStream *coclStream = getThreadVars()->getContext()->default_stream.get();
+    return enqueueMemcpy3D(coclStream, true, (char *)dst, dpitch, 0, (const char *)src, spitch, 0,
+        width, height, 1, kind);
+}
+
+size_t cudaMemcpy2DAsync(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width, size_t height,
+        cudaMemcpyKind kind, char *_queue) {
+    CoclStream *coclStream = (CoclStream *)_queue;
+    if(coclStream == 0) {
+        coclStream = getThreadVars()->getContext()->default_stream.get();
+    }
+    return enqueueMemcpy3D(coclStream, false, (char *)dst, dpitch, 0, (const char *)src, spitch, 0,
+        width, height, 1, kind);
+}
+
+size_t cudaMemcpy3D(const cudaMemcpy3DParms *p) {
+    if(p->srcArray != 0 || p->dstArray != 0) {
+        cout << "cudaMemcpy3D: cuda arrays not implemented; use pitched pointers" << endl;
+        return cudaErrorInvalidValue;
+    }
+    size_t srcSlicePitch = p->srcPtr.pitch * p->srcPtr.ysize;
+    size_t dstSlicePitch = p->dstPtr.pitch * p->dstPtr.ysize;
+    const char *src = (const char *)p->srcPtr.ptr + p->srcPos.z * srcSlicePitch + p->srcPos.y * p->srcPtr.pitch
+        + p->srcPos.x;
+    char *dst = (char *)p->dstPtr.ptr + p->dstPos.z * dstSlicePitch + p->dstPos.y * p->dstPtr.pitch + p->dstPos.x;
+    CoclStream *coclStream = getThreadVars()->getContext()->default_stream.get();
+    return enqueueMemcpy3D(coclStream, true, dst, p->dstPtr.pitch, dstSlicePitch, src, p->srcPtr.pitch, srcSlicePitch,
+        p->extent.width, p->extent.height, p->extent.depth, p->kind);
+}
+
+size_t cudaMemset2D(void *devPtr, size_t pitch, int value, size_t width, size_t height) {
+    COCL_PRINT("cudaMemset2D devPtr=" << devPtr << " pitch=" << pitch << " value=" << value
+        << " width=" << width << " height=" << height);
+    if(width == 0 || height == 0) {
+        return cudaSuccess;
+    }
+    if(width > pitch) {
+        return cudaErrorInvalidPitchValue;
+    }
+    size_t offset;
+    MemoryRef memory = findRectMemory((const char *)devPtr, getRectSpan(pitch, 0, width, height, 1), &offset);
+    if(memory.clmem == 0) {
+        return cudaErrorInvalidValue;
+    }
+    CoclStream *coclStream = getThreadVars()->getContext()->default_stream.get();
+    StreamEnqueue streamEnqueue(coclStream);
+    myEnqueueMemset2D(coclStream->clqueue->queue, memory.clmem, (unsigned char)value, offset, pitch, width, height);
+    return cudaSuccess;
+}
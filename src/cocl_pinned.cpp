@@ -0,0 +1,199 @@
+// Copyright Hugh Perkins 2016, 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_pinned.h"
+
+#include "cocl/cocl_context.h"
+#include "cocl/cocl_streams.h"
+
+#include "EasyCL/EasyCL.h"
+
+#include <iostream>
+#include <map>
+#include <set>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace std;
+using namespace easycl;
+
+#undef COCL_PRINT
+#define COCL_PRINT(x)
+// #define COCL_PRINT(x) std::cout << "[PINNED] " << x << std::endl;
+
+namespace cocl {
+    PinnedBuffer::PinnedBuffer(Context *context, size_t bytes) :
+            context(context), bytes(bytes) {
+        cl_int err;
+        clmem = clCreateBuffer(*context->getCl()->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, 0, &err);
+        EasyCL::checkError(err);
+        hostPtr = (char *)clEnqueueMapBuffer(context->default_stream->clqueue->queue, clmem, CL_TRUE,
+            CL_MAP_READ | CL_MAP_WRITE, 0, bytes, 0, 0, 0, &err);
+        if(err != CL_SUCCESS) {
+            clReleaseMemObject(clmem);
+            EasyCL::checkError(err);
+        }
+        COCL_PRINT("PinnedBuffer bytes=" << bytes << " hostPtr=" << (void *)hostPtr);
+    }
+
+    PinnedBuffer::~PinnedBuffer() {
+        // the unmap is queued, and the release waits for it, so no need to block here
+        cl_int err = clEnqueueUnmapMemObject(context->default_stream->clqueue->queue, clmem, hostPtr, 0, 0, 0);
+        EasyCL::checkError(err);
+        err = clReleaseMemObject(clmem);
+        EasyCL::checkError(err);
+    }
+
+    static std::mutex pinnedHostMemoryMutex;
+    static std::map<const char *, std::unique_ptr<PinnedBuffer> > pinnedHostMemoryByHostPtr;
+    // freed along with their context, but not yet passed to freePinnedHostMemory
+    static std::set<const char *> orphanedHostPtrs;
+
+    void *allocatePinnedHostMemory(Context *context, size_t bytes) {
+        std::unique_ptr<PinnedBuffer> buffer;
+        try {
+            buffer.reset(new PinnedBuffer(context, bytes));
+        } catch(runtime_error &e) {
+            COCL_PRINT("couldnt allocate pinned memory: " << e.what());
+            return 0;
+        }
+        char *hostPtr = buffer->hostPtr;
+        std::lock_guard< std::mutex > guard(pinnedHostMemoryMutex);
+        // the driver might hand an orphaned address out again
+        orphanedHostPtrs.erase(hostPtr);
+        pinnedHostMemoryByHostPtr[hostPtr] = std::move(buffer);
+        return hostPtr;
+    }
+
+    bool freePinnedHostMemory(void *hostPtr) {
+        std::unique_ptr<PinnedBuffer> buffer;
+        {
+            std::lock_guard< std::mutex > guard(pinnedHostMemoryMutex);
+            auto it = pinnedHostMemoryByHostPtr.find((const char *)hostPtr);
+            if(it == pinnedHostMemoryByHostPtr.end()) {
+                // already gone with its context, so there is nothing left to free
+                return orphanedHostPtrs.erase((const char *)hostPtr) > 0;
+            }
+            buffer = std::move(it->second);
+            pinnedHostMemoryByHostPtr.erase(it);
+        }
+        return true;
+    }
+
+    void releasePinnedHostMemory(Context *context) {
+        std::vector<std::unique_ptr<PinnedBuffer> > buffers;
+        {
+            std::lock_guard< std::mutex > guard(pinnedHostMemoryMutex);
+            for(auto it = pinnedHostMemoryByHostPtr.begin(); it != pinnedHostMemoryByHostPtr.end();) {
+                if(it->second->context != context) {
+                    it++;
+                    continue;
+                }
+                COCL_PRINT("releasing pinned memory hostPtr=" << (void *)it->first << " with its context");
+                orphanedHostPtrs.insert(it->first);
+                buffers.push_back(std::move(it->second));
+                it = pinnedHostMemoryByHostPtr.erase(it);
+            }
+        }
+        // buffers unmap and release as they go out of scope, outside the lock
+    }
+
+    bool isPinnedHostMemory(const void *hostPtr, size_t bytes) {
+        const char *start = (const char *)hostPtr;
+        std::lock_guard< std::mutex > guard(pinnedHostMemoryMutex);
+        auto it = pinnedHostMemoryByHostPtr.upper_bound(start);
+        if(it == pinnedHostMemoryByHostPtr.begin()) {
+            return false;
+        }
+        it--;
+        PinnedBuffer *buffer = it->second.get();
+        return start + bytes <= buffer->hostPtr + buffer->bytes;
+    }
+
+    StagingPool::StagingPool(Context *context) :
+            context(context) {
+        size_t totalBytes = 16 * 1024 * 1024;
+        if(getenv("COCL_STAGING_BYTES") != 0) {
+            totalBytes = atoll(getenv("COCL_STAGING_BYTES"));
+        }
+        chunkBytes = min((size_t)(1024 * 1024), totalBytes);
+        maxChunks = chunkBytes > 0 ? totalBytes / chunkBytes : 0;
+        COCL_PRINT("StagingPool chunkBytes=" << chunkBytes << " maxChunks=" << maxChunks);
+    }
+
+    StagingPool::~StagingPool() {
+        for(auto it = busyChunks.begin(); it != busyChunks.end(); it++) {
+            cl_int err = clWaitForEvents(1, &(*it)->event);
+            EasyCL::checkError(err);
+            err = clReleaseEvent((*it)->event);
+            EasyCL::checkError(err);
+        }
+    }
+
+    void StagingPool::retireCompleted() {
+        // chunks from different streams can complete out of order, so check them all
+        for(auto it = busyChunks.begin(); it != busyChunks.end();) {
+            StagingChunk *chunk = *it;
+            cl_int status;
+            cl_int err = clGetEventInfo(chunk->event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, 0);
+            EasyCL::checkError(err);
+            if(status > 0) { // CL_QUEUED, CL_SUBMITTED or CL_RUNNING
+                it++;
+                continue;
+            }
+            err = clReleaseEvent(chunk->event);
+            EasyCL::checkError(err);
+            chunk->event = 0;
+            freeChunks.push_back(chunk);
+            it = busyChunks.erase(it);
+        }
+    }
+
+    StagingChunk *StagingPool::acquire() {
+        std::unique_lock< std::mutex > lock(mutex);
+        if(freeChunks.empty()) {
+            retireCompleted();
+        }
+        if(freeChunks.empty() && chunks.size() < maxChunks) {
+            StagingChunk *chunk = new StagingChunk();
+            chunk->buffer.reset(new PinnedBuffer(context, chunkBytes));
+            chunks.push_back(std::unique_ptr<StagingChunk>(chunk));
+            freeChunks.push_back(chunk);
+        }
+        while(freeChunks.empty()) {
+            if(busyChunks.empty()) {
+                // other threads hold every chunk, and havent enqueued their copies yet
+                COCL_PRINT("StagingPool full, waiting for another thread to release a chunk");
+                chunkReleased.wait(lock);
+                continue;
+            }
+            COCL_PRINT("StagingPool full, waiting for the oldest copy");
+            cl_int err = clWaitForEvents(1, &busyChunks.front()->event);
+            EasyCL::checkError(err);
+            retireCompleted();
+        }
+        StagingChunk *chunk = freeChunks.back();
+        freeChunks.pop_back();
+        return chunk;
+    }
+
+    void StagingPool::release(StagingChunk *chunk, cl_event event) {
+        {
+            std::lock_guard< std::mutex > guard(mutex);
+            chunk->event = event;
+            busyChunks.push_back(chunk);
+        }
+        chunkReleased.notify_all();
+    }
+}
@@ -15,8 +15,10 @@
 #include "cocl/cocl_streams.h"
 
 #include "cocl/cocl_events.h"
+#include "cocl/cocl_error.h"
 #include "cocl/hostside_opencl_funcs.h"
 #include "cocl/cocl_context.h"
+#include "cocl/cocl_device.h"
 
 #include "EasyCL/EasyCL.h"
 
@@ -25,7 +27,8 @@
 #include <vector>
 #include <map>
 #include <set>
-
+#include <cstdlib>
+#include <cstring>
 
 using namespace std;
 using namespace cocl;
@@ -46,12 +49,280 @@ namespace cocl {
         delete info;
     }
 
-    CoclStream::CoclStream(EasyCL *cl) {
-        this->clqueue = cl->newQueue();
+    CoclStream::CoclStream(Context *context) :
+            context(context), lastEnqueuedSeq(0), lastCompletedSeq(0) {
+        this->clqueue = context->getCl()->newQueue();
+        if(isEventTimingEnabled()) {
+            // swap in a queue that timestamps its commands, for cudaEventElapsedTime. The CLQueue
+            // releases whichever queue it ends up holding
+            cl_int err;
+            cl_command_queue profilingQueue = clCreateCommandQueue(
+                *context->getCl()->context, getCoclDeviceByGpuOrdinal(context->gpuOrdinal)->deviceId,
+                CL_QUEUE_PROFILING_ENABLE, &err);
+            EasyCL::checkError(err);
+            err = clReleaseCommandQueue(clqueue->queue);
+            EasyCL::checkError(err);
+            clqueue->queue = profilingQueue;
+        }
+        ContextMutex contextMutex(context);
+        context->streams.insert(this);
     }
     CoclStream::~CoclStream() {
+        synchronize();
+        if(queryMarker != 0) {
+            cl_int err = clReleaseEvent(queryMarker);
+            EasyCL::checkError(err);
+        }
+        uploadRing.reset();
+        {
+            ContextMutex contextMutex(context);
+            context->streams.erase(this);
+        }
         delete clqueue;
     }
+
+    long long CoclStream::beforeEnqueue() {
+        CoclStream *defaultStream = context->default_stream.get();
+        if(this == defaultStream || defaultStream == 0) {
+            ContextMutex contextMutex(context);
+            for(auto it = context->streams.begin(); it != context->streams.end(); it++) {
+                CoclStream *other = *it;
+                if(other != this && other->isBusy()) {
+                    waitFor(other);
+                }
+            }
+        } else if(defaultStream->isBusy()) {
+            waitFor(defaultStream);
+        }
+        return lastEnqueuedSeq.load() + 1;
+    }
+
+    StreamEnqueue::StreamEnqueue(CoclStream *stream) :
+            stream(stream), lock(stream->enqueueMutex) {
+        seq = stream->beforeEnqueue();
+    }
+
+    StreamEnqueue::~StreamEnqueue() {
+        publish();
+    }
+
+    void StreamEnqueue::publish() {
+        if(lock.owns_lock()) {
+            // if the enqueue threw, nothing went on the queue for seq, so publishing it is harmless
+            stream->lastEnqueuedSeq.store(seq);
+            lock.unlock();
+        }
+    }
+
+    void CoclStream::completedUpTo(long long seq) {
+        long long lastCompleted = lastCompletedSeq.load();
+        while(seq > lastCompleted && !lastCompletedSeq.compare_exchange_weak(lastCompleted, seq)) {
+        }
+    }
+
+    bool CoclStream::isBusy() {
+        if(lastCompletedSeq.load() >= lastEnqueuedSeq.load()) {
+            return false;
+        }
+        // async work only moves lastCompletedSeq on when something looks, so look
+        return query() != CL_COMPLETE;
+    }
+
+    void CoclStream::waitFor(CoclStream *other) {
+        COCL_PRINT(cout << "stream " << this << " waiting for stream " << other << endl);
+        cl_event event = other->retainMarker();
+        cl_int err = clEnqueueBarrierWithWaitList(clqueue->queue, 1, &event, 0);
+        EasyCL::checkError(err);
+        err = clReleaseEvent(event);
+        EasyCL::checkError(err);
+        context->numCrossStreamWaits++;
+    }
+
+    void CoclStream::addPending(long long seq, cl_event event, std::vector<cl_mem> &clmemsToRelease) {
+        reapCompleted();
+        std::lock_guard< std::mutex > guard(pendingMutex);
+        PendingLaunch pendingLaunch;
+        pendingLaunch.seq = seq;
+        pendingLaunch.event = event;
+        pendingLaunch.clmemsToRelease.swap(clmemsToRelease);
+        pending.push_back(pendingLaunch);
+    }
+
+    void CoclStream::reapCompleted() {
+        // the queue is in-order, so we can stop at the first pending launch that hasnt finished
+        std::lock_guard< std::mutex > guard(pendingMutex);
+        while(!pending.empty()) {
+            PendingLaunch &pendingLaunch = pending.front();
+            cl_int status;
+            cl_int err = clGetEventInfo(pendingLaunch.event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, 0);
+            EasyCL::checkError(err);
+            if(status > 0) { // CL_QUEUED, CL_SUBMITTED or CL_RUNNING
+                break;
+            }
+            completedUpTo(pendingLaunch.seq);
+            for(auto it = pendingLaunch.clmemsToRelease.begin(); it != pendingLaunch.clmemsToRelease.end(); it++) {
+                err = clReleaseMemObject(*it);
+                EasyCL::checkError(err);
+            }
+            if(pendingLaunch.clmemsToRelease.size() > 0) {
+                // their handles can come back from the next clCreateBuffer, so boundArgs cant trust them
+                context->memoryGeneration++;
+            }
+            err = clReleaseEvent(pendingLaunch.event);
+            EasyCL::checkError(err);
+            pending.pop_front();
+        }
+    }
+
+    void CoclStream::synchronize() {
+        long long seq = lastEnqueuedSeq.load();
+        cl_int err = clFinish(clqueue->queue);
+        EasyCL::checkError(err);
+        completedUpTo(seq);
+        reapCompleted();
+    }
+
+    cl_event CoclStream::getMarkerLocked(long long seq) {
+        cl_int err;
+        if(queryMarker != 0 && queryMarkerSeq < seq) {
+            // more work has been enqueued behind our marker since
+            err = clReleaseEvent(queryMarker);
+            EasyCL::checkError(err);
+            queryMarker = 0;
+        }
+        if(queryMarker == 0) {
+            // the queue is in-order, so the marker completes once everything before it has
+            err = clEnqueueMarkerWithWaitList(clqueue->queue, 0, 0, &queryMarker);
+            EasyCL::checkError(err);
+            // otherwise the work might never be submitted, and we'd poll forever
+            err = clFlush(clqueue->queue);
+            EasyCL::checkError(err);
+            queryMarkerSeq = seq;
+        }
+        return queryMarker;
+    }
+
+    cl_event CoclStream::retainMarker() {
+        std::lock_guard< std::mutex > guard(queryMutex);
+        cl_event marker = getMarkerLocked(lastEnqueuedSeq.load());
+        cl_int err = clRetainEvent(marker);
+        EasyCL::checkError(err);
+        return marker;
+    }
+
+    cl_int CoclStream::query() {
+        long long seq = lastEnqueuedSeq.load();
+        if(lastCompletedSeq.load() >= seq) {
+            return CL_COMPLETE;
+        }
+        std::lock_guard< std::mutex > guard(queryMutex);
+        cl_event marker = getMarkerLocked(seq);
+        cl_int status;
+        cl_int err = clGetEventInfo(marker, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, 0);
+        EasyCL::checkError(err);
+        if(status == CL_COMPLETE) {
+            completedUpTo(queryMarkerSeq);
+            err = clReleaseEvent(queryMarker);
+            EasyCL::checkError(err);
+            queryMarker = 0;
+            reapCompleted();
+        }
+        return status;
+    }
+
+    UploadRing *CoclStream::getUploadRing() {
+        std::lock_guard< std::mutex > guard(uploadRingMutex);
+        if(uploadRing == 0) {
+            size_t capacity = 1024 * 1024;
+            if(getenv("COCL_UPLOAD_RING_BYTES") != 0) {
+                capacity = atoll(getenv("COCL_UPLOAD_RING_BYTES"));
+            }
+            capacity = (capacity / UploadRing::alignment) * UploadRing::alignment;
+            if(capacity == 0) {
+                return 0;
+            }
+            uploadRing.reset(new UploadRing(this, capacity));
+        }
+        return uploadRing.get();
+    }
+
+    UploadRing::UploadRing(CoclStream *stream, size_t capacity) :
+            stream(stream), capacity(capacity), hostShadow(capacity) {
+        cl_int err;
+        clmem = clCreateBuffer(*stream->context->getCl()->context, CL_MEM_READ_WRITE, capacity, NULL, &err);
+        EasyCL::checkError(err);
+        COCL_PRINT(cout << "UploadRing capacity=" << capacity << endl);
+    }
+
+    UploadRing::~UploadRing() {
+        // the stream has been synchronized, so nothing is reading the ring anymore
+        cl_int err = clReleaseMemObject(clmem);
+        EasyCL::checkError(err);
+        // it was bound as a kernel arg, so, as for any freed clmem, boundArgs cant trust its handle
+        stream->context->memoryGeneration++;
+    }
+
+    void UploadRing::retireCompleted() {
+        // caller should hold mutex
+        stream->reapCompleted();
+        long long lastCompleted = stream->lastCompletedSeq.load();
+        while(!inFlight.empty() && inFlight.front().seq <= lastCompleted) {
+            usedBytes -= inFlight.front().numBytes;
+            inFlight.pop_front();
+        }
+        if(usedBytes == 0) {
+            head = 0;
+        }
+    }
+
+    size_t UploadRing::upload(long long seq, const char *data, size_t numBytes) {
+        std::lock_guard< std::mutex > guard(mutex);
+        size_t alignedBytes = ((numBytes + alignment - 1) / alignment) * alignment;
+        retireCompleted();
+        // regions are contiguous, so if we dont fit before the end of the ring, skip to the start
+        size_t padding = head + alignedBytes > capacity ? capacity - head : 0;
+        if(usedBytes + padding + alignedBytes > capacity) {
+            // everything in flight is ahead of us on the stream anyway, so just wait for it. Only
+            // up to seq - 1 though: our own launch has its seq, but isnt enqueued until we return
+            COCL_PRINT(cout << "UploadRing full, synchronizing stream" << endl);
+            cl_int err = clFinish(stream->clqueue->queue);
+            EasyCL::checkError(err);
+            stream->completedUpTo(seq - 1);
+            retireCompleted();
+            padding = 0; // ring is empty now, so head is back at 0
+        }
+        if(head + alignedBytes > capacity) {
+            usedBytes += padding;
+            head = 0;
+        }
+        size_t offset = head;
+        memcpy(&hostShadow[offset], data, numBytes);
+        cl_int err = clEnqueueWriteBuffer(stream->clqueue->queue, clmem, CL_FALSE, offset, numBytes,
+            &hostShadow[offset], 0, NULL, NULL);
+        EasyCL::checkError(err);
+        head += alignedBytes;
+        usedBytes += alignedBytes;
+        UploadRegion region;
+        region.seq = seq;
+        region.numBytes = padding + alignedBytes;
+        inFlight.push_back(region);
+        return offset;
+    }
+
+    void synchronizeStreams(Context *context) {
+        vector<CoclStream *> busyStreams;
+        {
+            ContextMutex contextMutex(context);
+            for(auto it = context->streams.begin(); it != context->streams.end(); it++) {
+                if((*it)->isBusy()) {
+                    busyStreams.push_back(*it);
+                }
+            }
+        }
+        for(auto it = busyStreams.begin(); it != busyStreams.end(); it++) {
+            (*it)->synchronize();
+        }
+    }
 }
 
 size_t cudaStreamSynchronize(char *_queue) {
@@ -66,7 +337,7 @@ size_t cudaStreamSynchronize(char *_queue) {
     if(queue == 0) {
         cl->finish();
     } else {
-        clFinish(queue->queue);
+        stream->synchronize();
     }
 
     return 0;
@@ -79,8 +350,7 @@ size_t cuStreamSynchronize(char *_queue) {
 size_t cuStreamCreate(char **_pstream, unsigned int flags) {
     CoclStream **pstream = (CoclStream**)_pstream;
     ThreadVars *v = getThreadVars();
-    EasyCL *cl = v->getContext()->getCl();
-    CoclStream *coclStream = new CoclStream(cl);
+    CoclStream *coclStream = new CoclStream(v->getContext());
     *pstream = coclStream;
     return 0;
 }
@@ -100,17 +370,34 @@ size_t cudaStreamDestroy(char *_queue) {
 }
 
 size_t cudaStreamQuery(char *_queue) {
-    return cuStreamSynchronize(_queue);
+    CoclStream *stream = (CoclStream *)_queue;
+    if(stream == 0) {
+        stream = getThreadVars()->getContext()->default_stream.get();
+    }
+    cl_int status = stream->query();
+    COCL_PRINT(cout << "cudaStreamQuery stream=" << stream << " status=" << status << endl);
+    if(status == CL_COMPLETE) {
+        return 0;
+    } else if(status > 0) {
+        return cudaErrorNotReady;
+    } else {
+        // some command on the stream was abnormally terminated
+        return cudaErrorLaunchFailure;
+    }
 }
 
 size_t cuStreamQuery(char *_queue) {
-    return cuStreamSynchronize(_queue);
+    return cudaStreamQuery(_queue);
 }
 
 size_t cudaStreamAddCallback(char *_queue, cudacallbacktype callback, void *userdata, int flags) {
     CoclStream *stream = (CoclStream *)_queue;
+    if(stream == 0) {
+        stream = getThreadVars()->getContext()->default_stream.get();
+    }
     CLQueue *queue = stream->clqueue;
     // we need to queue an event, and attach the callback to that;
+    StreamEnqueue streamEnqueue(stream);
     cl_int err;
     cl_event event;
     err= clEnqueueBarrierWithWaitList(queue->queue,
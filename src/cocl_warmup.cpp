@@ -0,0 +1,236 @@
+// Copyright Hugh Perkins 2016, 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_warmup.h"
+
+#include "cocl/cocl_diskcache.h"
+#include "cocl/cocl_filesystem.h"
+#include "cocl/cocl_context.h"
+#include "cocl/hostside_opencl_funcs.h"
+
+#include "EasyCL/EasyCL.h"
+
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace std;
+
+#undef COCL_PRINT
+#define COCL_PRINT(x)
+// #define COCL_PRINT(x) std::cout << "[WARMUP] " << x << std::endl;
+
+namespace cocl {
+
+std::string KernelVariant::str() const {
+    std::ostringstream oss;
+    oss << deviceKey << " " << (offsets_32bit ? 1 : 0) << " " << deviceIrKey << " " << kernelName
+        << " " << uniqueClmemCount << " " << numVmemSegmentClmems << " " << clmemIndexByClmemArgIndex.size();
+    for(auto it = clmemIndexByClmemArgIndex.begin(); it != clmemIndexByClmemArgIndex.end(); it++) {
+        oss << " " << *it;
+    }
+    return oss.str();
+}
+
+bool KernelVariant::fromString(std::string line, KernelVariant *variant) {
+    std::istringstream iss(line);
+    int offsets_32bit = 0;
+    size_t numClmemArgs = 0;
+    iss >> variant->deviceKey >> offsets_32bit >> variant->deviceIrKey >> variant->kernelName
+        >> variant->uniqueClmemCount >> variant->numVmemSegmentClmems >> numClmemArgs;
+    if(!iss) {
+        return false;
+    }
+    variant->offsets_32bit = offsets_32bit != 0;
+    variant->clmemIndexByClmemArgIndex.clear();
+    for(size_t i = 0; i < numClmemArgs; i++) {
+        int clmemIndex = 0;
+        if(!(iss >> clmemIndex) || clmemIndex < 0 || clmemIndex >= variant->uniqueClmemCount) {
+            return false;
+        }
+        variant->clmemIndexByClmemArgIndex.push_back(clmemIndex);
+    }
+    return true;
+}
+
+std::string getDeviceKey(cl_device_id deviceId) {
+    uint64_t hash = fnv1a(easycl::getDeviceInfoString(deviceId, CL_DEVICE_VENDOR));
+    hash = fnv1a(easycl::getDeviceInfoString(deviceId, CL_DEVICE_NAME), hash);
+    hash = fnv1a(easycl::getDeviceInfoString(deviceId, CL_DEVICE_VERSION), hash);
+    hash = fnv1a(easycl::getDeviceInfoString(deviceId, CL_DRIVER_VERSION), hash);
+    return hashToHex(hash);
+}
+
+LaunchManifest::LaunchManifest(DiskCache *diskCache, std::string key) :
+        diskCache(diskCache), key(key) {
+    lastSave = std::chrono::steady_clock::now();
+    std::string contents = "";
+    if(!diskCache->read(key, &contents)) {
+        return;
+    }
+    std::istringstream iss(contents);
+    std::string line;
+    while(getline(iss, line)) {
+        KernelVariant variant;
+        if(line == "" || !KernelVariant::fromString(line, &variant)) {
+            COCL_PRINT("ignoring bad manifest line [" << line << "]");
+            continue;
+        }
+        if(lines.insert(line).second) {
+            recordedVariants.push_back(variant);
+        }
+    }
+    COCL_PRINT("loaded " << recordedVariants.size() << " kernel variants from " << key);
+}
+
+LaunchManifest::~LaunchManifest() {
+    save();
+}
+
+std::vector<KernelVariant> LaunchManifest::getRecordedVariants() {
+    std::lock_guard< std::mutex > guard(mutex);
+    return recordedVariants;
+}
+
+void LaunchManifest::record(KernelVariant variant, const std::string &deviceIr) {
+    variant.deviceIrKey = "devir-" + hashToHex(fnv1a(deviceIr));
+    std::string line = variant.str();
+    std::lock_guard< std::mutex > guard(mutex);
+    if(savedDeviceIrKeys.find(variant.deviceIrKey) == savedDeviceIrKeys.end()) {
+        // an earlier run may have saved it already, but writing it again also marks it as
+        // recently used, so it outlives less useful entries
+        diskCache->write(variant.deviceIrKey, deviceIr);
+        savedDeviceIrKeys.insert(variant.deviceIrKey);
+    }
+    if(!lines.insert(line).second) {
+        return;
+    }
+    COCL_PRINT("recorded " << line);
+    dirty = true;
+    if(std::chrono::steady_clock::now() - lastSave > std::chrono::seconds(1)) {
+        saveLocked();
+    }
+}
+
+void LaunchManifest::save() {
+    std::lock_guard< std::mutex > guard(mutex);
+    saveLocked();
+}
+
+void LaunchManifest::saveLocked() {
+    if(!dirty) {
+        return;
+    }
+    std::ostringstream contents;
+    for(auto it = lines.begin(); it != lines.end(); it++) {
+        contents << *it << "\n";
+    }
+    diskCache->write(key, contents.str());
+    dirty = false;
+    lastSave = std::chrono::steady_clock::now();
+}
+
+static LaunchManifest *createLaunchManifest() {
+    DiskCache *diskCache = getDiskCache();
+    if(diskCache == 0) {
+        return 0;
+    }
+    // one manifest per executable
+    std::string exePath = getExecutablePath();
+    if(exePath == "" && getenv("_") != 0) {
+        exePath = getenv("_");
+    }
+    return new LaunchManifest(diskCache, "manifest-" + hashToHex(fnv1a(exePath)));
+}
+
+LaunchManifest *getLaunchManifest() {
+    static std::unique_ptr<LaunchManifest> launchManifest(createLaunchManifest());
+    return launchManifest.get();
+}
+
+KernelWarmup::KernelWarmup(Context *context, std::vector<KernelVariant> variants, int numThreads) :
+        context(context), variants(variants) {
+    COCL_PRINT("warming up " << variants.size() << " kernels on " << numThreads << " threads");
+    for(int i = 0; i < numThreads && i < (int)variants.size(); i++) {
+        threads.push_back(std::thread(&KernelWarmup::threadMain, this));
+    }
+}
+
+KernelWarmup::~KernelWarmup() {
+    {
+        std::lock_guard< std::mutex > guard(mutex);
+        stopping = true;
+    }
+    for(auto it = threads.begin(); it != threads.end(); it++) {
+        it->join();
+    }
+}
+
+void KernelWarmup::threadMain() {
+    DiskCache *diskCache = getDiskCache();
+    while(true) {
+        KernelVariant variant;
+        {
+            std::lock_guard< std::mutex > guard(mutex);
+            if(stopping || nextVariant >= variants.size()) {
+                return;
+            }
+            variant = variants[nextVariant];
+            nextVariant++;
+        }
+        std::string deviceIr = "";
+        if(!diskCache->read(variant.deviceIrKey, &deviceIr)) {
+            continue;
+        }
+        try {
+            warmUpKernel(context, variant, deviceIr);
+            COCL_PRINT("warmed up " << variant.kernelName);
+        } catch(std::runtime_error &e) {
+            // the launch will try again, and report whatever went wrong
+            COCL_PRINT("failed to warm up " << variant.kernelName << ": " << e.what());
+        }
+    }
+}
+
+KernelWarmup *createKernelWarmup(Context *context, bool offsets_32bit) {
+    int numThreads = 2;
+    if(getenv("COCL_WARMUP_THREADS") != 0) {
+        numThreads = atoi(getenv("COCL_WARMUP_THREADS"));
+    }
+    if(numThreads <= 0 || getenv("COCL_LOAD_CL") != 0 || getenv("COCL_DUMP_CL") != 0) {
+        // COCL_LOAD_CL and COCL_DUMP_CL number their files in build order, so need the launches
+        // to build everything
+        return 0;
+    }
+    LaunchManifest *launchManifest = getLaunchManifest();
+    if(launchManifest == 0) {
+        return 0;
+    }
+    std::string deviceKey = getDeviceKey(getCoclDeviceByGpuOrdinal(context->gpuOrdinal)->deviceId);
+    std::vector<KernelVariant> recordedVariants = launchManifest->getRecordedVariants();
+    std::vector<KernelVariant> variants;
+    for(auto it = recordedVariants.begin(); it != recordedVariants.end(); it++) {
+        if(it->deviceKey == deviceKey && it->offsets_32bit == offsets_32bit) {
+            variants.push_back(*it);
+        }
+    }
+    if(variants.size() == 0) {
+        return 0;
+    }
+    return new KernelWarmup(context, variants, numThreads);
+}
+
+} // namespace cocl
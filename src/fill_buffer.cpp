@@ -20,68 +20,255 @@
 
 #include <iostream>
 #include <string>
+#include <sstream>
+#include <mutex>
+#include <map>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+
+#undef COCL_PRINT
+#define COCL_PRINT(x)
+// #define COCL_PRINT(x) std::cout << "[FILL] " << x << std::endl;
 
 namespace cocl {
 
-static std::string get_enqueueFillBuffer_sourcecode();
-
-inline int getNumThreads() {
-  // int blockSize = 1024;
-  // int maxWorkgroupSize = ((easycl::DeviceInfo *)state->deviceInfoByDevice[state->currentDevice])->maxWorkGroupSize;
-  // if( blockSize > maxWorkgroupSize ) {
-  //   blockSize = maxWorkgroupSize;
-  // }
-  // return blockSize;
-    return 256; // just hardcode to 256 for now, which covers amd, intel, nvidia, just not always most efficiently, but
-                // kind of ok
+static std::string get_enqueueFillBuffer_sourcecode(int vectorWidth);
+static std::string get_enqueueFillBytes_sourcecode();
+static std::string get_enqueueFill2D_sourcecode();
+
+// how to launch fills on one device. Worked out the first time we fill on it
+class FillTuning {
+public:
+    int vectorWidth = 4; // uints per store: 1, 4 or 8
+    int workgroupSize = 256;
+    int maxWorkgroups = 0; // grid stride beyond this many, so huge fills dont launch millions of groups
+    bool useNative = false; // clEnqueueFillBuffer, rather than our own kernel
+};
+
+static std::mutex fillTuningMutex;
+static std::map<cl_device_id, FillTuning> fillTuningByDevice;
+
+static const FillTuning &getFillTuning(cl_command_queue queue) {
+    cl_device_id deviceId;
+    cl_int err = clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &deviceId, 0);
+    easycl::EasyCL::checkError(err);
+
+    std::lock_guard< std::mutex > guard(fillTuningMutex);
+    auto it = fillTuningByDevice.find(deviceId);
+    if(it != fillTuningByDevice.end()) {
+        return it->second;
+    }
+    FillTuning tuning;
+    // 256 covers amd, intel, nvidia, just not always most efficiently, but kind of ok. Some cpu
+    // devices allow less, though
+    tuning.workgroupSize = std::min(256, easycl::getDeviceInfoInt(deviceId, CL_DEVICE_MAX_WORK_GROUP_SIZE));
+    // enough groups to keep every compute unit busy, each thread looping over the rest
+    tuning.maxWorkgroups = easycl::getDeviceInfoInt(deviceId, CL_DEVICE_MAX_COMPUTE_UNITS) * 8;
+    if(getenv("COCL_FILL_VECTOR_WIDTH") != 0) {
+        tuning.vectorWidth = atoi(getenv("COCL_FILL_VECTOR_WIDTH"));
+        if(tuning.vectorWidth != 1 && tuning.vectorWidth != 4 && tuning.vectorWidth != 8) {
+            std::cout << "COCL_FILL_VECTOR_WIDTH should be 1, 4 or 8, not " << tuning.vectorWidth << std::endl;
+            throw std::runtime_error("COCL_FILL_VECTOR_WIDTH should be 1, 4 or 8");
+        }
+    }
+    if(getenv("COCL_FILL_NATIVE") != 0) {
+        tuning.useNative = std::string(getenv("COCL_FILL_NATIVE")) == "1";
+    }
+    COCL_PRINT("fill tuning vectorWidth=" << tuning.vectorWidth << " workgroupSize=" << tuning.workgroupSize
+        << " maxWorkgroups=" << tuning.maxWorkgroups << " useNative=" << tuning.useNative);
+    fillTuningByDevice[deviceId] = tuning;
+    return fillTuningByDevice[deviceId];
 }
 
-// CL: number of blocks for threads.
-inline int GET_BLOCKS(const int N) {
-  return (N + getNumThreads() - 1) / getNumThreads();
+// number of workgroups, for numItems work items, grid striding past maxWorkgroups
+static size_t getNumWorkgroups(const FillTuning &tuning, size_t numItems) {
+    size_t numWorkgroups = (numItems + tuning.workgroupSize - 1) / tuning.workgroupSize;
+    numWorkgroups = std::min(numWorkgroups, (size_t)std::max(1, tuning.maxWorkgroups));
+    return std::max(numWorkgroups, (size_t)1);
 }
 
 int myEnqueueFillBuffer(
     cl_command_queue queue,
     cl_mem clmem,
     unsigned int value,
-    int offsetBytes, int countInts) {
+    size_t offsetBytes, size_t countInts) {
 
-    easycl::CLKernel *kernel = compileOpenCLKernel("enqueueFillBuffer", get_enqueueFillBuffer_sourcecode());
+    if(offsetBytes % 4 != 0) {
+        std::cout << "myEnqueueFillBuffer offsetBytes " << offsetBytes << " should be a multiple of 4" << std::endl;
+        throw std::runtime_error("myEnqueueFillBuffer offsetBytes should be a multiple of 4");
+    }
+    const FillTuning &tuning = getFillTuning(queue);
+    if(tuning.useNative) {
+        cl_int err = clEnqueueFillBuffer(queue, clmem, &value, sizeof(value), offsetBytes, countInts * sizeof(value), 0, 0, 0);
+        easycl::EasyCL::checkError(err);
+        return 0;
+    }
 
-    kernel->inout(&clmem);
-    kernel->in((int32_t)(offsetBytes >> 2));
+    std::ostringstream uniqueName;
+    uniqueName << "enqueueFillBuffer_v" << tuning.vectorWidth;
+    easycl::CLKernel *kernel = compileOpenCLKernel(
+        "enqueueFillBuffer", uniqueName.str(), "enqueueFillBuffer", get_enqueueFillBuffer_sourcecode(tuning.vectorWidth));
+    std::lock_guard< std::mutex > guard(*getKernelLaunchMutex(uniqueName.str()));
 
-    kernel->in((int32_t)countInts);
+    kernel->inout(&clmem);
+    kernel->in((int64_t)(offsetBytes >> 2));
+    kernel->in((int64_t)countInts);
     kernel->in(value);
 
-    int workgroupSize = getNumThreads();
-    int globalSize = GET_BLOCKS(countInts) * workgroupSize;
-    kernel->run_1d(&queue, globalSize, workgroupSize);
+    size_t numWorkgroups = getNumWorkgroups(tuning, (countInts + tuning.vectorWidth - 1) / tuning.vectorWidth);
+    kernel->run_1d(&queue, (int)(numWorkgroups * tuning.workgroupSize), tuning.workgroupSize);
+    return 0;
+}
+
+// for the unaligned head and tail of a memset, at most 3 bytes each
+static void enqueueFillBytes(
+    cl_command_queue queue,
+    cl_mem clmem,
+    unsigned char value,
+    size_t offsetBytes, size_t countBytes) {
+
+    easycl::CLKernel *kernel = compileOpenCLKernel("enqueueFillBytes", get_enqueueFillBytes_sourcecode());
+    std::lock_guard< std::mutex > guard(*getKernelLaunchMutex("enqueueFillBytes"));
+
+    kernel->inout(&clmem);
+    kernel->in((int64_t)offsetBytes);
+    kernel->in((int32_t)countBytes);
+    kernel->in((int32_t)value);
+
+    // the body fills the rest, so these are tiny; one workgroup does
+    int workgroupSize = 4;
+    kernel->run_1d(&queue, workgroupSize, workgroupSize);
+}
+
+int myEnqueueMemset(
+    cl_command_queue queue,
+    cl_mem clmem,
+    unsigned char value,
+    size_t offsetBytes, size_t countBytes) {
+
+    // bytes up to the first 4-byte boundary, then whole uints, then whatever is left
+    size_t headBytes = (4 - (offsetBytes & 3)) & 3;
+    if(headBytes > countBytes) {
+        headBytes = countBytes;
+    }
+    size_t bodyInts = (countBytes - headBytes) >> 2;
+    size_t tailBytes = countBytes - headBytes - (bodyInts << 2);
+    if(headBytes > 0) {
+        enqueueFillBytes(queue, clmem, value, offsetBytes, headBytes);
+    }
+    if(bodyInts > 0) {
+        unsigned int fourbytes = value;
+        fourbytes |= fourbytes << 8;
+        fourbytes |= fourbytes << 16;
+        myEnqueueFillBuffer(queue, clmem, fourbytes, offsetBytes + headBytes, bodyInts);
+    }
+    if(tailBytes > 0) {
+        enqueueFillBytes(queue, clmem, value, offsetBytes + headBytes + (bodyInts << 2), tailBytes);
+    }
+    return 0;
+}
+
+int myEnqueueMemset2D(
+    cl_command_queue queue,
+    cl_mem clmem,
+    unsigned char value,
+    size_t offsetBytes, size_t pitch, size_t width, size_t height) {
+
+    if(pitch == width) {
+        // rows are back to back, so its just one long fill
+        return myEnqueueMemset(queue, clmem, value, offsetBytes, width * height);
+    }
+    const FillTuning &tuning = getFillTuning(queue);
+    easycl::CLKernel *kernel = compileOpenCLKernel("enqueueFill2D", get_enqueueFill2D_sourcecode());
+    std::lock_guard< std::mutex > guard(*getKernelLaunchMutex("enqueueFill2D"));
+
+    kernel->inout(&clmem);
+    kernel->in((int64_t)offsetBytes);
+    kernel->in((int64_t)pitch);
+    kernel->in((int64_t)width);
+    kernel->in((int64_t)height);
+    kernel->in((int32_t)value);
+
+    size_t numWorkgroups = getNumWorkgroups(tuning, width * height);
+    kernel->run_1d(&queue, (int)(numWorkgroups * tuning.workgroupSize), tuning.workgroupSize);
     return 0;
 }
 
 // this shouldnt be necessary, since clEnqueueFillBuffer should do this, but
 // clEnqueueFillBuffer fails for me on Radeon Pro 450, eg see
 // http://stackoverflow.com/questions/38556710/clenqueuefillbuffer-fills-a-buffer-correctly-only-at-random/43727913#43727913
-std::string get_enqueueFillBuffer_sourcecode() {
-    return R"(
+//
+// Stores VEC_WIDTH uints at a time. target_offset needn't be a multiple of VEC_WIDTH, so the
+// uints before the first aligned vector, and after the last whole one, are stored singly
+std::string get_enqueueFillBuffer_sourcecode(int vectorWidth) {
+    std::ostringstream defines;
+    defines << "#define VEC_WIDTH " << vectorWidth << "\n";
+    if(vectorWidth == 1) {
+        defines << "#define VEC_TYPE uint\n";
+    } else {
+        defines << "#define VEC_TYPE uint" << vectorWidth << "\n";
+    }
+    return defines.str() + R"(
 // CL: grid stride looping
 #define CL_KERNEL_LOOP(i, n)                        \
-  for (int i = get_group_id(0) * get_local_size(0) + get_local_id(0); \
+  for (long i = get_global_id(0); \
       i < (n);                                       \
-      i += get_local_size(0) * get_num_groups(0))
+      i += get_global_size(0))
 
 kernel void enqueueFillBuffer(
-        global unsigned int *target_data, const int target_offset,
-        const int N,
+        global unsigned int *target_data, const long target_offset,
+        const long N,
         unsigned int value) {
     global unsigned int *target = target_data + target_offset;
-  CL_KERNEL_LOOP(n, N) {
-    if(n < N) {
-        target[n] = value;
+    long head = (VEC_WIDTH - target_offset % VEC_WIDTH) % VEC_WIDTH;
+    if(head > N) {
+        head = N;
     }
+    long numVectors = (N - head) / VEC_WIDTH;
+    long tailStart = head + numVectors * VEC_WIDTH;
+    global VEC_TYPE *vectors = (global VEC_TYPE *)(target + head);
+    VEC_TYPE vectorValue = (VEC_TYPE)(value);
+  CL_KERNEL_LOOP(n, numVectors) {
+    vectors[n] = vectorValue;
+  }
+  CL_KERNEL_LOOP(n, head) {
+    target[n] = value;
   }
+  CL_KERNEL_LOOP(n, N - tailStart) {
+    target[tailStart + n] = value;
+  }
+}
+)";
+}
+
+std::string get_enqueueFillBytes_sourcecode() {
+    return R"(
+kernel void enqueueFillBytes(
+        global unsigned char *target_data, const long target_offset,
+        const int N,
+        const int value) {
+    int n = get_global_id(0);
+    if(n < N) {
+        target_data[target_offset + n] = (unsigned char)value;
+    }
+}
+)";
+}
+
+// one work item per byte of the rectangle, for cudaMemset2D, when the rows have gaps between them
+std::string get_enqueueFill2D_sourcecode() {
+    return R"(
+kernel void enqueueFill2D(
+        global unsigned char *target_data, const long target_offset,
+        const long pitch, const long width, const long height,
+        const int value) {
+    global unsigned char *target = target_data + target_offset;
+    for(long i = get_global_id(0); i < width * height; i += get_global_size(0)) {
+        long row = i / width;
+        long col = i - row * width;
+        target[row * pitch + col] = (unsigned char)value;
+    }
 }
 )";
 }
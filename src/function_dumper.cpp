@@ -192,6 +192,25 @@ std::string FunctionDumper::dumpSharedDefinitions(std::string indent) {
     return oss.str();
 }
 
+std::string FunctionDumper::dumpGlobalVarsSegmentTable() {
+    // initializers for GlobalVars.clmems and GlobalVars.clmem_vmem_offsets, ie the
+    // segment table that getGlobalPointer uses to resolve vmem locations
+    if(kernelNumUniqueClmems == 0) {
+        return "{ 0 }, { 0 }";
+    }
+    ostringstream clmems;
+    ostringstream offsets;
+    for(int clmemIdx = 0; clmemIdx < kernelNumUniqueClmems; clmemIdx++) {
+        if(clmemIdx > 0) {
+            clmems << ", ";
+            offsets << ", ";
+        }
+        clmems << "clmem" << clmemIdx;
+        offsets << "clmem_vmem_offset" << clmemIdx;
+    }
+    return "{ " + clmems.str() + " }, { " + offsets.str() + " }";
+}
+
 std::string FunctionDumper::dumpKernelFunctionDeclarationWithoutReturn(llvm::Function *F) {
     std::ostringstream declaration;
     shimCode = "";
@@ -300,10 +319,20 @@ std::string FunctionDumper::dumpKernelFunctionDeclarationWithoutReturn(llvm::Fun
         }
         i++;
     }
-    if(i > 0) {
-        declaration << ", ";
+    if(_scratchArg) {
+        if(i > 0) {
+            declaration << ", ";
+        }
+        declaration << "local int *scratch";
+        i++;
+    }
+    if(_dynamicSharedArg) {
+        if(i > 0) {
+            declaration << ", ";
+        }
+        declaration << "local char *dynamicShared";
+        i++;
     }
-    declaration << "local int *scratch";
     declaration << ")";
     return declaration.str();
 }
@@ -501,11 +530,13 @@ void FunctionDumper::toCl(ostream &os) {
         os << shimCode << "\n";
     }
     if(isKernel) {
-    os << R"(    const struct GlobalVars globalVars = { scratch, clmem0, clmem_vmem_offset0 };
-    const struct GlobalVars* const pGlobalVars = &globalVars;
+        os << "    const struct GlobalVars globalVars = { " << (_scratchArg ? "scratch" : "0") << ", "
+            << (_dynamicSharedArg ? "dynamicShared" : "0") << ", "
+            << dumpGlobalVarsSegmentTable() << " };\n";
+        os << R"(    const struct GlobalVars* const pGlobalVars = &globalVars;
 
 )";
-}
+    }
 
     writeDeclarations("    ", os);
     os << "\n";
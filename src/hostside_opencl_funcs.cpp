@@ -18,6 +18,9 @@
 #include "cocl/cocl_clsources.h"
 #include "cocl/cocl_streams.h"
 #include "cocl/cocl_funcs.h"
+#include "cocl/cocl_diskcache.h"
+#include "cocl/cocl_device.h"
+#include "cocl/cocl_warmup.h"
 
 #include <iostream>
 #include <memory>
@@ -25,7 +28,10 @@
 #include <map>
 #include <set>
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
 #include <mutex>
+#include <atomic>
 
 #include "EasyCL/EasyCL.h"
 #include "EasyCL/util/easycl_stringhelper.h"
@@ -62,24 +68,12 @@ void hostside_opencl_funcs_assure_initialized(void) {
 
 }
 
-namespace cocl {
-    // this lock works as follows:
-    // - configureKernel takes out a lock, and does not release it. This first level of locking will remain locked, until
-    //   the kernelGo funcgtion is called, and completed
-    // - then, each setArg etc method takes out an additional level of locking, in case they are called in parallel
-    //   (this second level might not be stricly necessary, I'm not sure...)
-    //   this second level is per-call, released at hte end
-    // - finally, kernelGo is called, takes out a second-level lock, then at the end releases both levels
-    //
-    // I suppose we could do this with two standard locks, rather than one recursive one. Might be easier to udnerstand/read
-    // in fact
-    std::recursive_mutex launchMutex;
-}
-
 using namespace cocl;
 
-static LaunchConfiguration launchConfiguration;
-static DebugDumper debugDumper(&launchConfiguration);
+// each host thread builds up its own launch, from cudaConfigureCall through to kernelGo, so
+// threads only contend on the kernel caches, and on the kernel object itself, at enqueue time
+static thread_local LaunchConfiguration launchConfiguration;
+static thread_local DebugDumper debugDumper(&launchConfiguration);
 
 std::unique_ptr< ArgStore_base > g_arg;
 
@@ -90,18 +84,22 @@ size_t cuInit(unsigned int flags) {
 int cudaConfigureCall(
         dim3 grid,
         dim3 block, long long sharedMem, char *queue_as_voidstar) {
-    // pthread_mutex_lock(&launchMutex);
-    // std::lock_guard< std::recursive_mutex > guard(launchMutex);
-    launchMutex.lock();
     CoclStream *coclStream = (CoclStream *)queue_as_voidstar;
     ThreadVars *v = getThreadVars();
     if(coclStream == 0) {
         coclStream = v->currentContext->default_stream.get();
     }
     CLQueue *clqueue = coclStream->clqueue;
-    if(sharedMem != 0) {
-        COCL_PRINT("cudaConfigureCall: Not implemented: non-zero shared memory");
-        throw runtime_error("cudaConfigureCall: Not implemented: non-zero shared memory");
+    // the patched call site ignores our return value, so throw, rather than launching with
+    // whatever the previous launch left in launchConfiguration
+    if(sharedMem < 0) {
+        cout << "cudaConfigureCall: sharedMem " << sharedMem << " is negative" << endl;
+        throw runtime_error("cudaConfigureCall: sharedMem is negative");
+    }
+    if((size_t)sharedMem > coclStream->context->localMemBytes) {
+        cout << "cudaConfigureCall: sharedMem " << sharedMem << " bytes is more than the device's local memory, "
+            << coclStream->context->localMemBytes << " bytes" << endl;
+        throw runtime_error("cudaConfigureCall: sharedMem is more than the device's local memory");
     }
     int grid_x = grid.x;
     int grid_y = grid.y;
@@ -120,72 +118,234 @@ int cudaConfigureCall(
     launchConfiguration.block[0] = block_x;
     launchConfiguration.block[1] = block_y;
     launchConfiguration.block[2] = block_z;
+    launchConfiguration.sharedMem = sharedMem;
     return 0;
 }
 
-namespace cocl {
+// newer clang emits <<<...>>> as __cudaPushCallConfiguration, then a call to the kernel's stub,
+// which pops the configuration straight back off, and passes it to cudaLaunchKernel. Launches
+// can nest, eg a kernel launched whilst evaluating the args of another, hence the stack
+class CallConfiguration {
+public:
+    dim3 grid;
+    dim3 block;
+    size_t sharedMem;
+    void *stream;
+};
+static thread_local std::vector<CallConfiguration> callConfigurationStack;
+
+int __cudaPushCallConfiguration(dim3 grid, dim3 block, size_t sharedMem, void *stream) {
+    COCL_PRINT("__cudaPushCallConfiguration(grid=" << grid << ",block=" << block << ",sharedMem=" << sharedMem << ")");
+    CallConfiguration callConfiguration;
+    callConfiguration.grid = grid;
+    callConfiguration.block = block;
+    callConfiguration.sharedMem = sharedMem;
+    callConfiguration.stream = stream;
+    callConfigurationStack.push_back(callConfiguration);
+    return cudaSuccess;
+}
 
-std::string Int32Arg::str() {
-    ostringstream oss;
-    oss << "Int32Arg=" << v;
-    return oss.str();
+int __cudaPopCallConfiguration(dim3 *grid, dim3 *block, size_t *sharedMem, void **stream) {
+    if(callConfigurationStack.empty()) {
+        return cudaErrorInvalidConfiguration;
+    }
+    const CallConfiguration &callConfiguration = callConfigurationStack.back();
+    *grid = callConfiguration.grid;
+    *block = callConfiguration.block;
+    *sharedMem = callConfiguration.sharedMem;
+    *stream = callConfiguration.stream;
+    callConfigurationStack.pop_back();
+    return cudaSuccess;
+}
+
+size_t cudaLaunchKernel(const void *func, dim3 grid, dim3 block, void **args, size_t sharedMem, char *stream) {
+    // patch_hostside replaces every call to this with the launch itself, since only it knows the
+    // kernel's device IR, and the types of the args
+    cout << "cudaLaunchKernel: this call was not rewritten by patch_hostside. Please check the host IR went through patch_hostside" << endl;
+    throw runtime_error("cudaLaunchKernel: call not rewritten by patch_hostside");
 }
 
-std::string Int64Arg::str() {
+namespace cocl {
+
+std::string KernelArg::str() const {
     ostringstream oss;
-    oss << "Int64Arg=" << v;
+    switch(kind) {
+        case AK_Int8Arg: oss << "Int8Arg"; break;
+        case AK_Int32Arg: oss << "Int32Arg=" << v.int32; break;
+        case AK_UInt32Arg: oss << "UInt32Arg=" << v.uint32; break;
+        case AK_Int64Arg: oss << "Int64Arg=" << v.int64; break;
+        case AK_FloatArg: oss << "FloatArg"; break;
+        case AK_NullPtrArg: oss << "NullPtrArg"; break;
+    }
     return oss.str();
 }
 
 int32_t getNumCachedKernels() {
-    return getThreadVars()->getContext()->kernelCache.size();
+    Context *context = getThreadVars()->getContext();
+    return context->numCachedKernels;
 }
 
 int32_t getNumKernelCalls() {
-    return getThreadVars()->getContext()->numKernelCalls;
+    Context *context = getThreadVars()->getContext();
+    return context->numKernelCalls;
 }
 
-CLKernel *compileOpenCLKernel(string originalKernelName, string clSourcecode) {
-    return compileOpenCLKernel(originalKernelName, originalKernelName, originalKernelName, clSourcecode);
+int64_t getNumKernelArgsSet() {
+    Context *context = getThreadVars()->getContext();
+    return context->numKernelArgsSet;
 }
 
-CLKernel *compileOpenCLKernel(string originalKernelName, string uniqueKernelName, string shortKernelName, string clSourcecode) {
-    // returns already-built kernel if available, based on the name
-    // otherwise builds passed-in clsourcecode, caches that, and returns resulting kernel
-    // (opencl generation has already happened prior to this function)
+int64_t getNumKernelArgsSkipped() {
+    Context *context = getThreadVars()->getContext();
+    return context->numKernelArgsSkipped;
+}
 
-    ThreadVars *v = getThreadVars();
-    EasyCL *cl = v->getContext()->getCl();
-    ofstream f;
-    v->getContext()->numKernelCalls++;
-    if(v->getContext()->kernelCache.find(uniqueKernelName) != v->getContext()->kernelCache.end()) {
-        return v->getContext()->kernelCache[uniqueKernelName];
-    }
-    // compile the kernel.  we are still locking the mutex, but I cnat think of a better
-    // way right now...
-
-    string filename = "/tmp/" + easycl::toString(v->getContext()->kernelCache.size()) + ".cl";
-    if(getenv("COCL_LOAD_CL") != 0) {
-        cout << "loading cl sourcecode from " << filename << endl;
-        ifstream f;
-        f.open(filename, ios_base::in);
-        clSourcecode = "";
-        string line = "";
-        while(getline(f, line)) {
-            clSourcecode += line + "\n";
+int64_t getNumCrossStreamWaits() {
+    Context *context = getThreadVars()->getContext();
+    return context->numCrossStreamWaits;
+}
+
+KernelEntry *getKernelEntry(Context *context, const std::string &uniqueKernelName) {
+    // entries live as long as their context, so each thread remembers the ones it has already
+    // looked up, and launching an already-built kernel takes no lock shared with other threads.
+    // Keyed on context id, not address, since a new context might reuse a dead one's address.
+    // Whenever a context has been destroyed since we last looked, drop the dead ones, so a
+    // long-lived thread that works through many contexts doesnt hang on to them all
+    static thread_local std::map<long long, std::map<std::string, KernelEntry *> > entriesByContextId;
+    static thread_local long long numContextsDestroyedSeen = 0;
+    long long numContextsDestroyed = getNumContextsDestroyed();
+    if(numContextsDestroyed != numContextsDestroyedSeen) {
+        numContextsDestroyedSeen = numContextsDestroyed;
+        for(auto it = entriesByContextId.begin(); it != entriesByContextId.end();) {
+            if(it->first != context->id && !isContextAlive(it->first)) {
+                it = entriesByContextId.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+    std::map<std::string, KernelEntry *> &entries = entriesByContextId[context->id];
+    auto it = entries.find(uniqueKernelName);
+    if(it != entries.end()) {
+        return it->second;
+    }
+    KernelEntry *entry = 0;
+    {
+        std::lock_guard< std::mutex > guard(context->kernelCacheMutex);
+        std::unique_ptr<KernelEntry> &slot = context->kernelEntries[uniqueKernelName];
+        if(!slot) {
+            slot.reset(new KernelEntry());
+            slot->uniqueKernelName = uniqueKernelName;
+        }
+        entry = slot.get();
+    }
+    entries[uniqueKernelName] = entry;
+    return entry;
+}
+
+std::mutex *getKernelLaunchMutex(std::string uniqueKernelName) {
+    return &getKernelEntry(getThreadVars()->getContext(), uniqueKernelName)->launchMutex;
+}
+
+static string getProgramBuildLog(cl_program program, cl_device_id deviceId) {
+    size_t logSize = 0;
+    cl_int err = clGetProgramBuildInfo(program, deviceId, CL_PROGRAM_BUILD_LOG, 0, 0, &logSize);
+    if(err != CL_SUCCESS || logSize <= 1) {
+        return "";
+    }
+    string buildLog(logSize, '\0');
+    err = clGetProgramBuildInfo(program, deviceId, CL_PROGRAM_BUILD_LOG, logSize, &buildLog[0], 0);
+    if(err != CL_SUCCESS) {
+        return "";
+    }
+    buildLog.resize(logSize - 1); // drop the terminating 0
+    return buildLog;
+}
+
+static CLKernel *buildKernelWithDiskCache(DiskCache *diskCache, EasyCL *cl, cl_device_id deviceId, string shortKernelName, string clSourcecode) {
+    // if the disk cache has a program binary for this source, on this device and driver, load that,
+    // so the driver doesnt have to compile anything. Otherwise build from source, and save
+    // the resulting binary, for next time
+    string options = "";
+    uint64_t hash = fnv1a(easycl::getDeviceInfoString(deviceId, CL_DEVICE_VENDOR));
+    hash = fnv1a(easycl::getDeviceInfoString(deviceId, CL_DEVICE_NAME), hash);
+    hash = fnv1a(easycl::getDeviceInfoString(deviceId, CL_DEVICE_VERSION), hash);
+    hash = fnv1a(easycl::getDeviceInfoString(deviceId, CL_DRIVER_VERSION), hash);
+    hash = fnv1a(options, hash);
+    hash = fnv1a(shortKernelName, hash);
+    hash = fnv1a(clSourcecode, hash);
+    string key = "clbin-" + hashToHex(hash);
+
+    cl_context clContext = *cl->context;
+    cl_int err;
+    cl_program program = 0;
+    string binary = "";
+    if(diskCache->read(key, &binary)) {
+        const unsigned char *binaryPtr = (const unsigned char *)binary.data();
+        size_t binarySize = binary.size();
+        cl_int binaryStatus = CL_SUCCESS;
+        program = clCreateProgramWithBinary(clContext, 1, &deviceId, &binarySize, &binaryPtr, &binaryStatus, &err);
+        if(err == CL_SUCCESS && binaryStatus == CL_SUCCESS) {
+            err = clBuildProgram(program, 1, &deviceId, options.c_str(), 0, 0);
+        }
+        if(err != CL_SUCCESS || binaryStatus != CL_SUCCESS) {
+            // eg the driver changed without changing its version string. just rebuild from source
+            COCL_PRINT("compileOpenCLKernel: cached binary " << key << " rejected by driver, rebuilding");
+            if(program != 0) {
+                clReleaseProgram(program);
+            }
+            program = 0;
+        } else {
+            COCL_PRINT("compileOpenCLKernel: loaded binary " << key << " from disk cache");
+        }
+    }
+    string buildLog = "";
+    if(program == 0) {
+        const char *source = clSourcecode.c_str();
+        size_t sourceSize = clSourcecode.size();
+        program = clCreateProgramWithSource(clContext, 1, &source, &sourceSize, &err);
+        EasyCL::checkError(err);
+        cl_int buildErr = clBuildProgram(program, 1, &deviceId, options.c_str(), 0, 0);
+        buildLog = getProgramBuildLog(program, deviceId);
+        if(buildErr != CL_SUCCESS) {
+            clReleaseProgram(program);
+            throw runtime_error("Failed to build opencl program, error " + easycl::toString(buildErr) + ":\n" + buildLog);
+        }
+        size_t binarySize = 0;
+        err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binarySize, 0);
+        if(err == CL_SUCCESS && binarySize > 0) {
+            binary.resize(binarySize);
+            unsigned char *binaryPtr = (unsigned char *)&binary[0];
+            err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char *), &binaryPtr, 0);
+            if(err == CL_SUCCESS) {
+                diskCache->write(key, binary);
+            }
         }
-        f.close();
-    } else if(getenv("COCL_DUMP_CL") != 0) {
-        cout << "saving cl sourcecode to " << filename << endl;
-        ofstream f;
-        f.open(filename, ios_base::out);
-        f << clSourcecode << endl;
-        f.close();
     }
+    cl_kernel clKernel = clCreateKernel(program, shortKernelName.c_str(), &err);
+    if(err != CL_SUCCESS) {
+        clReleaseProgram(program);
+        EasyCL::checkError(err);
+    }
+    // the CLKernel owns program and clKernel from here on
+    CLKernel *kernel = new CLKernel(cl, "__internal__", shortKernelName, clSourcecode, program, clKernel);
+    kernel->buildLog = buildLog;
+    return kernel;
+}
 
+static CLKernel *buildOpenCLKernel(Context *context, string uniqueKernelName, string shortKernelName, const string &clSourcecode) {
+    // builds clSourcecode, from the disk cache if possible. Doesnt touch the kernel caches, so
+    // no need to hold kernelCacheMutex
+    EasyCL *cl = context->getCl();
     CLKernel *kernel = 0;
     try {
-        kernel = cl->buildKernelFromString(clSourcecode, shortKernelName, "", "__internal__", true);
+        DiskCache *diskCache = getDiskCache();
+        if(diskCache != 0) {
+            cl_device_id deviceId = getCoclDeviceByGpuOrdinal(context->gpuOrdinal)->deviceId;
+            kernel = buildKernelWithDiskCache(diskCache, cl, deviceId, shortKernelName, clSourcecode);
+        } else {
+            kernel = cl->buildKernelFromString(clSourcecode, shortKernelName, "", "__internal__", true);
+        }
         if(getenv("COCL_DUMP_BUILD_LOGS") != 0) {
             if(kernel->buildLog != "") {
                 std::cout << kernel->buildLog << std::endl;
@@ -198,41 +358,183 @@ CLKernel *compileOpenCLKernel(string originalKernelName, string uniqueKernelName
         cout << "writing ll to /tmp/failed-kernel.ll" << endl;
 
         cout << "writing cl to /tmp/failed-kernel.cl" << endl;
+        ofstream f;
         f.open("/tmp/failed-kernel.cl", ios_base::out);
         f << clSourcecode << endl;
         f.close();
 
         throw e;
     }
-    v->getContext()->kernelCache[uniqueKernelName] = kernel;
-    cl->storeKernel(uniqueKernelName, kernel, true);  // this will cause the kernel to be deleted with cl.  Not clean yet, but a start
     return kernel;
 }
 
-GenerateOpenCLResult generateOpenCL(
-        int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, string origKernelName, string devicellsourcecode) {
-    // generates OpenCL source-code, based on passed-in bytecode
-    // returns cached source-code if available
+static CLKernel *compileKernelEntry(
+        Context *context, KernelEntry *entry, string uniqueKernelName, string shortKernelName, const string &clSourcecodeIn) {
+    // returns entry's kernel, building it from clSourcecodeIn if no one has yet. If another
+    // thread is building it right now, waits for that, rather than building it again
+    CLKernel *kernel = entry->kernel;
+    if(kernel != 0) {
+        return kernel;
+    }
+    std::unique_lock< std::mutex > lock(entry->mutex);
+    while(entry->compiling) {
+        entry->buildCv.wait(lock);
+    }
+    kernel = entry->kernel;
+    if(kernel != 0) {
+        return kernel;
+    }
+    entry->compiling = true;
+    lock.unlock();
 
-    ThreadVars *v = getThreadVars();
+    string clSourcecode = clSourcecodeIn;
+    try {
+        string filename = "/tmp/" + easycl::toString(context->numCachedKernels.load()) + ".cl";
+        if(getenv("COCL_LOAD_CL") != 0) {
+            cout << "loading cl sourcecode from " << filename << endl;
+            ifstream f;
+            f.open(filename, ios_base::in);
+            clSourcecode = "";
+            string line = "";
+            while(getline(f, line)) {
+                clSourcecode += line + "\n";
+            }
+            f.close();
+        } else if(getenv("COCL_DUMP_CL") != 0) {
+            cout << "saving cl sourcecode to " << filename << endl;
+            ofstream f;
+            f.open(filename, ios_base::out);
+            f << clSourcecode << endl;
+            f.close();
+        }
+        kernel = buildOpenCLKernel(context, uniqueKernelName, shortKernelName, clSourcecode);
+    } catch(runtime_error &e) {
+        // let the next caller try again, and see the error for themselves
+        lock.lock();
+        entry->compiling = false;
+        entry->buildCv.notify_all();
+        throw e;
+    }
+    {
+        std::lock_guard< std::mutex > guard(context->kernelCacheMutex);
+        context->getCl()->storeKernel(uniqueKernelName, kernel, true);  // this will cause the kernel to be deleted with cl.  Not clean yet, but a start
+    }
+    lock.lock();
+    entry->kernel = kernel;
+    entry->compiling = false;
+    entry->buildCv.notify_all();
+    context->numCachedKernels++;
+    return kernel;
+}
 
-    ofstream f;
-    launchConfiguration.shortKernelName = origKernelName.substr(0, 20);
+CLKernel *compileOpenCLKernel(string originalKernelName, string clSourcecode) {
+    return compileOpenCLKernel(originalKernelName, originalKernelName, originalKernelName, clSourcecode);
+}
+
+CLKernel *compileOpenCLKernel(string originalKernelName, string uniqueKernelName, string shortKernelName, string clSourcecode) {
+    // returns already-built kernel if available, based on the name
+    // otherwise builds passed-in clsourcecode, caches that, and returns resulting kernel
+    // (opencl generation has already happened prior to this function)
+    Context *context = getThreadVars()->getContext();
+    context->numKernelCalls++;
+    KernelEntry *entry = getKernelEntry(context, uniqueKernelName);
+    return compileKernelEntry(context, entry, uniqueKernelName, shortKernelName, clSourcecode);
+}
 
+std::string getUniqueKernelName(std::string origKernelName, const std::vector<int> &clmemIndexByClmemArgIndex, int numVmemSegmentClmems) {
     std::ostringstream uniqueKernelName_ss;
     uniqueKernelName_ss << origKernelName;
     for(int i = 0; i < clmemIndexByClmemArgIndex.size(); i++) {
         uniqueKernelName_ss << "_" << clmemIndexByClmemArgIndex[i];
     }
-    launchConfiguration.uniqueKernelName = uniqueKernelName_ss.str();
-    if(v->getContext()->clSourceCodeCache.find(launchConfiguration.uniqueKernelName) != v->getContext()->clSourceCodeCache.end()) {
-        std::string clSourcecode = v->getContext()->clSourceCodeCache[launchConfiguration.uniqueKernelName];
-        return GenerateOpenCLResult { clSourcecode, origKernelName, launchConfiguration.shortKernelName, launchConfiguration.uniqueKernelName };
+    if(numVmemSegmentClmems > 0) {
+        uniqueKernelName_ss << "_vmem" << numVmemSegmentClmems;
+    }
+    return uniqueKernelName_ss.str();
+}
+
+static GenerateOpenCLResult convertKernelToOpenCL(
+        int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, string origKernelName, string shortKernelName,
+        string uniqueKernelName, const string &devicellsourcecode, bool offsets_32bit) {
+    // generates OpenCL source-code for one kernel variant, from the disk cache if possible.
+    // Doesnt touch the kernel caches, so no need to hold kernelCacheMutex
+
+    // converting means parsing the whole device IR, so see if an earlier run already did it
+    DiskCache *diskCache = getDiskCache();
+    string diskCacheKey = "";
+    if(diskCache != 0) {
+        // uniqueKernelName covers the kernel name, the clmem mapping, and any vmem segment clmems
+        uint64_t hash = fnv1a(getLibraryBuildId());
+        hash = fnv1a(devicellsourcecode, hash);
+        hash = fnv1a(uniqueKernelName, hash);
+        hash = fnv1a(easycl::toString(uniqueClmemCount), hash);
+        hash = fnv1a(offsets_32bit ? "offsets_32bit" : "offsets_64bit", hash);
+        diskCacheKey = "clsrc-" + hashToHex(hash);
+        string cached = "";
+        int usesVmem = 0;
+        int scratchBytesPerThread = 0;
+        int usesDynamicShared = 0;
+        size_t headerEnd = string::npos;
+        if(diskCache->read(diskCacheKey, &cached)
+                && (headerEnd = cached.find('\n')) != string::npos
+                && sscanf(cached.substr(0, headerEnd).c_str(), "usesVmem=%d scratchBytesPerThread=%d usesDynamicShared=%d",
+                    &usesVmem, &scratchBytesPerThread, &usesDynamicShared) == 3) {
+            COCL_PRINT("generateOpenCL: loaded " << uniqueKernelName << " from disk cache");
+            KernelInfo kernelInfo;
+            kernelInfo.usesVmem = usesVmem != 0;
+            kernelInfo.scratchBytesPerThread = scratchBytesPerThread;
+            kernelInfo.usesDynamicShared = usesDynamicShared != 0;
+            return GenerateOpenCLResult { cached.substr(headerEnd + 1), origKernelName, shortKernelName, uniqueKernelName, kernelInfo };
+        }
+    }
+
+    ModuleClRes res = convertLlStringToCl(
+        uniqueClmemCount, clmemIndexByClmemArgIndex, devicellsourcecode, origKernelName, shortKernelName, offsets_32bit);
+    std::string clSourcecode = res.clSourcecode;
+    KernelInfo kernelInfo;
+    kernelInfo.usesVmem = res.usesVmem;
+    kernelInfo.scratchBytesPerThread = res.scratchBytesPerThread;
+    kernelInfo.usesDynamicShared = res.usesDynamicShared;
+    clSourcecode = "// origKernelName: " + origKernelName + "\n" +
+        "// uniqueKernelName: " + uniqueKernelName + "\n" +
+        "// shortKernelName: " + shortKernelName + "\n" +
+        "\n" +
+        clSourcecode;
+    if(diskCache != 0) {
+        std::ostringstream cached;
+        cached << "usesVmem=" << kernelInfo.usesVmem << " scratchBytesPerThread=" << kernelInfo.scratchBytesPerThread
+            << " usesDynamicShared=" << kernelInfo.usesDynamicShared << "\n";
+        cached << clSourcecode;
+        diskCache->write(diskCacheKey, cached.str());
+    }
+    return GenerateOpenCLResult { clSourcecode, origKernelName, shortKernelName, uniqueKernelName, kernelInfo };
+}
+
+static bool generateKernelEntry(
+        Context *context, KernelEntry *entry, int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex,
+        string origKernelName, string shortKernelName, string uniqueKernelName, const string &devicellsourcecode,
+        bool offsets_32bit) {
+    // makes sure entry has its OpenCL source-code, generating it if no one has yet. If another
+    // thread is generating it right now, waits for that, rather than generating it again.
+    // Returns true if we were the ones that generated it
+    if(entry->clReady) {
+        return false;
+    }
+    std::unique_lock< std::mutex > lock(entry->mutex);
+    while(entry->generating) {
+        entry->buildCv.wait(lock);
     }
+    if(entry->clReady) {
+        return false;
+    }
+    entry->generating = true;
+    lock.unlock();
 
-    // convert to opencl first... based on the kernel name required
+    GenerateOpenCLResult res;
     try {
-        string filename = "/tmp/" + easycl::toString(v->getContext()->clSourceCodeCache.size()) + "-device.ll";
+        // device code embedded by patch_hostside is bitcode, unless it was run with --embed_device_ll
+        bool isBitcode = devicellsourcecode.compare(0, 2, "BC") == 0;
+        string filename = "/tmp/" + easycl::toString(context->numGeneratedKernels++) + (isBitcode ? "-device.bc" : "-device.ll");
         if(getenv("COCL_DUMP_BYTECODE") != 0) {
             cout << "saving deviceside bytecode to " << filename << endl;
             ofstream f;
@@ -240,42 +542,177 @@ GenerateOpenCLResult generateOpenCL(
             f << devicellsourcecode << endl;
             f.close();
         }
-        ModuleClRes res = convertLlStringToCl(
-            uniqueClmemCount, clmemIndexByClmemArgIndex, devicellsourcecode, origKernelName, launchConfiguration.shortKernelName, v->offsets_32bit);
-        std::string clSourcecode = res.clSourcecode;
-        KernelInfo kernelInfo;
-        kernelInfo.usesVmem = res.usesVmem;
-        kernelInfo.usesScratch = res.usesScratch;
-        clSourcecode = "// origKernelName: " + origKernelName + "\n" +
-            "// uniqueKernelName: " + launchConfiguration.uniqueKernelName + "\n" +
-            "// shortKernelName: " + launchConfiguration.shortKernelName + "\n" +
-            "\n" +
-            clSourcecode;
-        v->getContext()->clSourceCodeCache[launchConfiguration.uniqueKernelName] = clSourcecode;
-        v->getContext()->kernelInfoByUniqueName[launchConfiguration.uniqueKernelName] = kernelInfo;
-        return GenerateOpenCLResult { clSourcecode, origKernelName, launchConfiguration.shortKernelName, launchConfiguration.uniqueKernelName };
+
+        res = convertKernelToOpenCL(
+            uniqueClmemCount, clmemIndexByClmemArgIndex, origKernelName, shortKernelName,
+            uniqueKernelName, devicellsourcecode, offsets_32bit);
     } catch(runtime_error &e) {
         cout << "generateOpenCL failed to generate opencl sourcecode" << endl;
         cout << "kernel name orig=" << origKernelName << endl;
-        cout << "kernel name short=" << launchConfiguration.shortKernelName << endl;
-        cout << "kernel name unique=" << launchConfiguration.uniqueKernelName << endl;
+        cout << "kernel name short=" << shortKernelName << endl;
+        cout << "kernel name unique=" << uniqueKernelName << endl;
         cout << "writing ll to /tmp/failed-kernel.ll" << endl;
+        ofstream f;
         f.open("/tmp/failed-kernel.ll", ios_base::out);
         f << devicellsourcecode << endl;
         f.close();
+        // let the next caller try again
+        lock.lock();
+        entry->generating = false;
+        entry->buildCv.notify_all();
         throw e;
     }
+    lock.lock();
+    entry->clSourcecode = res.clSourcecode;
+    entry->kernelInfo = res.kernelInfo;
+    entry->clReady = true;
+    entry->generating = false;
+    entry->buildCv.notify_all();
+    return true;
+}
+
+static void recordInLaunchManifest(
+        Context *context, bool offsets_32bit, string origKernelName, int uniqueClmemCount, const std::vector<int> &clmemIndexByClmemArgIndex,
+        int numVmemSegmentClmems, const string &devicellsourcecode) {
+    // so the next run can build this variant in the background, before it is launched
+    LaunchManifest *launchManifest = getLaunchManifest();
+    if(launchManifest == 0) {
+        return;
+    }
+    KernelVariant variant;
+    variant.deviceKey = getDeviceKey(getCoclDeviceByGpuOrdinal(context->gpuOrdinal)->deviceId);
+    variant.offsets_32bit = offsets_32bit;
+    variant.kernelName = origKernelName;
+    variant.uniqueClmemCount = uniqueClmemCount;
+    variant.clmemIndexByClmemArgIndex = clmemIndexByClmemArgIndex;
+    variant.numVmemSegmentClmems = numVmemSegmentClmems;
+    launchManifest->record(variant, devicellsourcecode);
+}
+
+static KernelEntry *resolveKernelEntry(
+        Context *context, CoclLaunchSite *site, int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex,
+        int numVmemSegmentClmems) {
+    // returns the kernel entry for a launch from site, with its OpenCL source-code generated.
+    // Nearly always, the site's previous launch was the same variant, so we just return that
+    LaunchSiteResolution *resolution = site->resolution;
+    if(resolution == 0 || !resolution->matches(context->id, uniqueClmemCount, clmemIndexByClmemArgIndex, numVmemSegmentClmems)) {
+        resolution = site->findResolution(context->id, uniqueClmemCount, clmemIndexByClmemArgIndex, numVmemSegmentClmems);
+    }
+    if(resolution != 0) {
+        return resolution->kernelEntry;
+    }
+
+    bool offsets_32bit = getThreadVars()->offsets_32bit;
+    string uniqueKernelName = getUniqueKernelName(site->kernelName, clmemIndexByClmemArgIndex, numVmemSegmentClmems);
+    KernelEntry *entry = getKernelEntry(context, uniqueKernelName);
+    if(generateKernelEntry(
+            context, entry, uniqueClmemCount, clmemIndexByClmemArgIndex, site->kernelName, site->shortKernelName,
+            uniqueKernelName, site->getDeviceIr(), offsets_32bit)) {
+        recordInLaunchManifest(
+            context, offsets_32bit, site->kernelName, uniqueClmemCount, clmemIndexByClmemArgIndex, numVmemSegmentClmems,
+            site->getDeviceIr());
+    }
+    site->publish(context->id, uniqueClmemCount, clmemIndexByClmemArgIndex, numVmemSegmentClmems, entry);
+    return entry;
+}
+
+GenerateOpenCLResult generateOpenCL(
+        int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, string origKernelName, const string &devicellsourcecode,
+        int numVmemSegmentClmems) {
+    // generates OpenCL source-code, based on passed-in bytecode
+    // returns cached source-code if available
+    ThreadVars *v = getThreadVars();
+    Context *context = v->getContext();
+    string shortKernelName = origKernelName.substr(0, 20);
+    string uniqueKernelName = getUniqueKernelName(origKernelName, clmemIndexByClmemArgIndex, numVmemSegmentClmems);
+    KernelEntry *entry = getKernelEntry(context, uniqueKernelName);
+    if(generateKernelEntry(
+            context, entry, uniqueClmemCount, clmemIndexByClmemArgIndex, origKernelName, shortKernelName, uniqueKernelName,
+            devicellsourcecode, v->offsets_32bit)) {
+        recordInLaunchManifest(
+            context, v->offsets_32bit, origKernelName, uniqueClmemCount, clmemIndexByClmemArgIndex, numVmemSegmentClmems,
+            devicellsourcecode);
+    }
+    return GenerateOpenCLResult { entry->clSourcecode, origKernelName, shortKernelName, uniqueKernelName, entry->kernelInfo };
+}
+
+void warmUpKernel(Context *context, const KernelVariant &variant, const std::string &deviceIr) {
+    // generates and builds one variant from the launch manifest. This goes through the same
+    // kernel cache entry as a launch would, so a launch arriving meanwhile waits for us, rather
+    // than building the kernel a second time, and launches of other kernels carry on regardless
+    string shortKernelName = variant.kernelName.substr(0, 20);
+    string uniqueKernelName = getUniqueKernelName(variant.kernelName, variant.clmemIndexByClmemArgIndex, variant.numVmemSegmentClmems);
+    KernelEntry *entry = getKernelEntry(context, uniqueKernelName);
+    if(entry->kernel != 0) {
+        return;
+    }
+    std::vector<int> clmemIndexByClmemArgIndex = variant.clmemIndexByClmemArgIndex;
+    generateKernelEntry(
+        context, entry, variant.uniqueClmemCount, clmemIndexByClmemArgIndex, variant.kernelName, shortKernelName, uniqueKernelName,
+        deviceIr, variant.offsets_32bit);
+    compileKernelEntry(context, entry, uniqueKernelName, shortKernelName, entry->clSourcecode);
+}
+
+bool LaunchSiteResolution::matches(
+        long long contextId, int uniqueClmemCount, const std::vector<int> &clmemIndexByClmemArgIndex, int numVmemSegmentClmems) const {
+    return this->contextId == contextId && this->uniqueClmemCount == uniqueClmemCount
+        && this->numVmemSegmentClmems == numVmemSegmentClmems && this->clmemIndexByClmemArgIndex == clmemIndexByClmemArgIndex;
+}
+
+CoclLaunchSite::CoclLaunchSite(const char *kernelName, const char *deviceIrPtr, int64_t deviceIrSize) :
+        kernelName(kernelName), shortKernelName(this->kernelName.substr(0, 20)),
+        deviceIrPtr(deviceIrPtr), deviceIrSize(deviceIrSize), resolution(nullptr) {
+}
+
+const std::string &CoclLaunchSite::getDeviceIr() {
+    std::call_once(deviceIrOnce, [this] {
+        if(deviceIrSize < 0) {
+            deviceIr = deviceIrPtr;
+        } else {
+            deviceIr.assign(deviceIrPtr, deviceIrSize);
+        }
+    });
+    return deviceIr;
+}
+
+LaunchSiteResolution *CoclLaunchSite::findResolution(
+        long long contextId, int uniqueClmemCount, const std::vector<int> &clmemIndexByClmemArgIndex, int numVmemSegmentClmems) {
+    std::lock_guard< std::mutex > guard(mutex);
+    for(auto it = resolutions.begin(); it != resolutions.end(); it++) {
+        if((*it)->matches(contextId, uniqueClmemCount, clmemIndexByClmemArgIndex, numVmemSegmentClmems)) {
+            resolution = it->get();
+            return it->get();
+        }
+    }
+    return 0;
+}
+
+void CoclLaunchSite::publish(
+        long long contextId, int uniqueClmemCount, const std::vector<int> &clmemIndexByClmemArgIndex, int numVmemSegmentClmems,
+        KernelEntry *kernelEntry) {
+    std::lock_guard< std::mutex > guard(mutex);
+    for(auto it = resolutions.begin(); it != resolutions.end(); it++) {
+        if((*it)->matches(contextId, uniqueClmemCount, clmemIndexByClmemArgIndex, numVmemSegmentClmems)) {
+            // another thread got here first
+            resolution = it->get();
+            return;
+        }
+    }
+    LaunchSiteResolution *newResolution = new LaunchSiteResolution();
+    newResolution->contextId = contextId;
+    newResolution->uniqueClmemCount = uniqueClmemCount;
+    newResolution->clmemIndexByClmemArgIndex = clmemIndexByClmemArgIndex;
+    newResolution->numVmemSegmentClmems = numVmemSegmentClmems;
+    newResolution->kernelEntry = kernelEntry;
+    resolutions.push_back(std::unique_ptr<LaunchSiteResolution>(newResolution));
+    resolution = newResolution;
 }
 
 } // namespace cocl
 
-void configureKernel(const char *kernelName, const char *devicellsourcecode) {
-    // pthread_mutex_lock(&launchMutex);
-    // launchMutex.lock();
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
+static void configureLaunchSite(CoclLaunchSite *site) {
     COCL_PRINT("=========================================");
-    launchConfiguration.kernelName = kernelName;
-    launchConfiguration.devicellsourcecode = devicellsourcecode;
+    launchConfiguration.site = site;
 
     // in order to handle by-value structs containing pointers to gpu structs, we're first going
     // to add the first Memory object to the clmems, so it is available to the kernel, for
@@ -286,15 +723,71 @@ void configureKernel(const char *kernelName, const char *devicellsourcecode) {
     // we're simply going to assume there is a single memory allocated and take that
     // we'll verify this assumption before launhc, if we are in fact using vmem
     ThreadVars *v = getThreadVars();
-    Memory *firstMem = *v->getContext()->memories.begin();
+    Memory *firstMem = 0;
+    {
+        Context *context = v->getContext();
+        ContextMutex contextMutex(context);
+        if(!context->memories.empty()) {
+            firstMem = *context->memories.begin();
+        }
+    }
     // std::cout << "setKernelArgHostsideBuffer firstMem=" << firstMem << std::endl;
     // if its not zero, then pass it into kernel
     if(firstMem != 0) {
+        // register it in clmemIndexByClmem too, so args living in the same clmem (eg the same
+        // slab) reuse clmem0, rather than each adding another kernel parameter
+        launchConfiguration.clmemIndexByClmem[firstMem->clmem] = 0;
         launchConfiguration.clmems.push_back(firstMem->clmem);
         // addClmemArg(firstMem->clmem);
     }
+}
+
+void configureKernelSite(char **launchSite, const char *kernelName, const char *deviceIr, int64_t deviceIrSize) {
+    // launchSite is a slot in the host binary, and other threads may be launching from the same
+    // place, so whoever fills it first wins. std::atomic<char *> is lock-free, and laid out as a
+    // plain pointer, on every target we support, so we can treat the slot as one
+    static_assert(sizeof(std::atomic<char *>) == sizeof(char *), "launch site slots hold a plain pointer");
+    std::atomic<char *> *slot = reinterpret_cast<std::atomic<char *> *>(launchSite);
+    CoclLaunchSite *site = (CoclLaunchSite *)slot->load(std::memory_order_acquire);
+    if(site == 0) {
+        CoclLaunchSite *newSite = new CoclLaunchSite(kernelName, deviceIr, deviceIrSize);
+        char *existing = 0;
+        if(slot->compare_exchange_strong(existing, (char *)newSite, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            site = newSite;
+        } else {
+            delete newSite;
+            site = (CoclLaunchSite *)existing;
+        }
+    }
+    configureLaunchSite(site);
+}
+
+static CoclLaunchSite *getLaunchSiteByPointers(const char *kernelName, const char *deviceIr, int64_t deviceIrSize) {
+    // binaries patched before configureKernelSite existed have no slot for us, so we keep their
+    // sites here, keyed on where the kernel name and device IR live in the host binary
+    static std::mutex sitesMutex;
+    static std::map<std::pair<const char *, const char *>, std::unique_ptr<CoclLaunchSite> > siteByPointers;
+    static thread_local std::map<std::pair<const char *, const char *>, CoclLaunchSite *> siteByPointersMemo;
+    std::pair<const char *, const char *> key(kernelName, deviceIr);
+    auto it = siteByPointersMemo.find(key);
+    if(it != siteByPointersMemo.end()) {
+        return it->second;
+    }
+    CoclLaunchSite *site = 0;
+    {
+        std::lock_guard< std::mutex > guard(sitesMutex);
+        std::unique_ptr<CoclLaunchSite> &slot = siteByPointers[key];
+        if(!slot) {
+            slot.reset(new CoclLaunchSite(kernelName, deviceIr, deviceIrSize));
+        }
+        site = slot.get();
+    }
+    siteByPointersMemo[key] = site;
+    return site;
+}
 
-    // pthread_mutex_unlock(&launchMutex);
+void configureKernel(const char *kernelName, const char *devicellsourcecode) {
+    configureLaunchSite(getLaunchSiteByPointers(kernelName, devicellsourcecode, -1));
 }
 
 void addClmemArg(cl_mem clmem) {
@@ -311,12 +804,14 @@ void addClmemArg(cl_mem clmem) {
 
 void setKernelArgHostsideBuffer(char *pCpuStruct, int structAllocateSize) {
     // this receives a hostside struct. it will
-    // - allocate a gpu buffer, to hold the struct
-    // - queue an OpenCL command, to copy the hostside buffer to the gpu buffer
+    // - copy the struct into launchConfiguration.uploadBytes, which kernelGo uploads into the
+    //   stream's upload ring, in one write
+    //   (or, if the ring is disabled, or too small: allocate a gpu buffer, to hold the struct,
+    //   and copy the hostside buffer to the gpu buffer)
     // - adds the gpu buffer, and its offset, to the kernel parameters:
     //   - add the gpu buffer to list of unique clmems (if not already there)
     //   - records the unique clmem index, for use in generation
-    //   - adds an integer arg, with value 0, as the offset arg
+    //   - adds an integer arg, holding the offset of the struct in the gpu buffer
     //
     // Things this doesnt do:
     // - parse/walk the struct (thats handled during opencl generation, later on, not here)
@@ -329,11 +824,30 @@ void setKernelArgHostsideBuffer(char *pCpuStruct, int structAllocateSize) {
     //   anything to the setKernelArgGpuBuffer method (which expects an incoming
     //   pointer to be a virtual pointer, not a cl_mem)
 
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
-    // pthread_mutex_lock(&launchMutex);
     ThreadVars *v = getThreadVars();
     EasyCL *cl = v->getContext()->getCl();
     cl_context *ctx = cl->context;
+    COCL_PRINT("setKernelArgHostsideBuffer size=" << structAllocateSize);
+    if(structAllocateSize < 4) {
+        structAllocateSize = 4;
+    }
+
+    UploadRing *uploadRing = launchConfiguration.coclStream->getUploadRing();
+    size_t uploadOffset = ((launchConfiguration.uploadBytes.size() + UploadRing::alignment - 1) / UploadRing::alignment)
+        * UploadRing::alignment;
+    if(uploadRing != 0 && uploadOffset + structAllocateSize <= uploadRing->capacity) {
+        launchConfiguration.uploadBytes.resize(uploadOffset + structAllocateSize);
+        memcpy(&launchConfiguration.uploadBytes[uploadOffset], pCpuStruct, structAllocateSize);
+        addClmemArg(uploadRing->clmem);
+        launchConfiguration.uploadOffsetArgIndices.push_back(launchConfiguration.args.size());
+        if(v->offsets_32bit) {
+           launchConfiguration.args.push_back(KernelArg::uint32((uint32_t)uploadOffset));
+        } else {
+           launchConfiguration.args.push_back(KernelArg::int64((int64_t)uploadOffset));
+        }
+        return;
+    }
+
     // we're going to:
     // allocate a cl_mem for the struct
     // copy the cpu struct to the cl_mem
@@ -342,10 +856,6 @@ void setKernelArgHostsideBuffer(char *pCpuStruct, int structAllocateSize) {
     // we should also:
     // deallocate the cl_mem after calling the kernel
     // (we assume hte struct is passed by-value, so we dont have to actually copy it back afterwards)
-    COCL_PRINT("setKernelArgHostsideBuffer size=" << structAllocateSize);
-    if(structAllocateSize < 4) {
-        structAllocateSize = 4;
-    }
     cl_int err;
     cl_mem gpu_struct = clCreateBuffer(*ctx, CL_MEM_READ_WRITE, structAllocateSize,
                                            NULL, &err);
@@ -359,12 +869,10 @@ void setKernelArgHostsideBuffer(char *pCpuStruct, int structAllocateSize) {
 
     int offsetElements = 0;
     if(v->offsets_32bit) {
-       launchConfiguration.args.push_back(std::unique_ptr<Arg>(new UInt32Arg((uint32_t)offsetElements)));
+       launchConfiguration.args.push_back(KernelArg::uint32((uint32_t)offsetElements));
     } else {
-       launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int64Arg((int64_t)offsetElements)));
+       launchConfiguration.args.push_back(KernelArg::int64((int64_t)offsetElements));
     }
-
-    // pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgGpuBuffer(char *memory_as_charstar, int32_t elementSize) {
@@ -375,22 +883,20 @@ void setKernelArgGpuBuffer(char *memory_as_charstar, int32_t elementSize) {
     // The elementSize used to be used, but is no longer used/needed. Should probably be
     // removed from the method parameters at some point.
 
-    // pthread_mutex_lock(&launchMutex);
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
     ThreadVars *v = getThreadVars();
 
-    Memory *memory = findMemory(memory_as_charstar);
-    if(memory == 0) {
+    MemoryRef memory = findMemoryRef(memory_as_charstar);
+    if(memory.clmem == 0) {
         COCL_PRINT("setKernelArgGpuBuffer nullptr");
         addClmemArg(0);
         if(v->offsets_32bit) {
-            launchConfiguration.args.push_back(std::unique_ptr<Arg>(new UInt32Arg(0)));
+            launchConfiguration.args.push_back(KernelArg::uint32(0));
         } else {
-            launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int64Arg(0)));
+            launchConfiguration.args.push_back(KernelArg::int64(0));
         }
     } else {
-        size_t offset = memory->getOffset(memory_as_charstar);
-        cl_mem clmem = memory->clmem;
+        size_t offset = memory.getOffset(memory_as_charstar);
+        cl_mem clmem = memory.clmem;
         // std::cout << " clmem=" << clmem << std::endl;
 
         size_t offsetElements = offset;
@@ -400,102 +906,172 @@ void setKernelArgGpuBuffer(char *memory_as_charstar, int32_t elementSize) {
         addClmemArg(clmem);
 
         if(v->offsets_32bit) {
-            launchConfiguration.args.push_back(std::unique_ptr<Arg>(new UInt32Arg((uint32_t)offsetElements)));
+            launchConfiguration.args.push_back(KernelArg::uint32((uint32_t)offsetElements));
         } else {
-            launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int64Arg((int64_t)offsetElements)));
+            launchConfiguration.args.push_back(KernelArg::int64((int64_t)offsetElements));
         }
     }
-    // pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgInt64(int64_t value) {
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
-    // pthread_mutex_lock(&launchMutex);
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int64Arg(value)));
+    launchConfiguration.args.push_back(KernelArg::int64(value));
     COCL_PRINT("setKernelArgInt64 " << value);
-    // pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgInt32(int value) {
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
-    // pthread_mutex_lock(&launchMutex);
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int32Arg(value)));
+    launchConfiguration.args.push_back(KernelArg::int32(value));
     COCL_PRINT("setKernelArgInt32 " << value);
-    // pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgInt8(char value) {
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
-    // pthread_mutex_lock(&launchMutex);
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int8Arg(value)));
+    launchConfiguration.args.push_back(KernelArg::int8(value));
     COCL_PRINT("setKernelArgInt8 " << value);
-    // pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgFloat(float value) {
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
-    // pthread_mutex_lock(&launchMutex);
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new FloatArg(value)));
+    launchConfiguration.args.push_back(KernelArg::float32(value));
     COCL_PRINT("setKernelArgFloat " << value);
-    // pthread_mutex_unlock(&launchMutex);
+}
+
+static void bindKernelArg(KernelEntry *entry, int argIndex, size_t size, const void *value, int *numSkipped) {
+    // calls clSetKernelArg, unless the kernel already has this value for argIndex. A value of 0
+    // means local memory, of size bytes. Caller holds entry->launchMutex
+    if((int)entry->boundArgs.size() <= argIndex) {
+        entry->boundArgs.resize(argIndex + 1);
+    }
+    BoundKernelArg &boundArg = entry->boundArgs[argIndex];
+    bool local = value == 0;
+    uint64_t newValue = 0;
+    if(!local) {
+        if(size > sizeof(newValue)) {
+            throw runtime_error("bindKernelArg: arg " + easycl::toString(argIndex) + " is bigger than 8 bytes");
+        }
+        memcpy(&newValue, value, size);
+    }
+    if(boundArg.bound && boundArg.local == local && boundArg.size == size && boundArg.value == newValue) {
+        (*numSkipped)++;
+        return;
+    }
+    // if this throws, the arg is left unbound, so the next launch sets it again
+    boundArg.bound = false;
+    cl_int err = clSetKernelArg(entry->kernel.load()->kernel, argIndex, size, value);
+    EasyCL::checkError(err);
+    boundArg.bound = true;
+    boundArg.local = local;
+    boundArg.size = size;
+    boundArg.value = newValue;
+}
+
+// every clmem is passed as a pointer plus its vmem offset, so a big enough vmem segment table
+// can run past what the device takes. Better to say so than have clSetKernelArg fail
+static void checkKernelParameterBytes(Context *context, bool offsets_32bit, const KernelInfo &kernelInfo) {
+    size_t offsetBytes = offsets_32bit ? sizeof(uint32_t) : sizeof(int64_t);
+    size_t parameterBytes = launchConfiguration.clmems.size() * (sizeof(cl_mem) + offsetBytes);
+    for(int i = 0; i < launchConfiguration.args.size(); i++) {
+        parameterBytes += launchConfiguration.args[i].size();
+    }
+    if(kernelInfo.scratchBytesPerThread > 0) {
+        parameterBytes += sizeof(cl_mem);
+    }
+    if(kernelInfo.usesDynamicShared) {
+        parameterBytes += sizeof(cl_mem);
+    }
+    if(parameterBytes > context->maxKernelParameterBytes) {
+        cout << "kernel " << launchConfiguration.site->kernelName << " dereferences device pointers stored in device memory, "
+            << "so takes every one of the " << launchConfiguration.clmems.size() << " live device buffers as a parameter: "
+            << parameterBytes << " bytes of parameters, but the device takes at most "
+            << context->maxKernelParameterBytes << ". Try fewer, larger, cudaMallocs" << endl;
+        throw runtime_error("kernel parameters exceed CL_DEVICE_MAX_PARAMETER_SIZE");
+    }
 }
 
 void kernelGo() {
     try {
-    launchMutex.lock();
-    // pthread_mutex_lock(&launchMutex);
     // COCL_PRINT("kernelGo queue=" << (void *)launchConfiguration.queue);
 
     ThreadVars *v = getThreadVars();
+    Context *context = v->getContext();
 
-    GenerateOpenCLResult res = generateOpenCL(
-        launchConfiguration.clmems.size(), launchConfiguration.clmemIndexByClmemArgIndex, launchConfiguration.kernelName, launchConfiguration.devicellsourcecode);
-    COCL_PRINT("kernelGo() kernel: " << launchConfiguration.kernelName);
-    CLKernel *kernel = compileOpenCLKernel(launchConfiguration.kernelName, res.uniqueKernelName, res.shortKernelName, res.clSourcecode);
-    COCL_PRINT("kernelGo() uniqueKernelName: " << launchConfiguration.uniqueKernelName);
+    CoclLaunchSite *site = launchConfiguration.site;
+    KernelEntry *entry = resolveKernelEntry(
+        context, site, launchConfiguration.clmems.size(), launchConfiguration.clmemIndexByClmemArgIndex, 0);
+    COCL_PRINT("kernelGo() kernel: " << site->kernelName);
 
-    KernelInfo kernelInfo = v->getContext()->kernelInfoByUniqueName[launchConfiguration.uniqueKernelName];
+    const KernelInfo &kernelInfo = entry->kernelInfo;
     COCL_PRINT("kernel uses vmem?: " << kernelInfo.usesVmem);
-    COCL_PRINT("kernel uses scratch?: " << kernelInfo.usesScratch);
+    COCL_PRINT("kernel scratch bytes per thread: " << kernelInfo.scratchBytesPerThread);
+    COCL_PRINT("kernel uses dynamic shared?: " << kernelInfo.usesDynamicShared);
     if(kernelInfo.usesVmem) {
-        if(v->getContext()->memories.size() > 1) {
-            std::cout << std::endl;
-            std::cout << "Error: you are trying to use a kernel that uses double-indirected pointers ('float **' et al)" << std::endl;
-            std::cout << "whilst you have allocated multiple gpu buffers" << std::endl;
-            std::cout << std::endl;
-            std::cout << "This is currently not supported by Coriander" << std::endl;
-            std::cout << std::endl;
-            std::cout << "Your options are:" << std::endl;
-            std::cout << "- update your GPU kernel, to not use double-indirected pointers" << std::endl;
-            std::cout << "- allocate one single huge GPU memory buffer, instead of many smaller ones" << std::endl;
-            std::cout << std::endl;
-            throw std::runtime_error("Error: using vmem with multiple allocations");
-        } else {
-            WHEN_SPAMMING(Memory *memory = *v->getContext()->memories.begin());
-            COCL_PRINT("Memory allocation ok: one single allocation at vmem=" << memory->fakePos << " sizeByes=" << memory->bytes);
+        // a double-indirected pointer can point into any device buffer, not just the ones passed
+        // in as args, so hand the kernel every live buffer, as its vmem segment table. These
+        // extra clmems have no arg pointing at them, so they only change the clmem count
+        int numVmemSegmentClmems = 0;
+        {
+            ContextMutex contextMutex(context);
+            for(auto it = context->vmemBaseByClmem.begin(); it != context->vmemBaseByClmem.end(); it++) {
+                cl_mem clmem = it->first;
+                if(launchConfiguration.clmemIndexByClmem.find(clmem) == launchConfiguration.clmemIndexByClmem.end()) {
+                    launchConfiguration.clmemIndexByClmem[clmem] = launchConfiguration.clmems.size();
+                    launchConfiguration.clmems.push_back(clmem);
+                    numVmemSegmentClmems++;
+                }
+            }
         }
-    }
-
-    // ThreadVars *v = getThreadVars();
-    for(int i = 0; i < launchConfiguration.clmems.size(); i++) {
-        COCL_PRINT("clmem" << i);
-        kernel->inout(&launchConfiguration.clmems[i]);
-        // we also need to write out the offset of this clmem, in our virtual memory system
-        cl_mem clmem = launchConfiguration.clmems[i];
-        Memory *memory = findMemoryByClmem(clmem);
-        uint64_t vmemloc = 0;
-        if(memory != 0) {  // hostsidegpu buffers will be 0
-            vmemloc = memory->fakePos;
+        if(numVmemSegmentClmems > 0) {
+            // the kernel is generated for a given table size, so round that up to a power of two,
+            // rather than building a new variant every time the number of live buffers changes.
+            // The padding repeats the last buffer, which, having the same vmem base, is harmless
+            int numSegmentsBucket = 1;
+            while(numSegmentsBucket < numVmemSegmentClmems) {
+                numSegmentsBucket <<= 1;
+            }
+            cl_mem padClmem = launchConfiguration.clmems.back();
+            for(; numVmemSegmentClmems < numSegmentsBucket; numVmemSegmentClmems++) {
+                launchConfiguration.clmems.push_back(padClmem);
+            }
+            checkKernelParameterBytes(context, v->offsets_32bit, kernelInfo);
         }
-        if(v->offsets_32bit) {
-            kernel->in((uint32_t)vmemloc);
-        } else {
-            kernel->in((int64_t)vmemloc);
+        COCL_PRINT("vmem segment table: added " << numVmemSegmentClmems << " clmems");
+        if(numVmemSegmentClmems > 0) {
+            entry = resolveKernelEntry(
+                context, site, launchConfiguration.clmems.size(), launchConfiguration.clmemIndexByClmemArgIndex, numVmemSegmentClmems);
         }
     }
-    for(int i = 0; i < launchConfiguration.args.size(); i++) {
-        COCL_PRINT("i=" << i << " " << launchConfiguration.args[i]->str());
-        launchConfiguration.args[i]->inject(kernel);
+    launchConfiguration.kernelEntry = entry;
+    context->numKernelCalls++;
+    CLKernel *kernel = entry->kernel;
+    if(kernel == 0) {
+        kernel = compileKernelEntry(context, entry, entry->uniqueKernelName, site->shortKernelName, entry->clSourcecode);
+    }
+    COCL_PRINT("kernelGo() uniqueKernelName: " << entry->uniqueKernelName);
+
+    // holds the stream until the kernel, and the marker after it, are enqueued
+    StreamEnqueue streamEnqueue(launchConfiguration.coclStream);
+    long long seq = streamEnqueue.seq;
+    bool usesUploadRing = launchConfiguration.uploadBytes.size() > 0;
+    if(usesUploadRing) {
+        size_t ringOffset = launchConfiguration.coclStream->getUploadRing()->upload(
+            seq, &launchConfiguration.uploadBytes[0], launchConfiguration.uploadBytes.size());
+        COCL_PRINT("uploaded " << launchConfiguration.uploadBytes.size() << " bytes of structs to ring offset " << ringOffset);
+        for(auto it = launchConfiguration.uploadOffsetArgIndices.begin(); it != launchConfiguration.uploadOffsetArgIndices.end(); it++) {
+            KernelArg &arg = launchConfiguration.args[*it];
+            if(v->offsets_32bit) {
+                arg.v.uint32 += ringOffset;
+            } else {
+                arg.v.int64 += ringOffset;
+            }
+        }
+    }
+
+    // we also need to write out the offset of each clmem, in our virtual memory system. Look
+    // them all up under the one lock
+    {
+        ContextMutex contextMutex(context);
+        for(int i = 0; i < launchConfiguration.clmems.size(); i++) {
+            auto it = context->vmemBaseByClmem.find(launchConfiguration.clmems[i]);
+            // hostsidegpu buffers will be 0
+            launchConfiguration.clmemVmemBases.push_back(it == context->vmemBaseByClmem.end() ? 0 : it->second);
+        }
     }
 
     size_t global[3];
@@ -506,7 +1082,48 @@ void kernelGo() {
         << " global: " << global);
     int workgroupSize = launchConfiguration.block[0] * launchConfiguration.block[1] * launchConfiguration.block[2];
     COCL_PRINT("workgroupSize=" << workgroupSize);
-    kernel->localInts(max(4, workgroupSize));
+
+    // other threads may be launching the same kernel, and the args set on a cl_kernel are shared
+    // by everyone using it, so hold the kernel from here until it is enqueued
+    std::unique_lock< std::mutex > kernelLock(entry->launchMutex);
+    long long memoryGeneration = context->memoryGeneration.load();
+    if(entry->boundMemoryGeneration != memoryGeneration) {
+        entry->boundArgs.clear();
+        entry->boundMemoryGeneration = memoryGeneration;
+    }
+    int argIndex = 0;
+    int numArgsSkipped = 0;
+    for(int i = 0; i < launchConfiguration.clmems.size(); i++) {
+        COCL_PRINT("clmem" << i);
+        bindKernelArg(entry, argIndex++, sizeof(cl_mem), &launchConfiguration.clmems[i], &numArgsSkipped);
+        // we also need to write out the offset of this clmem, in our virtual memory system
+        uint64_t vmemloc = launchConfiguration.clmemVmemBases[i];
+        if(v->offsets_32bit) {
+            uint32_t vmemloc32 = (uint32_t)vmemloc;
+            bindKernelArg(entry, argIndex++, sizeof(vmemloc32), &vmemloc32, &numArgsSkipped);
+        } else {
+            int64_t vmemloc64 = (int64_t)vmemloc;
+            bindKernelArg(entry, argIndex++, sizeof(vmemloc64), &vmemloc64, &numArgsSkipped);
+        }
+    }
+    for(int i = 0; i < launchConfiguration.args.size(); i++) {
+        const KernelArg &arg = launchConfiguration.args[i];
+        COCL_PRINT("i=" << i << " " << arg.str());
+        bindKernelArg(entry, argIndex++, arg.size(), arg.data(), &numArgsSkipped);
+    }
+    if(kernelInfo.scratchBytesPerThread > 0) {
+        // local memory, for shims such as __shfl_down
+        bindKernelArg(entry, argIndex++, (size_t)workgroupSize * kernelInfo.scratchBytesPerThread, 0, &numArgsSkipped);
+    }
+    if(kernelInfo.usesDynamicShared) {
+        // the extern __shared__ arrays. opencl wont take a zero-sized local arg
+        size_t sharedMem = max((size_t)4, launchConfiguration.sharedMem);
+        COCL_PRINT("dynamic shared memory: " << launchConfiguration.sharedMem << " bytes");
+        bindKernelArg(entry, argIndex++, sharedMem, 0, &numArgsSkipped);
+    }
+    context->numKernelArgsSet += argIndex - numArgsSkipped;
+    context->numKernelArgsSkipped += numArgsSkipped;
+    COCL_PRINT("set " << (argIndex - numArgsSkipped) << " of " << argIndex << " kernel args");
 
     try {
         kernel->run(launchConfiguration.queue, 3, global, launchConfiguration.block);
@@ -515,42 +1132,82 @@ void kernelGo() {
             std::cout << kernel->buildLog << std::endl;
         }
         cout << "kernel failed to run" << endl;
-        cout << "kernel name: [" << launchConfiguration.kernelName << "]" << endl;
-        launchMutex.unlock();
-        launchMutex.unlock();
-        // pthread_mutex_unlock(&launchMutex);
-        // pthread_mutex_unlock(&launchMutex);
+        cout << "kernel name: [" << site->kernelName << "]" << endl;
         throw e;
     }
+    kernelLock.unlock();
     COCL_PRINT(".. kernel queued");
+    // we dont wait for the kernel to finish: the launch stays queued, and we return straight away.
+    // Any hostside struct buffers, and upload ring space, are released once a marker after the
+    // kernel completes
     cl_int err;
-    err = clFinish(launchConfiguration.queue->queue);
+    if(launchConfiguration.kernelArgsToBeReleased.size() > 0 || usesUploadRing) {
+        cl_event event;
+        err = clEnqueueMarkerWithWaitList(launchConfiguration.queue->queue, 0, 0, &event);
+        EasyCL::checkError(err);
+        launchConfiguration.coclStream->addPending(seq, event, launchConfiguration.kernelArgsToBeReleased);
+    } else {
+        launchConfiguration.coclStream->reapCompleted();
+    }
+    err = clFlush(launchConfiguration.queue->queue);
     EasyCL::checkError(err);
+    streamEnqueue.publish();
+    // dumping does blocking reads on the same queue, so sees the results of this launch
     debugDumper.maybeDump();
 
-    for(auto it=launchConfiguration.kernelArgsToBeReleased.begin(); it != launchConfiguration.kernelArgsToBeReleased.end(); it++) {
-        cl_mem memObject = *it;
-        err = clReleaseMemObject(memObject);
-        EasyCL::checkError(err);
-    }
     launchConfiguration.kernelArgsToBeReleased.clear();
+    launchConfiguration.uploadBytes.clear();
+    launchConfiguration.uploadOffsetArgIndices.clear();
     launchConfiguration.args.clear();
 
     launchConfiguration.clmemIndexByClmem.clear();
     launchConfiguration.clmems.clear();
     launchConfiguration.clmemIndexByClmemArgIndex.clear();
+    launchConfiguration.clmemVmemBases.clear();
 
-    err = clFinish(launchConfiguration.queue->queue);
-    EasyCL::checkError(err);
-
-    launchMutex.unlock();
-    launchMutex.unlock();
-    // pthread_mutex_unlock(&launchMutex);
-    // pthread_mutex_unlock(&launchMutex);
     } catch(runtime_error &e) {
         std::cout << "caught runtime error " << e.what() << std::endl;
         throw e;
     }
 }
 
+void launchKernel(
+        char **launchSite, const char *kernelName, const char *deviceIr, int64_t deviceIrSize,
+        const CoclKernelArgDesc *args, int32_t numArgs) {
+    // everything patch_hostside knows about a launch, in one call: the site, then the args,
+    // packed by patch_hostside onto the host stack, then the launch itself
+    configureKernelSite(launchSite, kernelName, deviceIr, deviceIrSize);
+    for(int i = 0; i < numArgs; i++) {
+        const CoclKernelArgDesc &arg = args[i];
+        switch(arg.kind) {
+            case COCL_ARG_INT8:
+                setKernelArgInt8((char)arg.value);
+                break;
+            case COCL_ARG_INT32:
+                setKernelArgInt32((int32_t)arg.value);
+                break;
+            case COCL_ARG_INT64:
+                setKernelArgInt64(arg.value);
+                break;
+            case COCL_ARG_FLOAT: {
+                uint32_t bits = (uint32_t)arg.value;
+                float value;
+                memcpy(&value, &bits, sizeof(value));
+                setKernelArgFloat(value);
+                break;
+            }
+            case COCL_ARG_GPU_BUFFER:
+                setKernelArgGpuBuffer((char *)(uintptr_t)arg.value, arg.size);
+                break;
+            case COCL_ARG_HOSTSIDE_BUFFER:
+                setKernelArgHostsideBuffer((char *)(uintptr_t)arg.value, arg.size);
+                break;
+            default:
+                throw runtime_error("launchKernel: unknown kernel arg kind " + easycl::toString(arg.kind)
+                    + " for kernel " + kernelName);
+        }
+    }
+    kernelGo();
+}
+
 MyClass hostsidefuncs(__FILE__);
@@ -18,12 +18,28 @@
 
 #include "cocl/ir-to-opencl-common.h"
 #include "cocl/kernel_dumper.h"
+#include "cocl/cocl_diskcache.h"
+#include "EasyCL/util/easycl_stringhelper.h"
 
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Error.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <cstdlib>
+
+using namespace std;
 
 
 namespace cocl {
@@ -37,23 +53,173 @@ ModuleClRes convertModuleToCl(
     ModuleClRes res;
     res.clSourcecode = cl;
     res.usesVmem = kernelDumper.usesVmem;
-    res.usesScratch = kernelDumper.usesScratch;
+    res.scratchBytesPerThread = kernelDumper.scratchBytesPerThread;
+    res.usesDynamicShared = kernelDumper.usesDynamicShared;
     return res;
 }
 
-ModuleClRes convertLlStringToCl(
-        int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, std::string llString, std::string specificFunction, std::string generatedName,
-        bool offsets_32bit) {
-    llvm::StringRef llStringRef(llString);
-    std::unique_ptr<llvm::MemoryBuffer> llMemoryBuffer = llvm::MemoryBuffer::getMemBuffer(llStringRef);
+// A parsed device module, kept around so that generating another variant of a kernel (eg for a
+// different clmem aliasing), or another kernel from the same module, doesnt parse the IR again.
+// Bitcode is loaded lazily: function bodies are only materialized once some kernel's call graph
+// reaches them. Text IR cant be loaded lazily, so is parsed in full, once.
+// LLVMContext isnt thread-safe, so each module has its own context, guarded by mutex
+class ParsedDeviceModule {
+public:
+    std::mutex mutex;
     llvm::LLVMContext context;
+    std::unique_ptr<llvm::Module> M;
+    long long lastUsed = 0;
+};
+
+static std::mutex parsedModulesMutex;
+static std::map<std::string, std::shared_ptr<ParsedDeviceModule> > parsedModuleByKey;
+static long long parsedModulesClock = 0;
+
+static int getMaxParsedModules() {
+    static int maxParsedModules = -1;
+    if(maxParsedModules == -1) {
+        maxParsedModules = 16;
+        if(getenv("COCL_MAX_PARSED_MODULES") != 0) {
+            maxParsedModules = atoi(getenv("COCL_MAX_PARSED_MODULES"));
+        }
+    }
+    return maxParsedModules;
+}
+
+static std::shared_ptr<ParsedDeviceModule> getParsedDeviceModule(const std::string &llString) {
+    // hashing is cheap compared to parsing; the size is in the key too, so a collision would
+    // need both to match
+    std::string key = hashToHex(fnv1a(llString)) + "-" + easycl::toString(llString.size());
+    std::shared_ptr<ParsedDeviceModule> parsed;
+    {
+        std::lock_guard< std::mutex > guard(parsedModulesMutex);
+        auto it = parsedModuleByKey.find(key);
+        if(it != parsedModuleByKey.end()) {
+            it->second->lastUsed = ++parsedModulesClock;
+            return it->second;
+        }
+        parsed.reset(new ParsedDeviceModule());
+        parsed->lastUsed = ++parsedModulesClock;
+        int maxParsedModules = getMaxParsedModules();
+        if(maxParsedModules > 0) {
+            // evict the least recently used. Anyone still converting from it holds a shared_ptr,
+            // so it lives until they are done
+            while((int)parsedModuleByKey.size() >= maxParsedModules) {
+                auto oldest = parsedModuleByKey.begin();
+                for(auto it2 = parsedModuleByKey.begin(); it2 != parsedModuleByKey.end(); it2++) {
+                    if(it2->second->lastUsed < oldest->second->lastUsed) {
+                        oldest = it2;
+                    }
+                }
+                parsedModuleByKey.erase(oldest);
+            }
+            parsedModuleByKey[key] = parsed;
+        }
+        // we parse under parsed->mutex, below, so threads wanting the same module wait for one parse
+        // rather than each doing their own
+        parsed->mutex.lock();
+    }
+    std::lock_guard< std::mutex > parsedGuard(parsed->mutex, std::adopt_lock);
+    std::unique_ptr<llvm::MemoryBuffer> llMemoryBuffer = llvm::MemoryBuffer::getMemBufferCopy(llString);
     llvm::SMDiagnostic smDiagnostic;
-    std::unique_ptr<llvm::Module> M = parseIR(llMemoryBuffer->getMemBufferRef(), smDiagnostic,
-                                context);
-    if(!M) {
+    parsed->M = getLazyIRModule(std::move(llMemoryBuffer), smDiagnostic, parsed->context);
+    if(!parsed->M) {
         smDiagnostic.print("irtopencl", llvm::errs());
+    } else if(llvm::Error err = parsed->M->materializeMetadata()) {
+        // named metadata gets copied along with the module, so load it now
+        llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "irtopencl: ");
+        parsed->M.reset();
+    }
+    if(!parsed->M) {
+        std::lock_guard< std::mutex > guard(parsedModulesMutex);
+        auto it = parsedModuleByKey.find(key);
+        if(it != parsedModuleByKey.end() && it->second == parsed) {
+            parsedModuleByKey.erase(it);
+        }
+        throw std::runtime_error("failed to parse IR");
+    }
+    return parsed;
+}
+
+static void addReferencedGlobals(llvm::Value *value, std::set<llvm::Value *> &seen, std::vector<llvm::GlobalValue *> &todo) {
+    // globals can hide inside constant expressions (bitcasts, geps) and aggregate initializers
+    if(seen.find(value) != seen.end()) {
+        return;
+    }
+    seen.insert(value);
+    if(llvm::GlobalValue *global = llvm::dyn_cast<llvm::GlobalValue>(value)) {
+        todo.push_back(global);
+        return;
+    }
+    if(llvm::Constant *constant = llvm::dyn_cast<llvm::Constant>(value)) {
+        for(auto it = constant->op_begin(); it != constant->op_end(); it++) {
+            addReferencedGlobals(it->get(), seen, todo);
+        }
+    }
+}
+
+static void materializeCallGraph(llvm::Module *M, std::string kernelName) {
+    // materialize the kernel, and everything it reaches, transitively. Anything already
+    // materialized by an earlier kernel is just walked again, which is cheap
+    llvm::Function *kernel = M->getFunction(kernelName);
+    if(kernel == 0) {
+        throw runtime_error("Couldnt find kernel " + kernelName);
+    }
+    std::set<llvm::Value *> seen;
+    std::vector<llvm::GlobalValue *> todo;
+    addReferencedGlobals(kernel, seen, todo);
+    while(todo.size() > 0) {
+        llvm::GlobalValue *global = todo.back();
+        todo.pop_back();
+        if(llvm::GlobalVariable *var = llvm::dyn_cast<llvm::GlobalVariable>(global)) {
+            if(var->hasInitializer()) {
+                addReferencedGlobals(var->getInitializer(), seen, todo);
+            }
+            continue;
+        }
+        llvm::Function *F = llvm::dyn_cast<llvm::Function>(global);
+        if(F == 0) {
+            continue;
+        }
+        if(F->isMaterializable()) {
+            if(llvm::Error err = F->materialize()) {
+                llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "irtopencl: ");
+                throw std::runtime_error("failed to materialize " + F->getName().str());
+            }
+        }
+        for(auto it = llvm::inst_begin(F); it != llvm::inst_end(F); it++) {
+            for(auto opIt = it->op_begin(); opIt != it->op_end(); opIt++) {
+                if(llvm::isa<llvm::Constant>(opIt->get())) {
+                    addReferencedGlobals(opIt->get(), seen, todo);
+                }
+            }
+        }
+    }
+}
+
+ModuleClRes convertLlStringToCl(
+        int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, std::string llString, std::string specificFunction, std::string generatedName,
+        bool offsets_32bit) {
+    std::shared_ptr<ParsedDeviceModule> parsed = getParsedDeviceModule(llString);
+    std::lock_guard< std::mutex > parsedGuard(parsed->mutex);
+    if(!parsed->M) {
+        // we were waiting on someone elses parse, and it failed
         throw std::runtime_error("failed to parse IR");
     }
+    materializeCallGraph(parsed->M.get(), specificFunction);
+    // conversion renames functions, and rewrites IR, so work on a copy. Functions still
+    // unmaterialized are copied as declarations; the kernel doesnt reach them anyway.
+    // The copy shares parsed->context, so we keep holding parsed->mutex until we are done with it
+    llvm::ValueToValueMapTy valueMap;
+    auto shouldCloneDefinition = [](const llvm::GlobalValue *global) {
+        const llvm::Function *F = llvm::dyn_cast<llvm::Function>(global);
+        return F == 0 || !F->isMaterializable();
+    };
+#if LLVM_VERSION_MAJOR >= 7
+    std::unique_ptr<llvm::Module> M = llvm::CloneModule(*parsed->M, valueMap, shouldCloneDefinition);
+#else
+    std::unique_ptr<llvm::Module> M = llvm::CloneModule(parsed->M.get(), valueMap, shouldCloneDefinition);
+#endif
     ModuleClRes res = convertModuleToCl(uniqueClmemCount, clmemIndexByClmemArgIndex, M.get(), specificFunction, generatedName, offsets_32bit);
     return res;
 }
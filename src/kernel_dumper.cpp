@@ -20,9 +20,12 @@
 #include "cocl/type_dumper.h"
 #include "cocl/function_dumper.h"
 #include "cocl/mutations.h"
+#include "cocl/ClWriter.h"
+#include "cocl/new_instruction_dumper.h"
 #include "EasyCL/util/easycl_stringhelper.h"
 
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
 
 #include <stdexcept>
 #include <iostream>
@@ -49,6 +52,73 @@ static std::string createShortKernelName(string origName, std::set<std::string>
     return name;
 }
 
+static bool isUsedFrom(Value *value, const std::set<Function *> &functions) {
+    // looks through constant expressions, eg getelementptrs and bitcasts of globals
+    for(auto it = value->user_begin(); it != value->user_end(); it++) {
+        User *user = *it;
+        if(Instruction *inst = dyn_cast<Instruction>(user)) {
+            if(functions.find(inst->getParent()->getParent()) != functions.end()) {
+                return true;
+            }
+        } else if(isa<ConstantExpr>(user) && isUsedFrom(user, functions)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::set<Function *> getReachableFunctions(Function *kernel) {
+    // the kernel declaration needs to know which local buffers the kernel takes, before we dump
+    // anything, so we walk the call graph up front
+    std::set<Function *> reachable;
+    std::vector<Function *> toVisit;
+    reachable.insert(kernel);
+    toVisit.push_back(kernel);
+    while(toVisit.size() > 0) {
+        Function *F = toVisit.back();
+        toVisit.pop_back();
+        for(auto bit = F->begin(); bit != F->end(); bit++) {
+            for(auto iit = bit->begin(); iit != bit->end(); iit++) {
+                CallInst *call = dyn_cast<CallInst>(&*iit);
+                if(call == 0) {
+                    continue;
+                }
+                Function *callee = call->getCalledFunction();
+                if(callee != 0 && !callee->isDeclaration() && reachable.insert(callee).second) {
+                    toVisit.push_back(callee);
+                }
+            }
+        }
+    }
+    return reachable;
+}
+
+static int getScratchBytesPerThread(const std::set<Function *> &reachable) {
+    int scratchBytesPerThread = 0;
+    for(auto fit = reachable.begin(); fit != reachable.end(); fit++) {
+        for(auto bit = (*fit)->begin(); bit != (*fit)->end(); bit++) {
+            for(auto iit = bit->begin(); iit != bit->end(); iit++) {
+                if(CallInst *call = dyn_cast<CallInst>(&*iit)) {
+                    std::string functionName = call->getCalledValue()->getName().str();
+                    scratchBytesPerThread = std::max(
+                        scratchBytesPerThread, NewInstructionDumper::getScratchBytesPerThread(functionName));
+                }
+            }
+        }
+    }
+    return scratchBytesPerThread;
+}
+
+static bool usesDynamicSharedMemory(Module *M, const std::set<Function *> &reachable) {
+    for(auto it = M->global_begin(); it != M->global_end(); it++) {
+        GlobalVariable *global = &*it;
+        if(isDynamicSharedMemory(global) && isUsedFrom(global, reachable)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 std::string KernelDumper::toCl(int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex) {
     Function *F = M->getFunction(kernelName);
     if(F == 0) {
@@ -94,6 +164,9 @@ std::string KernelDumper::toCl(int uniqueClmemCount, std::vector<int> &clmemInde
 
     isKernel.insert(F);
     neededFunctions.insert(F);
+    std::set<Function *> reachable = getReachableFunctions(F);
+    scratchBytesPerThread = getScratchBytesPerThread(reachable);
+    usesDynamicShared = usesDynamicSharedMemory(M, reachable);
 
     int nothingHappenedCount = 0;
     while(returnTypeByFunction.size() < neededFunctions.size()) {
@@ -122,6 +195,12 @@ std::string KernelDumper::toCl(int uniqueClmemCount, std::vector<int> &clmemInde
             if(_addIRToCl) {
                 childFunctionDumper.addIRToCl();
             }
+            if(_isKernel && scratchBytesPerThread > 0) {
+                childFunctionDumper.addScratchArg();
+            }
+            if(_isKernel && usesDynamicShared) {
+                childFunctionDumper.addDynamicSharedArg();
+            }
             if(!childFunctionDumper.runGeneration(returnTypeByFunction)) {
                 neededFunctions.insert(childFunctionDumper.neededFunctions.begin(), childFunctionDumper.neededFunctions.end());
                 continue;
@@ -129,8 +208,9 @@ std::string KernelDumper::toCl(int uniqueClmemCount, std::vector<int> &clmemInde
             if(childFunctionDumper.usesVmem) {
                 this->usesVmem = true;
             }
-            if(childFunctionDumper.usesScratch) {
-                this->usesScratch = true;
+            if(childFunctionDumper.usesScratch && scratchBytesPerThread == 0) {
+                cout << "ERROR: " << origName << " uses scratch, but the kernel doesnt take any" << endl;
+                throw runtime_error("function " + origName + " uses scratch, but the kernel doesnt take any");
             }
 
             returnTypeByFunction[childF] = childFunctionDumper.returnType;
@@ -170,6 +250,10 @@ std::string KernelDumper::toCl(int uniqueClmemCount, std::vector<int> &clmemInde
         typeDumper->structsToDefine.insert(*it);
     }
 
+    // segment table: each clmem covers the vmem range starting at its clmem_vmem_offset, so a
+    // vmemloc belongs to the clmem with the highest offset not above it. There are only ever a
+    // handful of clmems, so a linear scan is cheaper than anything cleverer
+    int numSegments = uniqueClmemCount > 0 ? uniqueClmemCount : 1;
     functionDeclarationsStream << R"(// __vmem__ is just a marker, so we can see which bits are vmems
 // It doesnt actually do anything; compiler ignores it
 #define __vmem__
@@ -177,17 +261,36 @@ std::string KernelDumper::toCl(int uniqueClmemCount, std::vector<int> &clmemInde
 // vmem2 is a pointer to a pointer (so we have to unwrap twice)
 #define __vmem2__
 
+#define NUM_CLMEMS )" << numSegments << R"(
+
 struct GlobalVars {
     local int *scratch;
-    global char *clmem0;
-    unsigned long clmem_vmem_offset0;
+    local char *dynamicShared; // extern __shared__ arrays, or 0 if the kernel has none
+    global char *clmems[NUM_CLMEMS];
+    unsigned long clmem_vmem_offsets[NUM_CLMEMS];
 };
 
-inline global float *getGlobalPointer(__vmem__ unsigned long vmemloc, const struct GlobalVars* const globalVars) {
-    return (global float *)(globalVars->clmem0 + vmemloc - globalVars->clmem_vmem_offset0);
+)";
+    if(numSegments == 1) {
+        functionDeclarationsStream << R"(inline global float *getGlobalPointer(__vmem__ unsigned long vmemloc, const struct GlobalVars* const globalVars) {
+    return (global float *)(globalVars->clmems[0] + vmemloc - globalVars->clmem_vmem_offsets[0]);
 }
 
 )";
+    } else {
+        functionDeclarationsStream << R"(inline global float *getGlobalPointer(__vmem__ unsigned long vmemloc, const struct GlobalVars* const globalVars) {
+    int segment = 0;
+    for(int i = 1; i < NUM_CLMEMS; i++) {
+        unsigned long offset = globalVars->clmem_vmem_offsets[i];
+        if(offset <= vmemloc && (offset > globalVars->clmem_vmem_offsets[segment] || globalVars->clmem_vmem_offsets[segment] > vmemloc)) {
+            segment = i;
+        }
+    }
+    return (global float *)(globalVars->clmems[segment] + vmemloc - globalVars->clmem_vmem_offsets[segment]);
+}
+
+)";
+    }
 
     functionDeclarationsStream << typeDumper->dumpStructDefinitions() << "\n";
 
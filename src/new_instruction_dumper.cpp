@@ -725,6 +725,34 @@ void NewInstructionDumper::dumpMemcpy(LocalValueInfo *localValueInfo, int align)
     }
 }
 
+// calls we write as a shim taking the scratch local memory, and how much of it each workitem
+// needs. Used both to size scratch, before dumping, and to dump the calls themselves
+class ScratchShim {
+public:
+    const char *functionName;
+    const char *shimName;
+    int bytesPerThread;
+};
+static const ScratchShim scratchShims[] = {
+    // __shfl_down_3 exchanges values through one float per workitem; __shfl_down_2 calls it
+    { "_Z11__shfl_downIfET_S0_ii", "__shfl_down_3", sizeof(float) },
+    { "_Z11__shfl_downIfET_S0_i", "__shfl_down_2", sizeof(float) },
+};
+
+static const ScratchShim *findScratchShim(const std::string &functionName) {
+    for(size_t i = 0; i < sizeof(scratchShims) / sizeof(scratchShims[0]); i++) {
+        if(functionName == scratchShims[i].functionName) {
+            return &scratchShims[i];
+        }
+    }
+    return 0;
+}
+
+int NewInstructionDumper::getScratchBytesPerThread(std::string functionName) {
+    const ScratchShim *scratchShim = findScratchShim(functionName);
+    return scratchShim == 0 ? 0 : scratchShim->bytesPerThread;
+}
+
 void NewInstructionDumper::writeShimCall(LocalValueInfo *localValueInfo, std::string shimName, std::string extraArgs, CallInst *instr) {
     // this probalby assumes:
     // - returns a primitive
@@ -854,12 +882,8 @@ void NewInstructionDumper::dumpCall(LocalValueInfo *localValueInfo, const std::m
     } else if(functionName == "_Z9atomicIncPjj") {
         writeShimCall(localValueInfo, "__atomic_inc_uint", "", instr);
         return;
-    } else if(functionName == "_Z11__shfl_downIfET_S0_ii") {
-        writeShimCall(localValueInfo, "__shfl_down_3", "pGlobalVars->scratch, ", instr);
-        this->usesScratch = true;
-        return;
-    } else if(functionName == "_Z11__shfl_downIfET_S0_i") {
-        writeShimCall(localValueInfo, "__shfl_down_2", "pGlobalVars->scratch, ", instr);
+    } else if(const ScratchShim *scratchShim = findScratchShim(functionName)) {
+        writeShimCall(localValueInfo, scratchShim->shimName, "pGlobalVars->scratch, ", instr);
         this->usesScratch = true;
         return;
     } else if(functionName == "llvm.lifetime.start") {
@@ -15,6 +15,7 @@
 // For doc, please see the corresponding include file, patch_hostside.h
 
 #include "cocl/patch_hostside.h"
+#include "cocl/cocl_kernellaunch.h"
 
 #include "cocl/cocl_logging.h"
 #include "cocl/llvm_dump.h"
@@ -27,6 +28,10 @@
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IR/Type.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_os_ostream.h"
@@ -37,6 +42,7 @@
 #include <fstream>
 #include <sstream>
 #include <memory>
+#include <map>
 
 using namespace llvm;
 using namespace std;
@@ -47,6 +53,9 @@ namespace cocl {
 static llvm::LLVMContext context;
 static std::string devicellcode_stringname;
 static string devicellfilename;
+// if true, embed the whole device .ll as text, and pass that to configureKernelSite, as we used to.
+// Otherwise each kernel gets its own bitcode slice
+static bool embedDeviceLlText = false;
 
 static GlobalNames globalNames;
 static TypeDumper typeDumper(&globalNames);
@@ -117,37 +126,42 @@ std::ostream &operator<<(std::ostream &os, const PointerInfo &pointerInfo) {
     return os;
 }
 
-llvm::Instruction *PatchHostside::addSetKernelArgInst_int(llvm::Instruction *lastInst, llvm::Value *value, llvm::IntegerType *intType) {
-    Module *M = lastInst->getModule();
+llvm::Instruction *PatchHostside::addPackedKernelArg(llvm::Instruction *lastInst, int kind, int size, llvm::Value *value) {
+    // widens value to the i64 value field of a CoclKernelArgDesc, and queues it up, for
+    // patchCudaLaunch to store into the launch's descriptor array
+    Type *int64Type = IntegerType::get(context, 64);
+    if(value->getType()->isPointerTy()) {
+        Instruction *ptrToInt = new PtrToIntInst(value, int64Type);
+        ptrToInt->insertAfter(lastInst);
+        lastInst = ptrToInt;
+        value = ptrToInt;
+    } else if(value->getType() != int64Type) {
+        Instruction *cast = CastInst::CreateIntegerCast(value, int64Type, kind != COCL_ARG_FLOAT);
+        cast->insertAfter(lastInst);
+        lastInst = cast;
+        value = cast;
+    }
+    launchCallInfo->packedArgs.push_back(PackedKernelArg(kind, size, value));
+    return lastInst;
+}
 
+llvm::Instruction *PatchHostside::addSetKernelArgInst_int(llvm::Instruction *lastInst, llvm::Value *value, llvm::IntegerType *intType) {
     int bitLength = intType->getBitWidth();
-    string mangledName = "";
+    int kind = 0;
     if(bitLength == 32) {
-        mangledName = "setKernelArgInt32";
+        kind = COCL_ARG_INT32;
     } else if(bitLength == 64) {
-        mangledName = "setKernelArgInt64";
+        kind = COCL_ARG_INT64;
     } else if(bitLength == 8) {
-        mangledName = "setKernelArgInt8";
+        kind = COCL_ARG_INT8;
     } else {
         throw std::runtime_error("bitlength " + easycl::toString(bitLength) + " not implemented");
     }
-
-    Function *setKernelArgInt = cast<Function>(getOrInsertFunction(
-        M,
-        mangledName,
-        Type::getVoidTy(context),
-        IntegerType::get(context, bitLength)));
-
-    CallInst *call = CallInst::Create(setKernelArgInt, value);
-    call->insertAfter(lastInst);
-    lastInst = call;
-    return lastInst;
+    return addPackedKernelArg(lastInst, kind, bitLength / 8, value);
 }
 
 llvm::Instruction *PatchHostside::addSetKernelArgInst_float(llvm::Instruction *lastInst, llvm::Value *value) {
-    // handle primitive floats, which we pass to `setKernelArgFloat`, by value
-
-    Module *M = lastInst->getModule();
+    // handle primitive floats, which we pass by value
 
     Type *valueType = value->getType();
     if(valueType->isDoubleTy()) {
@@ -157,15 +171,11 @@ llvm::Instruction *PatchHostside::addSetKernelArgInst_float(llvm::Instruction *l
         throw runtime_error("Executing functions with doubles as kernel parameters is not supported");
     }
 
-    Function *setKernelArgFloat = cast<Function>(getOrInsertFunction(
-        M,
-        "setKernelArgFloat",
-        Type::getVoidTy(context),
-        Type::getFloatTy(context)));
-
-    CallInst *call = CallInst::Create(setKernelArgFloat, value);
-    call->insertAfter(lastInst);
-    return call;
+    // the descriptor carries the float's bits
+    BitCastInst *bitcast = new BitCastInst(value, IntegerType::get(context, 32));
+    bitcast->insertAfter(lastInst);
+    lastInst = bitcast;
+    return addPackedKernelArg(lastInst, COCL_ARG_FLOAT, 4, bitcast);
 }
 
 llvm::Instruction *PatchHostside::addSetKernelArgInst_pointer(llvm::Instruction *lastInst, llvm::Value *value) {
@@ -189,18 +199,7 @@ llvm::Instruction *PatchHostside::addSetKernelArgInst_pointer(llvm::Instruction
     int allocSize = dataLayout->getTypeAllocSize(elementType);
     int32_t elementSize = allocSize;
 
-    Function *setKernelArgGpuBuffer = cast<Function>(getOrInsertFunction(
-        M,
-        "setKernelArgGpuBuffer",
-        Type::getVoidTy(context),
-        PointerType::get(IntegerType::get(context, 8), 0),
-        IntegerType::get(context, 32)));
-
-    Value *args[] = {bitcast, createInt32Constant(&context, elementSize)};
-    CallInst *call = CallInst::Create(setKernelArgGpuBuffer, ArrayRef<Value *>(args));
-    call->insertAfter(lastInst);
-    lastInst = call;
-    return lastInst;
+    return addPackedKernelArg(lastInst, COCL_ARG_GPU_BUFFER, elementSize, bitcast);
 }
 
 llvm::Instruction *PatchHostside::addSetKernelArgInst_pointerstruct(llvm::Instruction *lastInst, llvm::Value *structPointer) {
@@ -250,26 +249,11 @@ llvm::Instruction *PatchHostside::addSetKernelArgInst_byvaluevector(llvm::Instru
 
     int allocSize = elementSizeBytes * elementCount;
 
-    Module *M = lastInst->getModule();
-
     BitCastInst *bitcast = new BitCastInst(vectorPointer, PointerType::get(IntegerType::get(context, 8), 0));
     bitcast->insertAfter(lastInst);
     lastInst = bitcast;
 
-    Value *args[2];
-    args[0] = bitcast;
-    args[1] = createInt32Constant(&context, allocSize);
-
-    Function *setKernelArgHostsideBuffer = cast<Function>(getOrInsertFunction(
-        M,
-        "setKernelArgHostsideBuffer",
-        Type::getVoidTy(context),
-        PointerType::get(IntegerType::get(context, 8), 0),
-        IntegerType::get(context, 32)));
-
-    CallInst *call = CallInst::Create(setKernelArgHostsideBuffer, ArrayRef<Value *>(args));
-    call->insertAfter(lastInst);
-    lastInst = call;
+    lastInst = addPackedKernelArg(lastInst, COCL_ARG_HOSTSIDE_BUFFER, allocSize, bitcast);
 
     return lastInst;
 }
@@ -336,20 +320,7 @@ llvm::Instruction *PatchHostside::addSetKernelArgInst_byvaluestruct(llvm::Instru
     bitcast->insertAfter(lastInst);
     lastInst = bitcast;
 
-    Value *args[2];
-    args[0] = bitcast;
-    args[1] = createInt32Constant(&context, allocSize);
-
-    Function *setKernelArgHostsideBuffer = cast<Function>(getOrInsertFunction(
-        M,
-        "setKernelArgHostsideBuffer",
-        Type::getVoidTy(context),
-        PointerType::get(IntegerType::get(context, 8), 0),
-        IntegerType::get(context, 32)));
-
-    CallInst *call = CallInst::Create(setKernelArgHostsideBuffer, ArrayRef<Value *>(args));
-    call->insertAfter(lastInst);
-    lastInst = call;
+    lastInst = addPackedKernelArg(lastInst, COCL_ARG_HOSTSIDE_BUFFER, allocSize, bitcast);
 
     // now we have to handle any pointers, send those through too
     int i = 0;
@@ -446,19 +417,90 @@ void PatchHostside::getLaunchArgValue(GenericCallInst *inst, LaunchCallInfo *inf
         outs() << "\n";
         throw runtime_error("getlaunchvalue, first operatnd of inst is not an instruction...");
     }
-    Instruction *bitcast = cast<Instruction>(inst->getOperand(0));
-    Value *alloca = bitcast;
-    if(isa<BitCastInst>(bitcast)) {
+    PatchHostside::getLaunchArgValueFromPointer(inst->getOperand(0), inst->getInst(), paramInfo);
+}
+
+void PatchHostside::getLaunchArgValueFromPointer(llvm::Value *argPointer, llvm::Instruction *insertBefore, ParamInfo *paramInfo) {
+    Value *alloca = argPointer;
+    if(BitCastInst *bitcast = dyn_cast<BitCastInst>(argPointer)) {
         alloca = bitcast->getOperand(0);
-    } else {
-        alloca = bitcast;
     }
     Instruction *load = new LoadInst(alloca, "loadCudaArg");
-    load->insertBefore(inst->getInst());
+    load->insertBefore(insertBefore);
     paramInfo->value = load;
     paramInfo->pointer = alloca;
 }
 
+void PatchHostside::getLaunchKernelArgs(GenericCallInst *inst, LaunchCallInfo *info) {
+    // the operands of cudaLaunchKernel are: the kernel, then grid and block, which the ABI may have
+    // split into several operands each, then the args array, sharedMem, and the stream
+    Indentor indentor;
+    int numOperands = inst->getNumArgOperands();
+    int argsOperand = numOperands - 3;
+    Value *argsArray = inst->getArgOperand(argsOperand)->stripPointerCasts();
+
+    // the caller fills in argsArray[i] with a pointer to arg i, before the call. We find those stores,
+    // following geps into the array, eg getelementptr i8*, i8** %kernel_args, i64 1, and geps off
+    // those geps, as in clang's initialization of a local void *args[] = {...}
+    const DataLayout *dataLayout = &inst->getModule()->getDataLayout();
+    int pointerSize = dataLayout->getPointerSize();
+    std::map<int, Value *> argPointerByIndex;
+    vector<pair<Value *, int> > toVisit; // pointers into argsArray, and the index each points at
+    toVisit.push_back(pair<Value *, int>(argsArray, 0));
+    while(!toVisit.empty()) {
+        Value *pointer = toVisit.back().first;
+        int index = toVisit.back().second;
+        toVisit.pop_back();
+        for(auto it = pointer->user_begin(); it != pointer->user_end(); it++) {
+            User *user = *it;
+            if(StoreInst *store = dyn_cast<StoreInst>(user)) {
+                if(store->getPointerOperand() == pointer) {
+                    argPointerByIndex[index] = store->getValueOperand();
+                }
+            } else if(GetElementPtrInst *gep = dyn_cast<GetElementPtrInst>(user)) {
+                APInt offset(dataLayout->getPointerSizeInBits(), 0);
+                if(gep->getPointerOperand() == pointer && gep->accumulateConstantOffset(*dataLayout, offset)) {
+                    toVisit.push_back(pair<Value *, int>(gep, index + (int)(offset.getSExtValue() / pointerSize)));
+                }
+            }
+        }
+    }
+    for(int i = 0; i < (int)argPointerByIndex.size(); i++) {
+        if(argPointerByIndex.find(i) == argPointerByIndex.end()) {
+            cout << "ERROR: cudaLaunchKernel: couldnt find where kernel arg " << i << " is stored into the args array" << endl;
+            inst->dump();
+            throw runtime_error("cudaLaunchKernel: couldnt find where kernel arg " + easycl::toString(i) + " is stored into the args array");
+        }
+        unique_ptr<ParamInfo> paramInfo(new ParamInfo());
+        PatchHostside::getLaunchArgValueFromPointer(argPointerByIndex[i], inst->getInst(), paramInfo.get());
+        paramInfo->size = dataLayout->getTypeAllocSize(paramInfo->value->getType());
+        info->params.push_back(std::move(paramInfo));
+    }
+
+    // cudaConfigureCall takes grid, block, sharedMem and stream in the same way, so we can pass
+    // the operands straight through, however the ABI split them up
+    Type *charPtrType = PointerType::get(IntegerType::get(context, 8), 0);
+    vector<Value *> configureArgs;
+    vector<Type *> configureArgTypes;
+    for(int i = 1; i < numOperands; i++) {
+        if(i == argsOperand) {
+            continue;
+        }
+        Value *operand = inst->getArgOperand(i);
+        if(i == numOperands - 1) {
+            BitCastInst *streamAsCharStar = new BitCastInst(operand, charPtrType, "stream");
+            streamAsCharStar->insertBefore(inst->getInst());
+            operand = streamAsCharStar;
+        }
+        configureArgs.push_back(operand);
+        configureArgTypes.push_back(operand->getType());
+    }
+    FunctionType *configureCallType = FunctionType::get(IntegerType::get(context, 32), configureArgTypes, false);
+    Function *cudaConfigureCall = cast<Function>(inst->getModule()->getOrInsertFunction("cudaConfigureCall", configureCallType));
+    CallInst *configureCall = CallInst::Create(cudaConfigureCall, configureArgs);
+    configureCall->insertBefore(inst->getInst());
+}
+
 void PatchHostside::getLaunchTypes(
         llvm::Module *M, const llvm::Module *MDevice, GenericCallInst *inst, LaunchCallInfo *info) {
     // input to this is a cudaLaunch instruction
@@ -533,46 +575,110 @@ void PatchHostside::patchCudaLaunch(
     Instruction *kernelNameValue = addStringInstr(M, "s_" + ::devicellcode_stringname + "_" + kernelName, kernelName);
     kernelNameValue->insertBefore(inst->getInst());
 
-    // this isnt actually needed for running, but hopefully useful for debugging
-    Instruction *llSourcecodeValue = addStringInstrExistingGlobal(M, devicellcode_stringname);
-    llSourcecodeValue->insertBefore(inst->getInst());
-
-    Function *configureKernel = cast<Function>(getOrInsertFunction(
-        F->getParent(),
-        "configureKernel",
-        Type::getVoidTy(context),
-        PointerType::get(IntegerType::get(context, 8), 0),
-        PointerType::get(IntegerType::get(context, 8), 0)
-        // PointerType::get(IntegerType::get(context, 8), 0),
-        ));
-
-    Value *args[] = {kernelNameValue, llSourcecodeValue};
-    CallInst *callConfigureKernel = CallInst::Create(configureKernel, ArrayRef<Value *>(&args[0], &args[2]));
-    callConfigureKernel->insertBefore(inst->getInst());
-    Instruction *lastInst = callConfigureKernel;
+    // each launch site gets its own slot, which the runtime fills in on the first launch, with
+    // the resolved kernel, so later launches from here can skip looking the kernel up by name
+    Type *charPtrType = PointerType::get(IntegerType::get(context, 8), 0);
+    GlobalVariable *launchSite = new GlobalVariable(
+        *M, charPtrType, false, GlobalValue::InternalLinkage, ConstantPointerNull::get(cast<PointerType>(charPtrType)),
+        "__cocl_launchsite_" + kernelName);
+
+    Instruction *deviceIrValue = 0;
+    int64_t deviceIrSize = -1; // null-terminated text
+    if(embedDeviceLlText) {
+        deviceIrValue = addStringInstrExistingGlobal(M, devicellcode_stringname);
+    } else {
+        // each launch site of the same kernel shares the one slice
+        string bitcodeName = "__devicebc_" + kernelName;
+        if(GlobalVariable *existing = M->getNamedGlobal(bitcodeName)) {
+            deviceIrSize = cast<ArrayType>(existing->getValueType())->getNumElements() - 1;
+            deviceIrValue = addStringInstrExistingGlobal(M, bitcodeName);
+        } else {
+            string bitcode = PatchHostside::getKernelBitcode(MDevice, kernelName);
+            deviceIrSize = bitcode.size();
+            deviceIrValue = addStringInstr(M, bitcodeName, bitcode);
+            GlobalVariable *bitcodeGlobal = M->getNamedGlobal(bitcodeName);
+            bitcodeGlobal->setConstant(true);
+            bitcodeGlobal->setLinkage(GlobalValue::InternalLinkage);
+        }
+    }
+    deviceIrValue->insertBefore(inst->getInst());
 
-    // pass args now
-    int i = 0;
+    // the args are laid out in an array of CoclKernelArgDesc on the stack, which is handed to
+    // launchKernel, along with the launch site, in a single call
+    Instruction *lastInst = deviceIrValue;
+    launchCallInfo->packedArgs.clear();
     for(auto argit=launchCallInfo->params.begin(); argit != launchCallInfo->params.end(); argit++) {
         ParamInfo *paramInfo = argit->get();
         lastInst = PatchHostside::addSetKernelArgInst(lastInst, paramInfo);
-        i++;
     }
-    // trigger the kernel...
-    Function *kernelGo = cast<Function>(F->getParent()->getOrInsertFunction(
-        "kernelGo",
+
+    Type *int32Type = IntegerType::get(context, 32);
+    Type *int64Type = IntegerType::get(context, 64);
+    Type *argDescFields[] = {int32Type, int32Type, int64Type};
+    StructType *argDescType = StructType::get(context, ArrayRef<Type *>(argDescFields));
+    int numArgs = launchCallInfo->packedArgs.size();
+    Value *argDescs = ConstantPointerNull::get(PointerType::get(argDescType, 0));
+    if(numArgs > 0) {
+        // in the entry block, so a launch inside a loop doesnt grow the stack each time round
+        ArrayType *argDescArrayType = ArrayType::get(argDescType, numArgs);
+        Instruction *entryInst = &*F->getEntryBlock().getFirstInsertionPt();
+#if LLVM_VERSION_MAJOR > 4
+        AllocaInst *argDescArray = new AllocaInst(argDescArrayType, 0, "cocl_kernel_args", entryInst);
+#else
+        AllocaInst *argDescArray = new AllocaInst(argDescArrayType, "cocl_kernel_args", entryInst);
+#endif
+        for(int i = 0; i < numArgs; i++) {
+            PackedKernelArg *packedArg = &launchCallInfo->packedArgs[i];
+            Value *fieldValues[] = {
+                ConstantInt::get(int32Type, packedArg->kind),
+                ConstantInt::get(int32Type, packedArg->size),
+                packedArg->value};
+            for(int field = 0; field < 3; field++) {
+                Value *indices[] = {createInt32Constant(&context, 0), createInt32Constant(&context, i), createInt32Constant(&context, field)};
+                GetElementPtrInst *gep = GetElementPtrInst::CreateInBounds(
+                    argDescArrayType, argDescArray, ArrayRef<Value *>(indices), "cocl_kernel_arg");
+                gep->insertAfter(lastInst);
+                lastInst = gep;
+                StoreInst *store = new StoreInst(fieldValues[field], gep);
+                store->insertAfter(lastInst);
+                lastInst = store;
+            }
+        }
+        Value *indices[] = {createInt32Constant(&context, 0), createInt32Constant(&context, 0)};
+        GetElementPtrInst *firstArgDesc = GetElementPtrInst::CreateInBounds(
+            argDescArrayType, argDescArray, ArrayRef<Value *>(indices), "cocl_kernel_args_begin");
+        firstArgDesc->insertAfter(lastInst);
+        lastInst = firstArgDesc;
+        argDescs = firstArgDesc;
+    }
+
+    Function *launchKernel = cast<Function>(getOrInsertFunction(
+        F->getParent(),
+        "launchKernel",
         Type::getVoidTy(context),
-        NULL));
-    CallInst *kernelGoInst = CallInst::Create(kernelGo);
-    kernelGoInst->insertAfter(lastInst);
-    lastInst = kernelGoInst;
+        PointerType::get(charPtrType, 0),
+        charPtrType,
+        charPtrType,
+        int64Type,
+        PointerType::get(argDescType, 0),
+        int32Type
+        ));
+
+    Value *args[] = {
+        launchSite, kernelNameValue, deviceIrValue, ConstantInt::getSigned(int64Type, deviceIrSize),
+        argDescs, ConstantInt::get(int32Type, numArgs)};
+    CallInst *launchKernelInst = CallInst::Create(launchKernel, ArrayRef<Value *>(args));
+    launchKernelInst->insertAfter(lastInst);
+    lastInst = launchKernelInst;
 
     launchCallInfo->params.clear();
+    launchCallInfo->packedArgs.clear();
 }
 
 void PatchHostside::patchFunction(llvm::Module *M, const llvm::Module *MDevice, llvm::Function *F) {
     // this will take the calls to cudaSetupArgument(someArg, argSize, ...), and
-    // cudaLaunch(function), and rewrite them to call Coriander instead
+    // cudaLaunch(function), or to cudaLaunchKernel(function, grid, block, args, ...), and rewrite
+    // them to call Coriander instead
     // we do a bunch of bytecode parsing, to figure out how exactly we are goign to get the arguments
     // into coriander
     // For example, if it's a by-value struct, we're going to have to do some hacking
@@ -616,6 +722,9 @@ void PatchHostside::patchFunction(llvm::Module *M, const llvm::Module *MDevice,
                 to_replace_with_zero.push_back(inst);
             } else if(calledFunctionName == "cudaLaunch") {
                 PatchHostside::patchCudaLaunch(M, MDevice, F, genCallInst.get(), to_replace_with_zero);
+            } else if(calledFunctionName == "cudaLaunchKernel") {
+                PatchHostside::getLaunchKernelArgs(genCallInst.get(), launchCallInfo.get());
+                PatchHostside::patchCudaLaunch(M, MDevice, F, genCallInst.get(), to_replace_with_zero);
             }
         }
     }
@@ -628,7 +737,9 @@ void PatchHostside::patchFunction(llvm::Module *M, const llvm::Module *MDevice,
             BranchInst *branch = BranchInst::Create(oldTarget);
             branch->insertAfter(inst);
         }
-        ReplaceInstWithValue(inst->getParent()->getInstList(), ii, constzero);
+        // cudaLaunchKernel returns cudaError_t, which isnt necessarily an i32
+        Value *zero = inst->getType() == inttype ? (Value *)constzero : Constant::getNullValue(inst->getType());
+        ReplaceInstWithValue(inst->getParent()->getInstList(), ii, zero);
     }
 }
 
@@ -641,19 +752,69 @@ std::string PatchHostside::getBasename(std::string path) {
     return path.substr(slash_pos + 1);
 }
 
+std::string PatchHostside::getKernelBitcode(const llvm::Module *MDevice, std::string kernelName) {
+    // clone the device module, make everything except the kernel internal, so that
+    // GlobalDCE drops whatever the kernel doesnt (transitively) use, then write what is left
+    // out as bitcode
+#if LLVM_VERSION_MAJOR >= 7
+    std::unique_ptr<Module> slice = CloneModule(*MDevice);
+#else
+    std::unique_ptr<Module> slice = CloneModule(MDevice);
+#endif
+    for(auto it = slice->begin(); it != slice->end(); it++) {
+        Function *F = &*it;
+        if(F->isDeclaration()) {
+            continue;
+        }
+        F->setComdat(nullptr);
+        // the kernel itself might be linkonce_odr, eg a template; GlobalDCE would drop that too
+        F->setLinkage(F->getName() == kernelName ? GlobalValue::ExternalLinkage : GlobalValue::InternalLinkage);
+    }
+    for(auto it = slice->global_begin(); it != slice->global_end(); it++) {
+        GlobalVariable *var = &*it;
+        if(var->isDeclaration()) {
+            continue;
+        }
+        var->setComdat(nullptr);
+        var->setLinkage(GlobalValue::InternalLinkage);
+    }
+    // nvvm.annotations points at every kernel in the module; we dont use it, and it would
+    // otherwise be left holding nulls for the kernels we dropped
+    if(NamedMDNode *annotations = slice->getNamedMetadata("nvvm.annotations")) {
+        slice->eraseNamedMetadata(annotations);
+    }
+    legacy::PassManager passManager;
+    passManager.add(createGlobalDCEPass());
+    passManager.run(*slice);
+    if(slice->getFunction(kernelName) == 0) {
+        throw runtime_error("getKernelBitcode: lost kernel " + kernelName + " while slicing");
+    }
+
+    std::string bitcode;
+    raw_string_ostream bitcodeStream(bitcode);
+#if LLVM_VERSION_MAJOR >= 7
+    WriteBitcodeToFile(*slice, bitcodeStream);
+#else
+    WriteBitcodeToFile(slice.get(), bitcodeStream);
+#endif
+    bitcodeStream.flush();
+    return bitcode;
+}
+
 void PatchHostside::patchModule(Module *M, const Module *MDevice) {
     // entry point: given Module M, traverse all functions, rewriting the launch instructison to call
     // into Coriander runtime
 
     // MDevice is only for information, so we can see the declaration of kernels on the device-side
 
-    ifstream f_inll(::devicellfilename);
-    string devicell_sourcecode(
-        (std::istreambuf_iterator<char>(f_inll)),
-        (std::istreambuf_iterator<char>()));
-
     ::devicellcode_stringname = "__devicell_sourcecode" + ::devicellfilename;
-    addGlobalVariable(M, devicellcode_stringname, devicell_sourcecode);
+    if(embedDeviceLlText) {
+        ifstream f_inll(::devicellfilename);
+        string devicell_sourcecode(
+            (std::istreambuf_iterator<char>(f_inll)),
+            (std::istreambuf_iterator<char>()));
+        addGlobalVariable(M, devicellcode_stringname, devicell_sourcecode);
+    }
 
     for(auto it = M->begin(); it != M->end(); it++) {
         Function *F = &*it;
@@ -674,6 +835,7 @@ int main(int argc, char *argv[]) {
     parser.add_string_argument("--hostrawfile", &rawhostfilename)->required()->help("input file");
     parser.add_string_argument("--devicellfile", &::devicellfilename)->required()->help("input file");
     parser.add_string_argument("--hostpatchedfile", &patchedhostfilename)->required()->help("output file");
+    parser.add_bool_argument("--embed_device_ll", &::embedDeviceLlText)->help("embed the whole device .ll as text, rather than per-kernel bitcode");
     if(!parser.parse_args(argc, argv)) {
         return -1;
     }
@@ -0,0 +1,70 @@
+// measures what event timing costs: streams get profiling queues, so every command carries
+// device timestamps. Run once as is, and once with COCL_EVENT_TIMING=0, and compare the
+// launch rates
+//
+// also prints the device's own timing of each batch, from cudaEventElapsedTime, next to the
+// host's, when event timing is on
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+
+#include <cuda.h>
+
+const int N = 32;
+const int numLaunches = 10000;
+const int numRepeats = 5;
+
+__global__ void increment(float *data, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] += 1.0f;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+    float *gpuFloats;
+    cudaMalloc((void **)&gpuFloats, N * sizeof(float));
+    // warm up, so the kernel compile isnt included in the timings
+    increment<<<dim3(1,1,1), dim3(32,1,1), 0, stream>>>(gpuFloats, N);
+    cudaStreamSynchronize(stream);
+
+    cudaEvent_t start;
+    cudaEvent_t stop;
+    cudaEventCreate(&start);
+    cudaEventCreate(&stop);
+
+    const char *timing = getenv("COCL_EVENT_TIMING");
+    cout << "COCL_EVENT_TIMING=" << (timing == 0 ? "(unset)" : timing) << endl;
+    cout << "repeat\tlaunches_per_sec\thost_us_per_launch\tdevice_us_per_launch" << endl;
+    for(int repeat = 0; repeat < numRepeats; repeat++) {
+        auto hostStart = std::chrono::high_resolution_clock::now();
+        cudaEventRecord(start, stream);
+        for(int i = 0; i < numLaunches; i++) {
+            increment<<<dim3(1,1,1), dim3(32,1,1), 0, stream>>>(gpuFloats, N);
+        }
+        cudaEventRecord(stop, stream);
+        cudaEventSynchronize(stop);
+        auto hostEnd = std::chrono::high_resolution_clock::now();
+        double hostMicroseconds = std::chrono::duration<double, std::micro>(hostEnd - hostStart).count();
+
+        float deviceMilliseconds = 0.0f;
+        cout << repeat << "\t" << (numLaunches / hostMicroseconds * 1000000.0) << "\t"
+            << (hostMicroseconds / numLaunches) << "\t";
+        if(cudaEventElapsedTime(&deviceMilliseconds, start, stop) == cudaSuccess) {
+            cout << (deviceMilliseconds * 1000.0 / numLaunches) << endl;
+        } else {
+            cout << "n/a" << endl;
+        }
+    }
+
+    cudaEventDestroy(start);
+    cudaEventDestroy(stop);
+    cudaFree(gpuFloats);
+    cudaStreamDestroy(stream);
+    return 0;
+}
@@ -0,0 +1,60 @@
+// measures cudaMemsetAsync bandwidth, across sizes and alignments, timed with events. Run it
+// with different COCL_FILL_VECTOR_WIDTH (1, 4, 8), and with COCL_FILL_NATIVE=1, to compare
+// the fill kernels with each other, and with the driver's clEnqueueFillBuffer
+
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+#include <cuda.h>
+
+const int numRepeats = 10;
+
+int main(int argc, char *argv[]) {
+    size_t maxBytes = 256 * 1024 * 1024;
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+    char *gpuBytes;
+    cudaMalloc((void **)&gpuBytes, maxBytes + 16);
+
+    cudaEvent_t start;
+    cudaEvent_t stop;
+    cudaEventCreate(&start);
+    cudaEventCreate(&stop);
+
+    const char *vectorWidth = getenv("COCL_FILL_VECTOR_WIDTH");
+    const char *native = getenv("COCL_FILL_NATIVE");
+    cout << "COCL_FILL_VECTOR_WIDTH=" << (vectorWidth == 0 ? "(unset)" : vectorWidth)
+        << " COCL_FILL_NATIVE=" << (native == 0 ? "(unset)" : native) << endl;
+
+    // warm up, so the kernel compiles arent included in the timings
+    cudaMemsetAsync(gpuBytes + 1, 0, 1024, stream);
+    cudaStreamSynchronize(stream);
+
+    cout << "bytes\toffset\tus_per_fill\tGB_per_sec" << endl;
+    for(size_t bytes = 4096; bytes <= maxBytes; bytes *= 8) {
+        for(int offset = 0; offset <= 1; offset++) {
+            cudaEventRecord(start, stream);
+            for(int i = 0; i < numRepeats; i++) {
+                cudaMemsetAsync(gpuBytes + offset, i, bytes, stream);
+            }
+            cudaEventRecord(stop, stream);
+            cudaEventSynchronize(stop);
+            float milliseconds = 0.0f;
+            if(cudaEventElapsedTime(&milliseconds, start, stop) != cudaSuccess) {
+                cout << "cudaEventElapsedTime failed; is COCL_EVENT_TIMING=0?" << endl;
+                return 1;
+            }
+            double seconds = milliseconds / 1000.0 / numRepeats;
+            cout << bytes << "\t" << offset << "\t" << (seconds * 1000000.0) << "\t"
+                << (bytes / seconds / 1e9) << endl;
+        }
+    }
+
+    cudaEventDestroy(start);
+    cudaEventDestroy(stop);
+    cudaFree(gpuBytes);
+    cudaStreamDestroy(stream);
+    return 0;
+}
@@ -0,0 +1,63 @@
+// measures kernel launch overhead, as a function of how many device allocations are live
+//
+// every pointer kernel arg goes through cocl::findMemoryRef, so if the lookup is linear
+// in the number of live allocations, launch time grows with the allocation count
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void increment(float *data, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] += 1.0f;
+    }
+}
+
+double timeLaunches(CUstream stream, float *target, int N, int numLaunches) {
+    // warm up, so the kernel compile isnt included in the timings
+    increment<<<dim3(1,1,1), dim3(32,1,1), 0, stream>>>(target, N);
+    cuStreamSynchronize(stream);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < numLaunches; i++) {
+        increment<<<dim3(1,1,1), dim3(32,1,1), 0, stream>>>(target, N);
+    }
+    cuStreamSynchronize(stream);
+    auto end = std::chrono::high_resolution_clock::now();
+    double totalMicroseconds = std::chrono::duration<double, std::micro>(end - start).count();
+    return totalMicroseconds / numLaunches;
+}
+
+int main(int argc, char *argv[]) {
+    const int N = 32;
+    const int numLaunches = 1000;
+    const int allocCounts[] = {1, 10, 100, 1000, 10000};
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    vector<float *> allocs;
+    cout << "live_allocs\tus_per_launch" << endl;
+    for(int allocCount : allocCounts) {
+        while((int)allocs.size() < allocCount) {
+            float *gpuFloats;
+            cudaMalloc((void **)&gpuFloats, N * sizeof(float));
+            allocs.push_back(gpuFloats);
+        }
+        // always launch against the first allocation, so only the number of live allocations changes
+        double usPerLaunch = timeLaunches(stream, allocs[0], N, numLaunches);
+        cout << allocCount << "\t" << usPerLaunch << endl;
+    }
+
+    for(float *gpuFloats : allocs) {
+        cudaFree(gpuFloats);
+    }
+    cuStreamDestroy(stream);
+    return 0;
+}
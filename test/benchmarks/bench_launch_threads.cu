@@ -0,0 +1,87 @@
+// measures kernel launch throughput, as a function of how many host threads are launching
+//
+// each thread has its own stream and its own buffer, all in main's context, which each thread
+// makes current before launching. So the only thing the threads share is the runtime itself,
+// and that context: launches from different threads should not serialize on one another, and
+// aggregate launches per second should grow with the thread count
+
+#include "pthread.h"
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+const int N = 32;
+const int numLaunchesPerThread = 1000;
+
+__global__ void increment(float *data, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] += 1.0f;
+    }
+}
+
+struct ThreadData {
+    CUcontext context;
+    CUstream stream;
+    float *gpuFloats;
+};
+
+void *thread_func(void *data) {
+    ThreadData *threadData = (ThreadData *)data;
+    // otherwise the first launch creates a new context for this thread, which knows neither the
+    // stream nor the buffer
+    cuCtxSetCurrent(threadData->context);
+    for(int i = 0; i < numLaunchesPerThread; i++) {
+        increment<<<dim3(1,1,1), dim3(32,1,1), 0, threadData->stream>>>(threadData->gpuFloats, N);
+    }
+    cuStreamSynchronize(threadData->stream);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const int threadCounts[] = {1, 2, 4, 8, 16};
+    const int maxThreads = 16;
+
+    vector<ThreadData> threadDatas(maxThreads);
+    for(int i = 0; i < maxThreads; i++) {
+        cuStreamCreate(&threadDatas[i].stream, 0);
+        cudaMalloc((void **)&threadDatas[i].gpuFloats, N * sizeof(float));
+        // warm up, so the kernel compile isnt included in the timings
+        increment<<<dim3(1,1,1), dim3(32,1,1), 0, threadDatas[i].stream>>>(threadDatas[i].gpuFloats, N);
+        cuStreamSynchronize(threadDatas[i].stream);
+    }
+    CUcontext context;
+    cuCtxGetCurrent(&context);
+    for(int i = 0; i < maxThreads; i++) {
+        threadDatas[i].context = context;
+    }
+
+    cout << "threads\tlaunches_per_sec\tus_per_launch" << endl;
+    for(int numThreads : threadCounts) {
+        vector<pthread_t> threads(numThreads);
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < numThreads; i++) {
+            pthread_create(&threads[i], NULL, thread_func, &threadDatas[i]);
+        }
+        for(int i = 0; i < numThreads; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double totalMicroseconds = std::chrono::duration<double, std::micro>(end - start).count();
+        int totalLaunches = numThreads * numLaunchesPerThread;
+        cout << numThreads << "\t" << (totalLaunches / totalMicroseconds * 1000000.0) << "\t"
+            << (totalMicroseconds / totalLaunches) << endl;
+    }
+
+    for(int i = 0; i < maxThreads; i++) {
+        cudaFree(threadDatas[i].gpuFloats);
+        cuStreamDestroy(threadDatas[i].stream);
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+// dynamic shared memory: an extern __shared__ array, sized by the third <<<...>>> argument.
+// Sums each block of the input, with a tree reduction in shared memory, for a couple of
+// block sizes, so each launch passes a different number of shared bytes
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__device__ void storeShared(float *buf, int offset, float value) {
+    // writes through the extern array from a helper function, as well as from the kernel
+    extern __shared__ float shared[];
+    shared[offset] = value;
+    buf[offset] = value;
+}
+
+__global__ void blockSums(float *out, float *scratch, const float *in) {
+    extern __shared__ float shared[];
+    int tid = threadIdx.x;
+    int offset = blockIdx.x * blockDim.x;
+    storeShared(scratch + offset, tid, in[offset + tid]);
+    __syncthreads();
+    for(int stride = blockDim.x / 2; stride > 0; stride >>= 1) {
+        if(tid < stride) {
+            shared[tid] += shared[tid + stride];
+        }
+        __syncthreads();
+    }
+    if(tid == 0) {
+        out[blockIdx.x] = shared[0];
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const int N = 1024;
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    float hostIn[N];
+    float hostOut[N];
+    for(int i = 0; i < N; i++) {
+        hostIn[i] = i % 7;
+    }
+    float *gpuIn;
+    float *gpuOut;
+    float *gpuScratch;
+    cudaMalloc((void **)&gpuIn, N * sizeof(float));
+    cudaMalloc((void **)&gpuOut, N * sizeof(float));
+    cudaMalloc((void **)&gpuScratch, N * sizeof(float));
+    cudaMemcpy(gpuIn, hostIn, N * sizeof(float), cudaMemcpyHostToDevice);
+
+    int blockSizes[] = {64, 256};
+    for(int b = 0; b < 2; b++) {
+        int blockSize = blockSizes[b];
+        int numBlocks = N / blockSize;
+        blockSums<<<dim3(numBlocks, 1, 1), dim3(blockSize, 1, 1), blockSize * sizeof(float), stream>>>(
+            gpuOut, gpuScratch, gpuIn);
+        cudaMemcpy(hostOut, gpuOut, numBlocks * sizeof(float), cudaMemcpyDeviceToHost);
+        for(int block = 0; block < numBlocks; block++) {
+            float expected = 0.0f;
+            for(int i = 0; i < blockSize; i++) {
+                expected += hostIn[block * blockSize + i];
+            }
+            if(hostOut[block] != expected) {
+                cout << "blockSize=" << blockSize << " block=" << block << " got " << hostOut[block]
+                     << " expected " << expected << endl;
+            }
+            assert(hostOut[block] == expected);
+        }
+    }
+    cout << "ok" << endl;
+
+    cudaFree(gpuIn);
+    cudaFree(gpuOut);
+    cudaFree(gpuScratch);
+    cudaStreamDestroy(stream);
+    return 0;
+}
@@ -0,0 +1,67 @@
+// tests cudaEventElapsedTime: the time between two events should cover the kernel launched
+// between them, and fit inside the host's own timing of the same work
+
+#include <iostream>
+#include <memory>
+#include <chrono>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+// each thread only touches its own element, so the runtime scales with iters, not with N
+__global__ void longKernel(float *data, int iters, float value) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    for(int it = 0; it < iters; it++) {
+        data[tid] = data[tid] * 1.0001f + value;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int N = 102400;
+
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    float *gpuFloats;
+    cudaMalloc((void **)&gpuFloats, N * sizeof(float));
+    cudaMemsetAsync(gpuFloats, 0, N * sizeof(float), stream);
+
+    // warm up, so the kernel compile isnt inside the timed region
+    longKernel<<<dim3(1, 1, 1), dim3(32, 1, 1), 0, stream>>>(gpuFloats, 1, 1.0f);
+    cudaStreamSynchronize(stream);
+
+    cudaEvent_t start;
+    cudaEvent_t stop;
+    cudaEventCreate(&start);
+    cudaEventCreate(&stop);
+
+    float elapsedMs = 0.0f;
+    // not recorded yet
+    assert(cudaEventElapsedTime(&elapsedMs, start, stop) != cudaSuccess);
+
+    auto hostStart = std::chrono::high_resolution_clock::now();
+    cudaEventRecord(start, stream);
+    // long enough to time, even on a fast gpu, but still well under a second on a cpu device
+    int iters = 4096;
+    longKernel<<<dim3(N / 32, 1, 1), dim3(32, 1, 1), 0, stream>>>(gpuFloats, iters, 3.0f);
+    cudaEventRecord(stop, stream);
+    cudaEventSynchronize(stop);
+    auto hostEnd = std::chrono::high_resolution_clock::now();
+    double hostMs = std::chrono::duration<double, std::milli>(hostEnd - hostStart).count();
+
+    cudaError_t err = cudaEventElapsedTime(&elapsedMs, start, stop);
+    cout << "event elapsed " << elapsedMs << "ms, host elapsed " << hostMs << "ms" << endl;
+    assert(err == cudaSuccess);
+    assert(elapsedMs > 0.0f);
+    // allow for the host and device clocks ticking at slightly different rates
+    assert(elapsedMs <= hostMs * 1.05 + 0.1);
+
+    cudaEventDestroy(start);
+    cudaEventDestroy(stop);
+    cudaFree(gpuFloats);
+    cudaStreamDestroy(stream);
+    cout << "ok" << endl;
+    return 0;
+}
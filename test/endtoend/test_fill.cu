@@ -0,0 +1,110 @@
+// tests the contents of memory after cudaMemsetAsync, across the fill kernel's edge cases: bytes
+// before the first uint, uints before the first whole vector, vectors, uints and bytes after the
+// last whole vector, fills big enough to grid stride, and, where the device has room, a fill
+// past 4GB. Run once per COCL_FILL_VECTOR_WIDTH, see run-test_fill_v1 and run-test_fill_v8
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <stdexcept>
+#include <cstdlib>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+static void checkBytes(const vector<unsigned char> &hostBytes, size_t hostStart,
+        size_t offset, size_t count, unsigned char value, unsigned char background) {
+    for(size_t i = 0; i < hostBytes.size(); i++) {
+        size_t pos = hostStart + i;
+        unsigned char expected = (pos >= offset && pos < offset + count) ? value : background;
+        if(hostBytes[i] != expected) {
+            cout << "offset=" << offset << " count=" << count << " pos=" << pos
+                << " got " << (int)hostBytes[i] << " expected " << (int)expected << endl;
+        }
+        assert(hostBytes[i] == expected);
+    }
+}
+
+static void testSmall(cudaStream_t stream) {
+    // big enough that the vectors grid stride, even with 8 uints per work item
+    size_t N = 8 * 1024 * 1024;
+    unsigned char *gpuBytes;
+    cudaMalloc((void **)&gpuBytes, N);
+    vector<unsigned char> hostBytes(N);
+
+    // offset, count pairs. Offsets 4 to 28 leave the uints misaligned against a uint4 or uint8,
+    // so the kernel stores a head of single uints; the counts then leave tails of 1 to 7 uints,
+    // and 1 to 3 bytes
+    size_t cases[][2] = {
+        {0, N}, {1, N - 1}, {0, N - 1}, {1, N - 2},
+        {0, 4}, {0, 28}, {0, 32}, {0, 36}, {4, 4}, {4, 28}, {4, 32}, {12, 64}, {20, 100},
+        {28, 4}, {28, 8}, {1, 3}, {1, 4}, {2, 33}, {3, 61}, {5, 1}, {7, 6}, {13, 67},
+        {4, N - 8}, {12, N - 13}, {31, N - 64}, {N - 5, 5}, {N - 33, 33}, {100, 0}
+    };
+    int numCases = sizeof(cases) / sizeof(cases[0]);
+    for(int c = 0; c < numCases; c++) {
+        size_t offset = cases[c][0];
+        size_t count = cases[c][1];
+        cudaMemsetAsync(gpuBytes, 0xab, N, stream);
+        cudaMemsetAsync(gpuBytes + offset, 0x5c, count, stream);
+        cudaMemcpyAsync(&hostBytes[0], gpuBytes, N, cudaMemcpyDeviceToHost, stream);
+        cudaStreamSynchronize(stream);
+        checkBytes(hostBytes, 0, offset, count, 0x5c, 0xab);
+        cout << "offset=" << offset << " count=" << count << " ok" << endl;
+    }
+    cudaFree(gpuBytes);
+}
+
+// over 4GB, so the uint count alone no longer fits in 32 bits. Checks around the 2GB and 4GB
+// boundaries, and both ends, rather than copying the whole lot back
+static void testLarge(cudaStream_t stream) {
+    size_t N = (1ull << 32) + 4096 + 3;
+    cudaDeviceProp prop;
+    cudaGetDeviceProperties(&prop, 0);
+    if(prop.totalGlobalMem < N * 2) {
+        cout << "skipping fill over 4GB: device only has " << prop.totalGlobalMem << " bytes" << endl;
+        return;
+    }
+    unsigned char *gpuBytes = 0;
+    try {
+        cudaMalloc((void **)&gpuBytes, N);
+        cudaMemsetAsync(gpuBytes, 0xab, N, stream);
+        cudaStreamSynchronize(stream);
+    } catch(runtime_error &e) {
+        // most devices cap a single buffer well below their total memory
+        cout << "skipping fill over 4GB: " << e.what() << endl;
+        if(gpuBytes != 0) {
+            cudaFree(gpuBytes);
+        }
+        return;
+    }
+    size_t offset = 1;
+    size_t count = N - 2;
+    cudaMemsetAsync(gpuBytes + offset, 0x5c, count, stream);
+
+    size_t sliceBytes = 4096;
+    size_t sliceStarts[] = { 0, (1ull << 31) - sliceBytes / 2, (1ull << 32) - sliceBytes / 2, N - sliceBytes };
+    vector<unsigned char> hostBytes(sliceBytes);
+    for(int s = 0; s < 4; s++) {
+        cudaMemcpyAsync(&hostBytes[0], gpuBytes + sliceStarts[s], sliceBytes, cudaMemcpyDeviceToHost, stream);
+        cudaStreamSynchronize(stream);
+        checkBytes(hostBytes, sliceStarts[s], offset, count, 0x5c, 0xab);
+    }
+    cout << "offset=" << offset << " count=" << count << " ok" << endl;
+    cudaFree(gpuBytes);
+}
+
+int main(int argc, char *argv[]) {
+    const char *vectorWidth = getenv("COCL_FILL_VECTOR_WIDTH");
+    cout << "COCL_FILL_VECTOR_WIDTH=" << (vectorWidth == 0 ? "(unset)" : vectorWidth) << endl;
+
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+    testSmall(stream);
+    testLarge(stream);
+    cudaStreamDestroy(stream);
+    cout << "ok" << endl;
+    return 0;
+}
@@ -0,0 +1,68 @@
+// double indirection, ie float **, in kernel parameter, where the pointed-to buffers
+// come from separate cudaMallocs, rather than being carved out of one single arena
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+struct BoundedArray {
+    float *bounded_array[8];
+};
+
+__global__ void run_bounded_array(struct BoundedArray boundedArray, int numBuffers, int N) {
+    for(int i = 0; i < numBuffers; i++) {
+        for(int j = 0; j < N; j++) {
+            boundedArray.bounded_array[i][j] = 123.0f + i + 1 + j;
+        }
+    }
+}
+
+void test1() {
+    int N = 1024;
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    const int numBuffers = 3;
+
+    // the first two are small, so probably share a slab. The last one is too big for a slab,
+    // so gets its own clmem, and the kernel needs more than one entry in its vmem segment table
+    size_t bufferSizes[numBuffers] = {N * sizeof(float), N * sizeof(float), 20 * 1024 * 1024};
+
+    struct BoundedArray boundedArray;
+    float *hostFloats[numBuffers];
+    for(int i = 0; i < numBuffers; i++) {
+        cudaMalloc((void **)&boundedArray.bounded_array[i], bufferSizes[i]);
+        std::cout << "bounded_array[" << i << "]=" << (long)boundedArray.bounded_array[i] << std::endl;
+        hostFloats[i] = new float[N];
+    }
+
+    run_bounded_array<<<dim3(1,1,1), dim3(32,1,1), 0, stream>>>(boundedArray, numBuffers, N);
+
+    for(int i = 0; i < numBuffers; i++) {
+        cudaMemcpy(hostFloats[i], boundedArray.bounded_array[i], N * sizeof(float), cudaMemcpyDeviceToHost);
+    }
+    cuStreamSynchronize(stream);
+
+    for(int i = 0; i < numBuffers; i++) {
+        for(int j = 0; j < N; j++) {
+            assert(hostFloats[i][j] == 123.0f + i + 1 + j);
+        }
+    }
+
+    for(int i = 0; i < numBuffers; i++) {
+        cudaFree(boundedArray.bounded_array[i]);
+        delete[] hostFloats[i];
+    }
+    cuStreamDestroy(stream);
+    cout << "test1 ok" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    test1();
+    return 0;
+}
@@ -28,6 +28,7 @@ void testfloatstar() {
     cuMemAlloc(&deviceFloats1, N * sizeof(float));
 
     getValue<<<dim3(1,1,1), dim3(32,1,1), 0, stream>>>(((float *)deviceFloats1), 0);
+    int64_t argsPerLaunch = cocl::getNumKernelArgsSet();
     getValue<<<dim3(1,1,1), dim3(32,1,1), 0, stream>>>(((float *)deviceFloats1), 0);
     getValue<<<dim3(1,1,1), dim3(32,1,1), 0, stream>>>(((float *)deviceFloats1), 0);
     getValue<<<dim3(1,1,1), dim3(32,1,1), 0, stream>>>(((float *)deviceFloats1), 0);
@@ -35,9 +36,15 @@ void testfloatstar() {
 
     cout << "num kernels cached " << cocl::getNumCachedKernels() << endl;
     cout << "num kernel calls " << cocl::getNumKernelCalls() << endl;
+    cout << "num kernel args set " << cocl::getNumKernelArgsSet() << endl;
+    cout << "num kernel args skipped " << cocl::getNumKernelArgsSkipped() << endl;
 
     assert(cocl::getNumCachedKernels() == 1);
     assert(cocl::getNumKernelCalls() == 4);
+    // the relaunches had identical args, so the kernel already had them all
+    assert(argsPerLaunch > 0);
+    assert(cocl::getNumKernelArgsSet() == argsPerLaunch);
+    assert(cocl::getNumKernelArgsSkipped() == 3 * argsPerLaunch);
 
     cuMemFreeHost(hostFloats1);
     cuMemFree(deviceFloats1);
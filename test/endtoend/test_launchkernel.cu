@@ -0,0 +1,66 @@
+// launches through cudaLaunchKernel, the launch ABI of newer CUDA headers and clang, which
+// takes the launch configuration, and an array of pointers to the args, in a single call.
+// patch_hostside rewrites the call into a coriander launch, finding the args in the array
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+struct Offsets {
+    float add;
+    float mul;
+};
+
+__global__ void transform(float *out, const float *in, int n, float scale, struct Offsets offsets) {
+    int tid = threadIdx.x;
+    if(tid < n) {
+        out[tid] = (in[tid] * scale + offsets.add) * offsets.mul;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const int N = 32;
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    float hostIn[N];
+    float hostOut[N];
+    for(int i = 0; i < N; i++) {
+        hostIn[i] = i;
+        hostOut[i] = 0.0f;
+    }
+    float *gpuIn;
+    float *gpuOut;
+    cudaMalloc((void **)&gpuIn, N * sizeof(float));
+    cudaMalloc((void **)&gpuOut, N * sizeof(float));
+    cudaMemcpy(gpuIn, hostIn, N * sizeof(float), cudaMemcpyHostToDevice);
+    cudaMemcpy(gpuOut, hostOut, N * sizeof(float), cudaMemcpyHostToDevice);
+
+    // only the first n are written
+    int n = N - 2;
+    float scale = 2.0f;
+    struct Offsets offsets = {1.0f, 3.0f};
+    void *args[] = {&gpuOut, &gpuIn, &n, &scale, &offsets};
+    cudaError_t err = cudaLaunchKernel((const void *)transform, dim3(1,1,1), dim3(N,1,1), args, 0, stream);
+    assert(err == cudaSuccess);
+    cudaStreamSynchronize(stream);
+
+    cudaMemcpy(hostOut, gpuOut, N * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < N; i++) {
+        float expected = i < n ? (i * 2.0f + 1.0f) * 3.0f : 0.0f;
+        if(hostOut[i] != expected) {
+            cout << "i=" << i << " got " << hostOut[i] << " expected " << expected << endl;
+        }
+        assert(hostOut[i] == expected);
+    }
+    cout << "ok" << endl;
+
+    cudaFree(gpuIn);
+    cudaFree(gpuOut);
+    cudaStreamDestroy(stream);
+    return 0;
+}
@@ -0,0 +1,128 @@
+// tests cudaMallocPitch, cudaMemcpy2D, cudaMemcpy2DAsync, cudaMemcpy3D and cudaMemset2D: pitched
+// rows on the device, tightly packed rows on the host, and copies of sub-rectangles and sub-boxes
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+// adds value to each float in a width x height pitched image
+__global__ void addValue(float *data, size_t pitch, int width, int height, float value) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x;
+    int y = blockIdx.y;
+    if(x < width && y < height) {
+        float *row = (float *)((char *)data + y * pitch);
+        row[x] += value;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int width = 37; // floats per row, so the pitch needs padding
+    int height = 11;
+    size_t rowBytes = width * sizeof(float);
+
+    float *gpuImage;
+    size_t pitch;
+    cudaMallocPitch((void **)&gpuImage, &pitch, rowBytes, height);
+    cout << "pitch " << pitch << endl;
+    assert(pitch >= rowBytes);
+
+    vector<float> hostImage(width * height);
+    for(int i = 0; i < width * height; i++) {
+        hostImage[i] = i;
+    }
+    assert(cudaMemcpy2D(gpuImage, pitch, &hostImage[0], rowBytes, rowBytes, height, cudaMemcpyHostToDevice) == cudaSuccess);
+    addValue<<<dim3(1, height, 1), dim3(64, 1, 1)>>>(gpuImage, pitch, width, height, 0.5f);
+
+    // back, async, on a stream, from a second pitched image via a device to device copy
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+    float *gpuImage2;
+    size_t pitch2;
+    cudaMallocPitch((void **)&gpuImage2, &pitch2, rowBytes + 200, height);
+    assert(cudaMemcpy2DAsync(gpuImage2, pitch2, gpuImage, pitch, rowBytes, height, cudaMemcpyDeviceToDevice, stream) == cudaSuccess);
+    vector<float> result(width * height);
+    assert(cudaMemcpy2DAsync(&result[0], rowBytes, gpuImage2, pitch2, rowBytes, height, cudaMemcpyDeviceToHost, stream) == cudaSuccess);
+    cudaStreamSynchronize(stream);
+    for(int i = 0; i < width * height; i++) {
+        assert(result[i] == i + 0.5f);
+    }
+
+    // async from pageable memory: overwriting the source straight away mustnt matter
+    for(int i = 0; i < width * height; i++) {
+        hostImage[i] = 2 * i;
+    }
+    cudaMemcpy2DAsync(gpuImage, pitch, &hostImage[0], rowBytes, rowBytes, height, cudaMemcpyHostToDevice, stream);
+    for(int i = 0; i < width * height; i++) {
+        hostImage[i] = -1;
+    }
+    cudaMemcpy2DAsync(&result[0], rowBytes, gpuImage, pitch, rowBytes, height, cudaMemcpyDeviceToHost, stream);
+    cudaStreamSynchronize(stream);
+    for(int i = 0; i < width * height; i++) {
+        assert(result[i] == 2 * i);
+    }
+
+    // cudaMemset2D leaves the padding, and rows outside, alone
+    cudaMemset2D(gpuImage, pitch, 0, 4 * sizeof(float), 3);
+    cudaMemcpy2D(&result[0], rowBytes, gpuImage, pitch, rowBytes, height, cudaMemcpyDeviceToHost);
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            float expected = (x < 4 && y < 3) ? 0.0f : 2 * (y * width + x);
+            assert(result[y * width + x] == expected);
+        }
+    }
+
+    // a width 3, height 2, depth 2 box of floats, out of a 5 x 4 x 3 volume, into a packed host array
+    int volWidth = 5;
+    int volHeight = 4;
+    int volDepth = 3;
+    float *gpuVolume;
+    size_t volPitch;
+    cudaMallocPitch((void **)&gpuVolume, &volPitch, volWidth * sizeof(float), volHeight * volDepth);
+    vector<float> hostVolume(volWidth * volHeight * volDepth);
+    for(int i = 0; i < volWidth * volHeight * volDepth; i++) {
+        hostVolume[i] = i;
+    }
+    cudaMemcpy3DParms up = {0};
+    up.srcPtr = make_cudaPitchedPtr(&hostVolume[0], volWidth * sizeof(float), volWidth * sizeof(float), volHeight);
+    up.dstPtr = make_cudaPitchedPtr(gpuVolume, volPitch, volWidth * sizeof(float), volHeight);
+    up.extent = make_cudaExtent(volWidth * sizeof(float), volHeight, volDepth);
+    up.kind = cudaMemcpyHostToDevice;
+    assert(cudaMemcpy3D(&up) == cudaSuccess);
+
+    vector<float> box(3 * 2 * 2);
+    cudaMemcpy3DParms down = {0};
+    down.srcPtr = make_cudaPitchedPtr(gpuVolume, volPitch, volWidth * sizeof(float), volHeight);
+    down.srcPos = make_cudaPos(1 * sizeof(float), 2, 1);
+    down.dstPtr = make_cudaPitchedPtr(&box[0], 3 * sizeof(float), 3 * sizeof(float), 2);
+    down.extent = make_cudaExtent(3 * sizeof(float), 2, 2);
+    down.kind = cudaMemcpyDeviceToHost;
+    assert(cudaMemcpy3D(&down) == cudaSuccess);
+    for(int z = 0; z < 2; z++) {
+        for(int y = 0; y < 2; y++) {
+            for(int x = 0; x < 3; x++) {
+                float expected = (z + 1) * volWidth * volHeight + (y + 2) * volWidth + (x + 1);
+                assert(box[(z * 2 + y) * 3 + x] == expected);
+            }
+        }
+    }
+
+    // rows wider than the pitch are an error
+    assert(cudaMemcpy2D(&result[0], rowBytes, gpuImage, pitch, pitch + 4, height, cudaMemcpyDeviceToHost) == cudaErrorInvalidPitchValue);
+    // as are host pointers where device memory should be, boxes running off the end of the
+    // allocation, and copies that dont touch the device at all
+    assert(cudaMemcpy2D(&result[0], rowBytes, &result[0], rowBytes, rowBytes, height, cudaMemcpyDeviceToHost) == cudaErrorInvalidValue);
+    assert(cudaMemcpy2D(&result[0], rowBytes, gpuImage, pitch, rowBytes, height + 1, cudaMemcpyDeviceToHost) == cudaErrorInvalidValue);
+    assert(cudaMemcpy2D(&result[0], rowBytes, &result[0], rowBytes, rowBytes, height, cudaMemcpyHostToHost) == cudaErrorInvalidValue);
+
+    cudaFree(gpuVolume);
+    cudaFree(gpuImage2);
+    cudaFree(gpuImage);
+    cudaStreamDestroy(stream);
+    cout << "ok" << endl;
+    return 0;
+}
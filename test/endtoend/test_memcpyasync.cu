@@ -0,0 +1,71 @@
+// tests cuMemcpyHtoDAsync and cudaMemcpyAsync from pageable memory: they return before the
+// transfer has happened, so the host buffer is staged first, and overwriting it straight after
+// the call mustnt change what reaches the device. Sized to span several staging chunks
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addValue(float *data, int N, float value) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] += value;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // 3MB and a bit, so the last chunk is a partial one
+    int N = 3 * 1024 * 1024 / 4 + 37;
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    CUdeviceptr deviceFloats;
+    cuMemAlloc(&deviceFloats, N * sizeof(float));
+
+    vector<float> hostFloats(N);
+    for(int i = 0; i < N; i++) {
+        hostFloats[i] = i % 1000;
+    }
+    cuMemcpyHtoDAsync(deviceFloats, &hostFloats[0], N * sizeof(float), stream);
+    // the copy might not even have started yet
+    for(int i = 0; i < N; i++) {
+        hostFloats[i] = -1.0f;
+    }
+    addValue<<<dim3((N + 255) / 256, 1, 1), dim3(256, 1, 1), 0, stream>>>((float *)deviceFloats, N, 0.5f);
+    cuMemcpyDtoHAsync(&hostFloats[0], deviceFloats, N * sizeof(float), stream);
+    cuStreamSynchronize(stream);
+    for(int i = 0; i < N; i++) {
+        if(hostFloats[i] != i % 1000 + 0.5f) {
+            cout << "i=" << i << " hostFloats[i]=" << hostFloats[i] << endl;
+        }
+        assert(hostFloats[i] == i % 1000 + 0.5f);
+    }
+
+    // same again, via the runtime api
+    cudaStream_t cudaStream;
+    cudaStreamCreate(&cudaStream);
+    for(int i = 0; i < N; i++) {
+        hostFloats[i] = 3.0f;
+    }
+    cudaMemcpyAsync((float *)deviceFloats, &hostFloats[0], N * sizeof(float), cudaMemcpyHostToDevice, cudaStream);
+    for(int i = 0; i < N; i++) {
+        hostFloats[i] = -1.0f;
+    }
+    cudaMemcpyAsync(&hostFloats[0], (float *)deviceFloats, N * sizeof(float), cudaMemcpyDeviceToHost, cudaStream);
+    cudaStreamSynchronize(cudaStream);
+    for(int i = 0; i < N; i++) {
+        assert(hostFloats[i] == 3.0f);
+    }
+
+    cudaStreamDestroy(cudaStream);
+    cuMemFree(deviceFloats);
+    cuStreamDestroy(stream);
+    cout << "ok" << endl;
+    return 0;
+}
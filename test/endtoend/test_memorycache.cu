@@ -0,0 +1,65 @@
+// checks that cudaFree'd buffers are recycled by later cudaMallocs of similar size,
+// rather than going back to clCreateBuffer
+//
+// small allocations are carved out of slabs, and dont touch the cache directly, so we
+// use allocations larger than the slab allocator takes (a quarter of a 64MB slab)
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void setValue(float *data, int N, float value) {
+    int tid = threadIdx.x;
+    if(tid < N) {
+        data[tid] = value;
+    }
+}
+
+void testRecycle() {
+    int N = 8 * 1024 * 1024;
+
+    cocl::trimMemoryCache();
+    cocl::MemoryCacheStats before = cocl::getMemoryCacheStats();
+
+    float *gpuFloats1;
+    cudaMalloc((void **)&gpuFloats1, N * sizeof(float));
+    cudaFree(gpuFloats1);
+
+    // slightly different size, but should be in the same size class
+    float *gpuFloats2;
+    cudaMalloc((void **)&gpuFloats2, (N - 1) * sizeof(float));
+
+    cocl::MemoryCacheStats after = cocl::getMemoryCacheStats();
+    cout << "cache hits " << (after.numCacheHits - before.numCacheHits)
+        << " misses " << (after.numCacheMisses - before.numCacheMisses) << endl;
+    assert(after.numCacheHits - before.numCacheHits == 1);
+    assert(after.numCacheMisses - before.numCacheMisses == 1);
+    assert(after.cachedBuffers == 0);
+
+    // check the recycled buffer still works
+    setValue<<<dim3(1,1,1), dim3(32,1,1)>>>(gpuFloats2, 32, 123.0f);
+    float hostFloats[32];
+    cudaMemcpy(hostFloats, gpuFloats2, 32 * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < 32; i++) {
+        assert(hostFloats[i] == 123.0f);
+    }
+
+    cudaFree(gpuFloats2);
+    after = cocl::getMemoryCacheStats();
+    assert(after.cachedBuffers == 1);
+
+    cocl::trimMemoryCache();
+    after = cocl::getMemoryCacheStats();
+    assert(after.cachedBuffers == 0);
+    assert(after.cachedBytes == 0);
+    cout << "testRecycle ok" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    testRecycle();
+    return 0;
+}
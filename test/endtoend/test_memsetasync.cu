@@ -0,0 +1,55 @@
+// tests cudaMemsetAsync: any offset, and any count, not just multiples of 4, and ordered on
+// the stream it is given, so a memset on a side stream lands between the kernels around it
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void setValue(unsigned char *data, int N, unsigned char value) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] = value;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int N = 4096;
+
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    unsigned char *gpuBytes;
+    cudaMalloc((void **)&gpuBytes, N);
+    vector<unsigned char> hostBytes(N);
+
+    // offset, count pairs: unaligned head, unaligned tail, both, and smaller than one uint
+    int cases[][2] = { {0, N}, {1, 100}, {4, 17}, {3, 1}, {5, 2}, {6, 3001}, {N - 3, 3}, {8, 0} };
+    int numCases = sizeof(cases) / sizeof(cases[0]);
+    for(int c = 0; c < numCases; c++) {
+        int offset = cases[c][0];
+        int count = cases[c][1];
+        setValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, stream>>>(gpuBytes, N, 0xab);
+        cudaMemsetAsync(gpuBytes + offset, 0x5c, count, stream);
+        cudaMemcpyAsync(&hostBytes[0], gpuBytes, N, cudaMemcpyDeviceToHost, stream);
+        cudaStreamSynchronize(stream);
+        for(int i = 0; i < N; i++) {
+            unsigned char expected = (i >= offset && i < offset + count) ? 0x5c : 0xab;
+            if(hostBytes[i] != expected) {
+                cout << "offset=" << offset << " count=" << count << " i=" << i
+                    << " got " << (int)hostBytes[i] << " expected " << (int)expected << endl;
+            }
+            assert(hostBytes[i] == expected);
+        }
+        cout << "offset=" << offset << " count=" << count << " ok" << endl;
+    }
+
+    cudaFree(gpuBytes);
+    cudaStreamDestroy(stream);
+    cout << "ok" << endl;
+    return 0;
+}
@@ -0,0 +1,77 @@
+// small allocations are carved out of shared slabs. Check that they dont overlap, that
+// kernels and memcpys see the right offsets, and that launching with different combinations
+// of buffers doesnt generate a new kernel variant each time
+
+#include "hostside_opencl_funcs_ext.h"
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addOne(float *out, float *in, int N) {
+    int tid = threadIdx.x;
+    if(tid < N) {
+        out[tid] = in[tid] + 1.0f;
+    }
+}
+
+void testSlab() {
+    const int N = 32;
+    const int numBuffers = 4;
+
+    float *gpuBuffers[numBuffers];
+    for(int i = 0; i < numBuffers; i++) {
+        // odd sizes, so allocations dont happen to line up
+        cudaMalloc((void **)&gpuBuffers[i], N * sizeof(float) + i * 4 + 1);
+    }
+
+    float hostFloats[N];
+    for(int i = 0; i < N; i++) {
+        hostFloats[i] = i;
+    }
+    cudaMemcpy(gpuBuffers[0], hostFloats, N * sizeof(float), cudaMemcpyHostToDevice);
+
+    int numCachedBefore = cocl::getNumCachedKernels();
+    // 0 -> 1 -> 2 -> 3, each adding one
+    for(int i = 1; i < numBuffers; i++) {
+        addOne<<<dim3(1,1,1), dim3(32,1,1)>>>(gpuBuffers[i], gpuBuffers[i - 1], N);
+    }
+    int numCachedAfter = cocl::getNumCachedKernels();
+    cout << "new kernel variants " << (numCachedAfter - numCachedBefore) << endl;
+    assert(numCachedAfter - numCachedBefore == 1);
+
+    cudaMemcpy(hostFloats, gpuBuffers[numBuffers - 1], N * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < N; i++) {
+        assert(hostFloats[i] == i + numBuffers - 1);
+    }
+
+    // free the middle ones, and reallocate, to exercise reuse of freed ranges
+    cudaFree(gpuBuffers[1]);
+    cudaFree(gpuBuffers[2]);
+    float *reused;
+    cudaMalloc((void **)&reused, 2 * N * sizeof(float));
+    addOne<<<dim3(1,1,1), dim3(32,1,1)>>>(reused, gpuBuffers[numBuffers - 1], N);
+    cudaMemcpy(hostFloats, reused, N * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < N; i++) {
+        assert(hostFloats[i] == i + numBuffers);
+    }
+    // and the neighbours are untouched
+    cudaMemcpy(hostFloats, gpuBuffers[0], N * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < N; i++) {
+        assert(hostFloats[i] == i);
+    }
+
+    cudaFree(reused);
+    cudaFree(gpuBuffers[0]);
+    cudaFree(gpuBuffers[3]);
+    cout << "testSlab ok" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    testSlab();
+    return 0;
+}
@@ -0,0 +1,67 @@
+// tests cudaStreamQuery: it should return straight away, with cudaErrorNotReady while the
+// stream still has work, and cudaSuccess once that work has finished, so the host can get
+// on with other things whilst polling
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void slowAdd(float *data, int numIterations, float value) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    float sum = data[tid];
+    for(int i = 0; i < numIterations; i++) {
+        sum += value;
+    }
+    data[tid] = sum;
+}
+
+int main(int argc, char *argv[]) {
+    int N = 102400;
+
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    float *gpuFloats;
+    cudaMalloc((void **)&gpuFloats, N * sizeof(float));
+    cudaMemsetAsync(gpuFloats, 0, N * sizeof(float), stream);
+    cudaStreamSynchronize(stream);
+
+    // nothing enqueued yet
+    assert(cudaStreamQuery(stream) == cudaSuccess);
+
+    // long enough that the launches are still in flight when we first poll, so a blocking
+    // cudaStreamQuery would never see cudaErrorNotReady. The sums stay exact in float
+    int numIterations = 50000;
+    slowAdd<<<dim3(N / 32, 1, 1), dim3(32, 1, 1), 0, stream>>>(gpuFloats, numIterations, 3.0f);
+    slowAdd<<<dim3(N / 32, 1, 1), dim3(32, 1, 1), 0, stream>>>(gpuFloats, numIterations, 1.0f);
+    long long numPolls = 0;
+    long long numNotReady = 0;
+    while(true) {
+        cudaError_t err = cudaStreamQuery(stream);
+        numPolls++;
+        if(err == cudaSuccess) {
+            break;
+        }
+        assert(err == cudaErrorNotReady);
+        numNotReady++;
+    }
+    cout << "polled " << numPolls << " times, not ready " << numNotReady << " times" << endl;
+    assert(numNotReady > 0);
+
+    // the work really is done
+    float hostFloats[4];
+    cudaMemcpy(hostFloats, gpuFloats, 4 * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < 4; i++) {
+        assert(hostFloats[i] == numIterations * 4.0f);
+    }
+    assert(cudaStreamQuery(stream) == cudaSuccess);
+
+    cudaFree(gpuFloats);
+    cudaStreamDestroy(stream);
+    cout << "ok" << endl;
+    return 0;
+}
@@ -0,0 +1,62 @@
+// tests that the legacy default stream only waits on other streams while they have work
+// outstanding: once a stream's async work has finished, commands on the default stream
+// shouldnt add any more barriers against it, even though nothing has synchronized that stream
+
+#include "hostside_opencl_funcs_ext.h"
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addValue(float *data, float value) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    data[tid] += value;
+}
+
+int main(int argc, char *argv[]) {
+    int N = 1024;
+
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    float *gpuFloats;
+    cudaMalloc((void **)&gpuFloats, N * sizeof(float));
+    float *gpuOther;
+    cudaMalloc((void **)&gpuOther, N * sizeof(float));
+    cudaMemsetAsync(gpuFloats, 0, N * sizeof(float), stream);
+    cudaStreamSynchronize(stream);
+
+    addValue<<<dim3(N / 32, 1, 1), dim3(32, 1, 1), 0, stream>>>(gpuFloats, 3.0f);
+
+    // stream is most likely still busy, so the default stream has to wait for it
+    long long numWaits = cocl::getNumCrossStreamWaits();
+    cudaMemsetAsync(gpuOther, 0, N * sizeof(float), 0);
+    cout << "cross stream waits, stream busy: " << (cocl::getNumCrossStreamWaits() - numWaits) << endl;
+    assert(cocl::getNumCrossStreamWaits() <= numWaits + 1);
+
+    // the default stream waited for stream, so stream's work has finished too, though only
+    // the default stream has been synchronized
+    cudaStreamSynchronize(0);
+
+    numWaits = cocl::getNumCrossStreamWaits();
+    cudaMemsetAsync(gpuOther, 0, N * sizeof(float), 0);
+    cudaMemsetAsync(gpuOther, 0, N * sizeof(float), 0);
+    cout << "cross stream waits, stream finished: " << (cocl::getNumCrossStreamWaits() - numWaits) << endl;
+    assert(cocl::getNumCrossStreamWaits() == numWaits);
+
+    float hostFloats[4];
+    cudaMemcpy(hostFloats, gpuFloats, 4 * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < 4; i++) {
+        assert(hostFloats[i] == 3.0f);
+    }
+
+    cudaFree(gpuOther);
+    cudaFree(gpuFloats);
+    cudaStreamDestroy(stream);
+    cout << "ok" << endl;
+    return 0;
+}
@@ -0,0 +1,97 @@
+// by-value structs go through a per-stream upload ring. Use a tiny ring, so that many launches
+// in a row wrap around it, and have to wait for earlier launches to free up space, and check
+// each launch still sees its own struct. Also check a struct bigger than the ring still works
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+#include <cstdlib>
+
+using namespace std;
+
+#include <cuda.h>
+
+struct SmallStruct {
+    float f1;
+    float f2;
+};
+
+struct BigStruct {
+    float values[512];
+};
+
+__global__ void addSmallStructs(struct SmallStruct a, struct SmallStruct b, float *out) {
+    out[threadIdx.x] += a.f1 + a.f2 + b.f1 + b.f2;
+}
+
+__global__ void addBigStruct(struct BigStruct big, float *out) {
+    out[threadIdx.x] += big.values[threadIdx.x];
+}
+
+void testWrapAround(CUstream stream, float *gpuOut) {
+    const int N = 32;
+    const int numLaunches = 100;
+
+    float hostOut[N];
+    for(int i = 0; i < N; i++) {
+        hostOut[i] = 0.0f;
+    }
+    cudaMemcpy(gpuOut, hostOut, N * sizeof(float), cudaMemcpyHostToDevice);
+
+    float expected = 0.0f;
+    for(int i = 0; i < numLaunches; i++) {
+        struct SmallStruct a = {(float)i, 1.0f};
+        struct SmallStruct b = {2.0f, (float)(i % 3)};
+        addSmallStructs<<<dim3(1,1,1), dim3(N,1,1), 0, stream>>>(a, b, gpuOut);
+        expected += a.f1 + a.f2 + b.f1 + b.f2;
+    }
+    cuStreamSynchronize(stream);
+
+    cudaMemcpy(hostOut, gpuOut, N * sizeof(float), cudaMemcpyDeviceToHost);
+    cout << "hostOut[0] " << hostOut[0] << " expected " << expected << endl;
+    for(int i = 0; i < N; i++) {
+        assert(hostOut[i] == expected);
+    }
+}
+
+void testBiggerThanRing(CUstream stream, float *gpuOut) {
+    const int N = 32;
+
+    float hostOut[N];
+    for(int i = 0; i < N; i++) {
+        hostOut[i] = 0.0f;
+    }
+    cudaMemcpy(gpuOut, hostOut, N * sizeof(float), cudaMemcpyHostToDevice);
+
+    struct BigStruct big;
+    for(int i = 0; i < 512; i++) {
+        big.values[i] = i * 2;
+    }
+    addBigStruct<<<dim3(1,1,1), dim3(N,1,1), 0, stream>>>(big, gpuOut);
+    cuStreamSynchronize(stream);
+
+    cudaMemcpy(hostOut, gpuOut, N * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < N; i++) {
+        assert(hostOut[i] == i * 2);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // enough for only a few launches at once. The ring is created on the first launch
+    // with a struct, so this has to come before any launches
+    setenv("COCL_UPLOAD_RING_BYTES", "1024", 1);
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    float *gpuOut;
+    cudaMalloc((void **)&gpuOut, 32 * sizeof(float));
+
+    testWrapAround(stream, gpuOut);
+    testBiggerThanRing(stream, gpuOut);
+
+    cudaFree(gpuOut);
+    cuStreamDestroy(stream);
+    cout << "finished" << endl;
+    return 0;
+}
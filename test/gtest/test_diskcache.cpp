@@ -0,0 +1,106 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_diskcache.h"
+#include "cocl/cocl_filesystem.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <ctime>
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace cocl;
+
+namespace {
+
+string makeCacheDir() {
+    return makeTempDir("cocl_diskcache_");
+}
+
+TEST(test_diskcache, test_hash) {
+    EXPECT_EQ(fnv1a("foo"), fnv1a("foo"));
+    EXPECT_NE(fnv1a("foo"), fnv1a("bar"));
+    // chaining shouldnt just be concatenation
+    EXPECT_NE(fnv1a("c", fnv1a("ab")), fnv1a("bc", fnv1a("a")));
+    EXPECT_EQ(16u, hashToHex(fnv1a("foo")).size());
+}
+
+TEST(test_diskcache, test_read_write) {
+    DiskCache diskCache(makeCacheDir(), 1024 * 1024);
+    string contents;
+    EXPECT_FALSE(diskCache.read("key1", &contents));
+
+    string binary("some\0binary\ndata", 16);
+    binary.push_back('\0');
+    diskCache.write("key1", binary);
+    EXPECT_TRUE(diskCache.read("key1", &contents));
+    EXPECT_EQ(binary, contents);
+
+    // overwrite
+    diskCache.write("key1", "other data");
+    EXPECT_TRUE(diskCache.read("key1", &contents));
+    EXPECT_EQ("other data", contents);
+}
+
+TEST(test_diskcache, test_corrupt_file_is_miss) {
+    DiskCache diskCache(makeCacheDir(), 1024 * 1024);
+    diskCache.write("key1", "hello world");
+
+    // truncate
+    {
+        string path = diskCache.getPath("key1");
+        ifstream in(path);
+        string all((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        in.close();
+        ofstream out(path, ios_base::trunc);
+        out << all.substr(0, all.size() - 3);
+    }
+    string contents;
+    EXPECT_FALSE(diskCache.read("key1", &contents));
+
+    // not even a header
+    {
+        ofstream out(diskCache.getPath("key2"), ios_base::trunc);
+        out << "garbage";
+    }
+    EXPECT_FALSE(diskCache.read("key2", &contents));
+}
+
+TEST(test_diskcache, test_evicts_least_recently_used) {
+    string payload(1000, 'x');
+    DiskCache diskCache(makeCacheDir(), 3500);
+    diskCache.write("key1", payload);
+    diskCache.write("key2", payload);
+    diskCache.write("key3", payload);
+    time_t now = time(0);
+    setFileMtime(diskCache.getPath("key1"), now - 300);
+    setFileMtime(diskCache.getPath("key2"), now - 200);
+    setFileMtime(diskCache.getPath("key3"), now - 100);
+
+    // reading key1 makes it the most recently used, so key2 should go first
+    string contents;
+    EXPECT_TRUE(diskCache.read("key1", &contents));
+    diskCache.write("key4", payload);
+
+    EXPECT_TRUE(diskCache.read("key1", &contents));
+    EXPECT_FALSE(diskCache.read("key2", &contents));
+    EXPECT_TRUE(diskCache.read("key4", &contents));
+    EXPECT_LE(diskCache.getTotalBytes(), 3500);
+}
+
+} // namespace
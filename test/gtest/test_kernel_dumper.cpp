@@ -87,27 +87,37 @@ TEST(test_kernel_dumper, basic) {
 // vmem2 is a pointer to a pointer (so we have to unwrap twice)
 #define __vmem2__
 
+#define NUM_CLMEMS 2
+
 struct GlobalVars {
     local int *scratch;
-    global char *clmem0;
-    unsigned long clmem_vmem_offset0;
+    local char *dynamicShared; // extern __shared__ arrays, or 0 if the kernel has none
+    global char *clmems[NUM_CLMEMS];
+    unsigned long clmem_vmem_offsets[NUM_CLMEMS];
 };
 
 inline global float *getGlobalPointer(__vmem__ unsigned long vmemloc, const struct GlobalVars* const globalVars) {
-    return (global float *)(globalVars->clmem0 + vmemloc - globalVars->clmem_vmem_offset0);
+    int segment = 0;
+    for(int i = 1; i < NUM_CLMEMS; i++) {
+        unsigned long offset = globalVars->clmem_vmem_offsets[i];
+        if(offset <= vmemloc && (offset > globalVars->clmem_vmem_offsets[segment] || globalVars->clmem_vmem_offsets[segment] > vmemloc)) {
+            segment = i;
+        }
+    }
+    return (global float *)(globalVars->clmems[segment] + vmemloc - globalVars->clmem_vmem_offsets[segment]);
 }
 
 
 float someFunc_gg(global float* d1, global float* v11, const struct GlobalVars *const pGlobalVars);
 float someFunc_gp(global float* d1, float* v11, const struct GlobalVars *const pGlobalVars);
 float someFunc_pg(float* d1, global float* v11, const struct GlobalVars *const pGlobalVars);
-kernel void someKernel(global char* clmem0, unsigned long clmem_vmem_offset0, global char* clmem1, unsigned long clmem_vmem_offset1, uint d1_offset, uint d2_offset, local int *scratch);
+kernel void someKernel(global char* clmem0, unsigned long clmem_vmem_offset0, global char* clmem1, unsigned long clmem_vmem_offset1, uint d1_offset, uint d2_offset);
 
-kernel void someKernel(global char* clmem0, unsigned long clmem_vmem_offset0, global char* clmem1, unsigned long clmem_vmem_offset1, uint d1_offset, uint d2_offset, local int *scratch) {
+kernel void someKernel(global char* clmem0, unsigned long clmem_vmem_offset0, global char* clmem1, unsigned long clmem_vmem_offset1, uint d1_offset, uint d2_offset) {
     global float* d2 = (global float*)(clmem1 + d2_offset);
     global float* d1 = (global float*)(clmem0 + d1_offset);
 
-    const struct GlobalVars globalVars = { scratch, clmem0, clmem_vmem_offset0 };
+    const struct GlobalVars globalVars = { 0, 0, { clmem0, clmem1 }, { clmem_vmem_offset0, clmem_vmem_offset1 } };
     const struct GlobalVars* const pGlobalVars = &globalVars;
 
     float v4;
@@ -173,27 +183,30 @@ TEST(test_kernel_dumper, redundant_clmems1) {
 // vmem2 is a pointer to a pointer (so we have to unwrap twice)
 #define __vmem2__
 
+#define NUM_CLMEMS 1
+
 struct GlobalVars {
     local int *scratch;
-    global char *clmem0;
-    unsigned long clmem_vmem_offset0;
+    local char *dynamicShared; // extern __shared__ arrays, or 0 if the kernel has none
+    global char *clmems[NUM_CLMEMS];
+    unsigned long clmem_vmem_offsets[NUM_CLMEMS];
 };
 
 inline global float *getGlobalPointer(__vmem__ unsigned long vmemloc, const struct GlobalVars* const globalVars) {
-    return (global float *)(globalVars->clmem0 + vmemloc - globalVars->clmem_vmem_offset0);
+    return (global float *)(globalVars->clmems[0] + vmemloc - globalVars->clmem_vmem_offsets[0]);
 }
 
 
 float someFunc_gg(global float* d1, global float* v11, const struct GlobalVars *const pGlobalVars);
 float someFunc_gp(global float* d1, float* v11, const struct GlobalVars *const pGlobalVars);
 float someFunc_pg(float* d1, global float* v11, const struct GlobalVars *const pGlobalVars);
-kernel void someKernel(global char* clmem0, unsigned long clmem_vmem_offset0, uint d1_offset, uint d2_offset, local int *scratch);
+kernel void someKernel(global char* clmem0, unsigned long clmem_vmem_offset0, uint d1_offset, uint d2_offset);
 
-kernel void someKernel(global char* clmem0, unsigned long clmem_vmem_offset0, uint d1_offset, uint d2_offset, local int *scratch) {
+kernel void someKernel(global char* clmem0, unsigned long clmem_vmem_offset0, uint d1_offset, uint d2_offset) {
     global float* d2 = (global float*)(clmem0 + d2_offset);
     global float* d1 = (global float*)(clmem0 + d1_offset);
 
-    const struct GlobalVars globalVars = { scratch, clmem0, clmem_vmem_offset0 };
+    const struct GlobalVars globalVars = { 0, 0, { clmem0 }, { clmem_vmem_offset0 } };
     const struct GlobalVars* const pGlobalVars = &globalVars;
 
     float v4;
@@ -257,23 +270,26 @@ TEST(test_kernel_dumper, testBranches_phifromfuture) {
 // vmem2 is a pointer to a pointer (so we have to unwrap twice)
 #define __vmem2__
 
+#define NUM_CLMEMS 1
+
 struct GlobalVars {
     local int *scratch;
-    global char *clmem0;
-    unsigned long clmem_vmem_offset0;
+    local char *dynamicShared; // extern __shared__ arrays, or 0 if the kernel has none
+    global char *clmems[NUM_CLMEMS];
+    unsigned long clmem_vmem_offsets[NUM_CLMEMS];
 };
 
 inline global float *getGlobalPointer(__vmem__ unsigned long vmemloc, const struct GlobalVars* const globalVars) {
-    return (global float *)(globalVars->clmem0 + vmemloc - globalVars->clmem_vmem_offset0);
+    return (global float *)(globalVars->clmems[0] + vmemloc - globalVars->clmem_vmem_offsets[0]);
 }
 
 
-kernel void testBranches_phifromfuture(global char* clmem0, unsigned long clmem_vmem_offset0, uint d1_offset, local int *scratch);
+kernel void testBranches_phifromfuture(global char* clmem0, unsigned long clmem_vmem_offset0, uint d1_offset);
 
-kernel void testBranches_phifromfuture(global char* clmem0, unsigned long clmem_vmem_offset0, uint d1_offset, local int *scratch) {
+kernel void testBranches_phifromfuture(global char* clmem0, unsigned long clmem_vmem_offset0, uint d1_offset) {
     global float* d1 = (global float*)(clmem0 + d1_offset);
 
-    const struct GlobalVars globalVars = { scratch, clmem0, clmem_vmem_offset0 };
+    const struct GlobalVars globalVars = { 0, 0, { clmem0 }, { clmem_vmem_offset0 } };
     const struct GlobalVars* const pGlobalVars = &globalVars;
 
     float v12;
@@ -317,20 +333,23 @@ TEST(test_kernel_dumper, usesPointerFunction) {
 // vmem2 is a pointer to a pointer (so we have to unwrap twice)
 #define __vmem2__
 
+#define NUM_CLMEMS 1
+
 struct GlobalVars {
     local int *scratch;
-    global char *clmem0;
-    unsigned long clmem_vmem_offset0;
+    local char *dynamicShared; // extern __shared__ arrays, or 0 if the kernel has none
+    global char *clmems[NUM_CLMEMS];
+    unsigned long clmem_vmem_offsets[NUM_CLMEMS];
 };
 
 inline global float *getGlobalPointer(__vmem__ unsigned long vmemloc, const struct GlobalVars* const globalVars) {
-    return (global float *)(globalVars->clmem0 + vmemloc - globalVars->clmem_vmem_offset0);
+    return (global float *)(globalVars->clmems[0] + vmemloc - globalVars->clmem_vmem_offsets[0]);
 }
 
 
 float* returnsPointer(float* in, const struct GlobalVars *const pGlobalVars);
 global float* returnsPointer_g(global float* in, const struct GlobalVars *const pGlobalVars);
-kernel void usesPointerFunction(global char* clmem0, unsigned long clmem_vmem_offset0, uint in_offset, local int *scratch);
+kernel void usesPointerFunction(global char* clmem0, unsigned long clmem_vmem_offset0, uint in_offset);
 
 global float* returnsPointer_g(global float* in, const struct GlobalVars *const pGlobalVars) {
 
@@ -342,10 +361,10 @@ float* returnsPointer(float* in, const struct GlobalVars *const pGlobalVars) {
 v1:;
     return in;
 }
-kernel void usesPointerFunction(global char* clmem0, unsigned long clmem_vmem_offset0, uint in_offset, local int *scratch) {
+kernel void usesPointerFunction(global char* clmem0, unsigned long clmem_vmem_offset0, uint in_offset) {
     global float* in = (global float*)(clmem0 + in_offset);
 
-    const struct GlobalVars globalVars = { scratch, clmem0, clmem_vmem_offset0 };
+    const struct GlobalVars globalVars = { 0, 0, { clmem0 }, { clmem_vmem_offset0 } };
     const struct GlobalVars* const pGlobalVars = &globalVars;
 
     float v3[1];
@@ -378,24 +397,27 @@ TEST(test_kernel_dumper, usesFunctionReturningVoid) {
 // vmem2 is a pointer to a pointer (so we have to unwrap twice)
 #define __vmem2__
 
+#define NUM_CLMEMS 1
+
 struct GlobalVars {
     local int *scratch;
-    global char *clmem0;
-    unsigned long clmem_vmem_offset0;
+    local char *dynamicShared; // extern __shared__ arrays, or 0 if the kernel has none
+    global char *clmems[NUM_CLMEMS];
+    unsigned long clmem_vmem_offsets[NUM_CLMEMS];
 };
 
 inline global float *getGlobalPointer(__vmem__ unsigned long vmemloc, const struct GlobalVars* const globalVars) {
-    return (global float *)(globalVars->clmem0 + vmemloc - globalVars->clmem_vmem_offset0);
+    return (global float *)(globalVars->clmems[0] + vmemloc - globalVars->clmem_vmem_offsets[0]);
 }
 
 
-kernel void usesFunctionReturningVoid(global char* clmem0, unsigned long clmem_vmem_offset0, uint in_offset, local int *scratch);
+kernel void usesFunctionReturningVoid(global char* clmem0, unsigned long clmem_vmem_offset0, uint in_offset);
 void returnsVoid_g(global float* in, const struct GlobalVars *const pGlobalVars);
 
-kernel void usesFunctionReturningVoid(global char* clmem0, unsigned long clmem_vmem_offset0, uint in_offset, local int *scratch) {
+kernel void usesFunctionReturningVoid(global char* clmem0, unsigned long clmem_vmem_offset0, uint in_offset) {
     global float* in = (global float*)(clmem0 + in_offset);
 
-    const struct GlobalVars globalVars = { scratch, clmem0, clmem_vmem_offset0 };
+    const struct GlobalVars globalVars = { 0, 0, { clmem0 }, { clmem_vmem_offset0 } };
     const struct GlobalVars* const pGlobalVars = &globalVars;
 
 
@@ -429,26 +451,29 @@ TEST(test_kernel_dumper, test_randomintarray) {
 // vmem2 is a pointer to a pointer (so we have to unwrap twice)
 #define __vmem2__
 
+#define NUM_CLMEMS 1
+
 struct GlobalVars {
     local int *scratch;
-    global char *clmem0;
-    unsigned long clmem_vmem_offset0;
+    local char *dynamicShared; // extern __shared__ arrays, or 0 if the kernel has none
+    global char *clmems[NUM_CLMEMS];
+    unsigned long clmem_vmem_offsets[NUM_CLMEMS];
 };
 
 inline global float *getGlobalPointer(__vmem__ unsigned long vmemloc, const struct GlobalVars* const globalVars) {
-    return (global float *)(globalVars->clmem0 + vmemloc - globalVars->clmem_vmem_offset0);
+    return (global float *)(globalVars->clmems[0] + vmemloc - globalVars->clmem_vmem_offsets[0]);
 }
 
 struct class_tensorflow__random__Array {
     int f0[4];
 };
 
-kernel void test_randomintarray(global char* clmem0, unsigned long clmem_vmem_offset0, uint data_offset, local int *scratch);
+kernel void test_randomintarray(global char* clmem0, unsigned long clmem_vmem_offset0, uint data_offset);
 
-kernel void test_randomintarray(global char* clmem0, unsigned long clmem_vmem_offset0, uint data_offset, local int *scratch) {
+kernel void test_randomintarray(global char* clmem0, unsigned long clmem_vmem_offset0, uint data_offset) {
     global int* data = (global int*)(clmem0 + data_offset);
 
-    const struct GlobalVars globalVars = { scratch, clmem0, clmem_vmem_offset0 };
+    const struct GlobalVars globalVars = { 0, 0, { clmem0 }, { clmem_vmem_offset0 } };
     const struct GlobalVars* const pGlobalVars = &globalVars;
 
     int v9;
@@ -47,7 +47,7 @@ def test_program_compiles(extract_value):
 
 
 def test_copy_float(extract_value, q, float_data, float_data_gpu):
-    extract_value.__getattr__(kernelname)(q, (32,), (32,), float_data_gpu, offset_type(0), offset_type(0), cl.LocalMemory(4))
+    extract_value.__getattr__(kernelname)(q, (32,), (32,), float_data_gpu, offset_type(0), offset_type(0))
     cl.enqueue_copy(q, float_data, float_data_gpu)
     q.finish()
     assert float_data[0] == float_data[1]
@@ -156,7 +156,6 @@ __global__ void myKernel(float *data0, float *data1, int N) {
 
     global_size = 256
     workgroup_size = 256
-    # scratch = workgroup_size * 4
 
     kernel(
         queue, (global_size,), (workgroup_size,),
@@ -164,8 +163,7 @@ __global__ void myKernel(float *data0, float *data1, int N) {
         huge_buf_gpu, offset_type(0),
         offset_type(dst_offset),
         offset_type(src_offset),
-        np.int32(N),
-        cl.LocalMemory(4)
+        np.int32(N)
     )
     queue.finish()
     test_common.enqueue_read_buffer_ext(cl, queue, huge_buf_gpu, dst_host, device_offset=dst_offset, size=N * 4)
@@ -205,15 +203,13 @@ __global__ void myKernel(float *data0, float *data1, int N) {
 
 #     global_size = 256
 #     workgroup_size = 256
-#     # scratch = workgroup_size * 4
 
 #     mangledName = '_Z8myKernelPfS_i'
 #     prog.__getattr__(mangledName)(
 #         queue, (global_size,), (workgroup_size,),
 #         huge_buf_gpu, offset_type(dst_offset),
 #         huge_buf_gpu, offset_type(src_offset),
-#         np.int32(N),
-#         cl.LocalMemory(4)
+#         np.int32(N)
 #     )
 #     queue.finish()
 #     # test_common.enqueue_read_buffer_ext(cl, queue, huge_buf_gpu, dst_host, device_offset=dst_offset, size=N * 4)
@@ -43,7 +43,7 @@ def test_cwise_sqrt(context, q, float_data, float_data_gpu):
 
     N = 10
 
-    # global struct Eigen__TensorEvaluator_nopointers* eval_nopointers, global float* eval_ptr0, long eval_ptr0_offset, global float* eval_ptr1, long eval_ptr1_offset, int size, local int *scratch
+    # global struct Eigen__TensorEvaluator_nopointers* eval_nopointers, global float* eval_ptr0, long eval_ptr0_offset, global float* eval_ptr1, long eval_ptr1_offset, int size
 
     # what we need:
     # struct Eigen__TensorEvaluator_nopointers   Note that none of the values we copy across are actually use, so we can just create a sufficiently large buffer...
@@ -52,7 +52,6 @@ def test_cwise_sqrt(context, q, float_data, float_data_gpu):
     # eval_ptr1 => will contian the data we want to reduce
     # eval_ptr1_offset=> 0
     # size =>  eg 10, to reduce 10 values
-    # scratch => set to workgroupsize * sizeof(float)
 
     eval_nopointers_gpu = cl.Buffer(context, cl.mem_flags.READ_WRITE, size=4096)
 
@@ -68,7 +67,6 @@ def test_cwise_sqrt(context, q, float_data, float_data_gpu):
 
     global_size = 256
     workgroup_size = 256
-    scratch = workgroup_size * 4
 
     print('running kernel...')
     prog.__getattr__('_ZN5Eigen8internal15EigenMetaKernelINS_15TensorEvaluatorIKNS_14TensorAssignOpINS_9TensorMapINS_6TensorIfLi1ELi1EiEELi16ENS_11MakePointerEEEKNS_18TensorCwiseUnaryOpINS0_14scalar_sqrt_opIfEEKNS4_INS5_IKfLi1ELi1EiEELi16ES7_EEEEEENS_9GpuDeviceEEEiEEvT_T0_')(
@@ -79,8 +77,7 @@ def test_cwise_sqrt(context, q, float_data, float_data_gpu):
         offset_type(0),
         offset_type(eval_ptr0_offset),
         offset_type(eval_ptr1_offset),
-        np.int32(size),
-        cl.LocalMemory(scratch)
+        np.int32(size)
     )
     # check for errors
     q.finish()
@@ -108,7 +105,7 @@ def test_cwise_sqrt_singlebuffer(context, queue, float_data, float_data_gpu):
 
     N = 10
 
-    # global struct Eigen__TensorEvaluator_nopointers* eval_nopointers, global float* eval_ptr0, long eval_ptr0_offset, global float* eval_ptr1, long eval_ptr1_offset, int size, local int *scratch
+    # global struct Eigen__TensorEvaluator_nopointers* eval_nopointers, global float* eval_ptr0, long eval_ptr0_offset, global float* eval_ptr1, long eval_ptr1_offset, int size
 
     # what we need:
     # struct Eigen__TensorEvaluator_nopointers   Note that none of the values we copy across are actually use, so we can just create a sufficiently large buffer...
@@ -117,7 +114,6 @@ def test_cwise_sqrt_singlebuffer(context, queue, float_data, float_data_gpu):
     # eval_ptr1 => will contian the data we want to reduce
     # eval_ptr1_offset=> 0
     # size =>  eg 10, to reduce 10 values
-    # scratch => set to workgroupsize * sizeof(float)
 
     # by compariosn to the earlier test, we create a sigle buffer, containing both ptr0 and ptr1, and just use
     # offset into this
@@ -147,7 +143,6 @@ def test_cwise_sqrt_singlebuffer(context, queue, float_data, float_data_gpu):
 
     global_size = 256
     workgroup_size = 256
-    scratch = workgroup_size * 4
 
     prog.__getattr__('_ZN5Eigen8internal15EigenMetaKernelINS_15TensorEvaluatorIKNS_14TensorAssignOpINS_9TensorMapINS_6TensorIfLi1ELi1EiEELi16ENS_11MakePointerEEEKNS_18TensorCwiseUnaryOpINS0_14scalar_sqrt_opIfEEKNS4_INS5_IKfLi1ELi1EiEELi16ES7_EEEEEENS_9GpuDeviceEEEiEEvT_T0_')(
         queue, (global_size,), (workgroup_size,),
@@ -157,8 +152,7 @@ def test_cwise_sqrt_singlebuffer(context, queue, float_data, float_data_gpu):
         offset_type(0),
         offset_type(eval_ptr0_offset),
         offset_type(eval_ptr1_offset),
-        np.int32(size),
-        cl.LocalMemory(scratch)
+        np.int32(size)
     )
     # check for errors
     queue.finish()